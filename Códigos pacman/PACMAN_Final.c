@@ -12,11 +12,34 @@
  *  - Use as setas do teclado para mover o Pac-Man.
  *  - Colete todos os itens no labirinto para completar o nvel.
  *  - Evite os monstros, ou perder uma vida.
- *  - Pressione 'TAB' para pausar o jogo e acessar a funo de salvar.
+ *  - Pressione 'TAB' para pausar o jogo e acessar a funo de salvar; 'ESC' abandona a partida e volta ao menu.
+ *  - 'F3' mostra o painel de desempenho (tempo do quadro, chamadas de desenho e vrtices); 'F2' alterna o desenho em lote.
+ *  - 'F4' alterna o ritmo dos quadros: limitado, vsync ou livre (tambm na linha de comando: --limitado fps, --vsync, --livre [fps]).
+ *
+ *  - 'F5' salva na hora no slot rpido escolhido com '1' a '4', e 'F9' volta para ele (sem sair do jogo).
  *
  *  Notas:
- *  - O jogo fechar automaticamente aps salvar.
+ *  - Salvar no fecha o jogo. Os saves ficam na memria e so gravados no disco em segundo plano
+ *    (savegame.bin para o menu de pause, slot1.bin a slot4.bin para os saves rpidos).
  *  - O jogo avana por mltiplos nveis; complete todos os nveis para vencer.
+ *  - Mapas podem ter qualquer tamanho: um .txt que comea com a linha "#mapa <largura> <altura>"  jogado com
+ *    PACMAN_Final --mapa arquivo.txt (uma fase s). Mapas maiores que a janela rolam seguindo o Pac-Man.
+ *  - Com muitos monstros as buscas deles so divididas entre os ncleos (--threads n limita; o jogo  o mesmo com qualquer n).
+ *  - A simulao roda em uma thread prpria; a janela s desenha os retratos que ela publica e manda as teclas por uma fila.
+ *
+ *  Compilao:
+ *  - Jogo:     gcc PACMAN_Final.c -o PACMAN_Final -lraylib -lm -lpthread  (no Windows tambm -lopengl32 -lgdi32 -lwinmm)
+ *  - Headless: gcc -O2 -DPACMAN_HEADLESS PACMAN_Final.c -o pacman_headless -lm -lpthread
+ *    Roda s a simulao, sem janela e sem raylib, o mais rpido possvel (ver o main no final do arquivo).
+ *  - Mapas:    pacman_headless --compila-mapas
+ *    Compila mapa1.txt a mapa3.txt em mapas.pmc (paredes, posies iniciais e tabelas de rotas), que os jogos abrem com mmap.
+ *    Se mapas.pmc faltar ou for mais velho que os .txt, o prprio jogo compila de novo ao abrir.
+ *  - Labirintos: pacman_headless --gera-labirinto arquivo.txt largura altura [semente]  (mapa gerado de qualquer tamanho)
+ *                pacman_headless --labirinto largura altura [semente] [ticks] [modo_ia] (benchmark, ex.: 1000 1000 = 1 milho de clulas)
+ *                pacman_headless --escala-threads (as decises dos monstros divididas entre 1 a N threads)
+ *                pacman_headless --simulacao-thread arquivo.replay (o replay jogado pela thread da simulao, conferindo os retratos)
+ *  - Lotes:    gcc -O2 -DPACMAN_LOTE PACMAN_Final.c -o pacman_lote -lm -lpthread
+ *    Joga milhares de partidas com o bot usando todos os ncleos e mede a escala de 1 a N threads.
  *
  *  Autores:
  *  Nicolas R. Carvalho, Lucas F. Canto.
@@ -26,17 +49,35 @@
  **************************************************************************************************/
 
 #include <stdio.h>
+#ifdef PACMAN_LOTE
+#define PACMAN_HEADLESS //o executor de lotes e um modo headless
+#endif
+#ifndef PACMAN_HEADLESS
 #include <raylib.h>
+#include <rlgl.h>
+#endif
+#include <pthread.h> //threads da simulacao e da IA dos monstros, gravador dos slots de save e executor de lotes
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <stddef.h>
+#ifdef _WIN32
+#include <io.h> //_commit
+__declspec(dllimport) int __stdcall MoveFileExA(const char *existente, const char *novo, unsigned long flags); //de windows.h, que conflita com a raylib
+#else
+#include <unistd.h> //fsync e sysconf
+#include <sys/mman.h> //mmap dos mapas compilados
+#endif
+#include <sys/stat.h>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h> //kernels SSE2/AVX2 da BFS por bitboards
+#endif
 
 #define LAR_TELA 800
 #define ALT_TELA 640
-#define COLUNAS_MAPA 40
-#define LINHAS_MAPA 32
 #define TAM_PIXEL 20
-#define MAXIMO_MONSTROS 10 // Define numero maximo de monstros
 #define TEMPO_DIFICULDADE 225 //configura quanto tempo leva para a dificuldade mudar
 #define MAXSCORES 5 // Define o nmero mximo de scores que sero armazenados
 #define NUM_MAPAS 3 // Define numero maximo de mapas
@@ -56,23 +97,16 @@ typedef struct pos_pacman
     int x, y;
     int dx, dy;
     int x_inicial, y_inicial;
+    int x_anterior, y_anterior; //celula antes do ultimo passo (o desenho interpola entre ela e a atual)
 } POS_PACMAN;
 
-//Posicao/direcao dos monstros
-typedef struct pos_monstro
-{
-    int x, y;
-    int dx, dy;
-    int x_inicial, y_inicial;
-} POS_MONSTRO;
-
 //Vida e pontuacao do jogador
 typedef struct status_player
 {
     int vida;
     int pontuacao;
     int fase;
-    int pontuacao_alvo;
+    int pontuacao_alvo; //soma dos itens de todas as fases ja carregadas (so gravada no savegame; o fim de fase usa JOGO.num_coletaveis)
     int dificuldade;
 } STATUS_PLAYER;
 
@@ -81,150 +115,539 @@ typedef struct node
 {
     int x, y; //Cordenadas do n no mapa
     int g, h, f; // F = soma de G e H (F = G + H),   G  = Custo acumulado desde o ponto inicial at este n,    H  =  Heurstica (estimativa do custo restante at o objetivo).
-    struct node *parent; //Ponteiro que indica o n anterior do caminho ("Node pai"), que permitira reconstruir o caminho aps encontrar o objetivo.
+    int parent; //Indice (na arena) do n anterior do caminho ("Node pai"), que permitira reconstruir o caminho aps encontrar o objetivo. NODE_NULO = sem pai
+    int ordem; //Ordem de insercao na lista aberta, usada para desempatar nodes com o mesmo F
+    int indice_heap; //Posicao do node dentro do heap da lista aberta (necessario para o decrease-key)
 } Node;
 
+//Indice de parent que indica "sem node pai" (posicao inicial da busca)
+#define NODE_NULO -1
+
+//Lista aberta do A* organizada como heap binario (o node de menor F fica sempre na posicao 0)
+typedef struct heap_abertos
+{
+    Node **itens; //um lugar por celula do mapa
+    int tamanho;
+} HEAP_ABERTOS;
+
+//Arena de nodes do A*: um bloco com um node por celula do mapa, reaproveitado a cada busca.
+//Como cada celula gera no maximo um node por busca, a arena nunca enche, e "liberar" todos os nodes e so zerar o contador de usados.
+//Junto ficam a lista aberta e o node de cada celula: toda a memoria de trabalho de uma busca, uma por jogo. Os vetores ficam no
+//bloco de memoria do jogo (ver MEMORIA_JOGO), nunca na pilha, entao uma busca em um mapa de 1 milhao de celulas nao estoura a pilha.
+typedef struct arena_nodes
+{
+    Node *nodes; //um por celula
+    int usados; //quantos nodes da arena ja foram entregues na busca atual
+    int pico; //maior numero de nodes usados em uma unica busca
+    long total_alocados; //contador de nodes entregues desde o inicio do programa
+    long buscas; //quantas vezes a arena foi reiniciada (uma por busca)
+    int ultimo_custo; //tamanho do caminho encontrado na ultima busca (-1 = sem caminho)
+    HEAP_ABERTOS abertos; //Lista aberta (heap)
+    Node **node_da_celula; //Node que esta na lista aberta para cada celula (valido apenas se o bit de aberto estiver ligado)
+    unsigned int *bits_abertos, *bits_fechados; //um bit por celula (PALAVRAS_BITS palavras cada)
+} ARENA_NODES;
+
+//Mapa em bitboards: para cada tipo de celula uma mascara de bits por linha, com o bit x da linha y ligado quando a coluna x
+//tem aquele tipo. Cada linha ocupa "palavras" LINHA_BITS, e sempre sobra pelo menos uma coluna de folga no fim da linha
+//(palavras = largura / 64 + 1) que nunca e livre: assim a BFS por bits trata o mapa inteiro como uma unica fila de bits.
+//Nos mapas de ate 63 colunas e uma palavra por linha, e testar parede e um shift e um AND. Os vetores sao do bloco de memoria
+//do jogo (ou do mapa compilado); a matriz de char so existe nos arquivos .txt.
+typedef unsigned long long LINHA_BITS;
+typedef struct bitboards_mapa
+{
+    int largura, altura; //em celulas
+    int palavras; //LINHA_BITS por linha
+    LINHA_BITS *paredes; //'W' (altura * palavras)
+    LINHA_BITS *pontos; //'.'
+    LINHA_BITS *power; //'S'
+    LINHA_BITS *frutas; //'F'
+} BITBOARDS_MAPA;
+
+//Indice de uma celula do mapa em um vetor linear, e quantidade de celulas
+#define INDICE_CELULA(mapa, x, y) ((y) * (mapa)->largura + (x))
+#define CELULAS_MAPA(mapa) ((mapa)->largura * (mapa)->altura)
+//Quantidade de palavras de 32 bits necessarias para ter um bit por celula
+#define PALAVRAS_BITS(celulas) (((celulas) + 31) / 32)
+//Palavras de 64 bits de uma linha de bitboard com pelo menos uma coluna de folga
+#define PALAVRAS_LINHA(largura) ((largura) / 64 + 1)
+//Palavra e bit da coluna x em uma linha de um bitboard
+#define PALAVRA_COLUNA(x) ((x) >> 6)
+#define BIT_COLUNA(x) (1ULL << ((x) & 63))
+
+//Dimensoes dos mapas. Um mapa .txt pode comecar com a linha "#mapa <largura> <altura>"; sem ela vale o tamanho classico 40x32
+#define COLUNAS_MAPA_PADRAO 40
+#define LINHAS_MAPA_PADRAO 32
+#define MAXIMO_LADO_MAPA 8192
+#define MAXIMO_CELULAS_MAPA (16 * 1024 * 1024)
+#define MAXIMO_CELULAS_ROTAS 4096 //a tabela de rotas tem celulas^2/4 bytes: acima disso (64x64) ela nao e montada e os monstros usam o HPA*
+
+//Tabela de rotas pre-calculada: para cada par (origem, alvo) guarda em 2 bits qual das 4 direcoes e o proximo passo do menor caminho.
+//Como as paredes nao mudam durante uma fase, a tabela e montada uma vez pelo compilador de mapas, e mover um monstro vira uma consulta.
+//Os vetores ficam dentro do mapa compilado (no arquivo aberto com mmap); a struct so aponta para eles.
+typedef struct tabela_rotas
+{
+    unsigned char *direcoes; //4 entradas por byte, indexado por alvo*celulas+origem ((celulas^2 + 3) / 4 bytes)
+    unsigned short *componente; //regiao conexa de cada celula (0 = parede); origem e alvo em regioes diferentes nao tem caminho
+    int celulas, largura;
+    unsigned long long hash; //hash das paredes para as quais a tabela foi montada
+    int pronta;
+} TABELA_ROTAS;
+
+//Memoria de trabalho das BFS: a fila da BFS com fila e as frentes de onda da BFS por bits. Cada frente tem uma linha extra
+//zerada em cima e em baixo (e mais uma palavra em cada ponta), entao as linhas vizinhas sao lidas sem testes.
+typedef struct memoria_bfs
+{
+    int *fila; //uma posicao por celula
+    LINHA_BITS *frente, *proxima; //(altura + 2) * palavras + 2 cada
+    LINHA_BITS *visitados, *livres; //altura * palavras + 2 cada (mais uma palavra antes e depois da primeira/ultima linha)
+} MEMORIA_BFS;
+
+//Campo de fluxo: distancia de cada celula ate o Pac-Man, calculada com uma unica BFS por tick e compartilhada por todos os monstros,
+//que so precisam "descer" o campo. O custo da IA deixa de depender do numero de monstros.
+typedef struct campo_fluxo
+{
+    int *distancia; //passos ate o alvo (-1 = parede ou inalcancavel), uma por celula
+    MEMORIA_BFS bfs;
+    int alvo_x, alvo_y; //celula a partir da qual o campo foi calculado
+    int valido; //0 depois de trocar de mapa, forca um novo calculo
+    long calculos; //quantas BFS foram feitas
+    long reaproveitados; //quantas vezes o campo foi reutilizado porque o alvo nao se moveu
+} CAMPO_FLUXO;
+
+//Grafo abstrato do HPA* (A* hierarquico): o mapa e dividido em clusters de LADO_CLUSTER x LADO_CLUSTER celulas, e cada trecho livre da
+//borda entre dois clusters vizinhos vira uma ou duas entradas (um par de celulas, uma de cada lado). As celulas das entradas sao os nos
+//do grafo; as arestas ligam os nos de um mesmo cluster (custo = passos sem sair do cluster) e os nos vizinhos de clusters diferentes
+//(custo 1). O grafo e montado uma vez quando os mapas sao abertos (monta_grafo_hpa) e, como a tabela de rotas, e so para leitura e
+//compartilhado entre jogos. Uma busca percorre os nos em vez das celulas, e o caminho de verdade so e calculado dentro de um cluster.
+#define LADO_CLUSTER 16
+#define TRECHO_DUAS_ENTRADAS 6 //trechos de borda com pelo menos isso de celulas ganham uma entrada em cada ponta; os menores, uma no meio
+#define CLUSTER_DA_CELULA(grafo, x, y) ((y) / LADO_CLUSTER * (grafo)->clusters_x + (x) / LADO_CLUSTER)
+typedef struct grafo_hpa
+{
+    int largura, altura; //do mapa
+    int clusters_x, clusters_y;
+    int num_nos, num_arestas;
+    int *celula_no; //celula de cada no; os nos de um mesmo cluster sao consecutivos
+    int *inicio_nos_cluster; //nos do cluster c: de inicio_nos_cluster[c] ate inicio_nos_cluster[c + 1] - 1
+    int *inicio_arestas; //arestas do no n: de inicio_arestas[n] ate inicio_arestas[n + 1] - 1
+    int *destino_aresta, *custo_aresta;
+    void *bloco; //um malloc com todos os vetores
+    unsigned long long hash; //hash das paredes para as quais o grafo foi montado
+    int pronto;
+} GRAFO_HPA;
+
+//Caminho abstrato guardado de um monstro: os proximos nos ate o cluster do Pac-Man. Enquanto o Pac-Man continuar no corredor (os clusters
+//dos nos que faltam, ou o cluster onde ele estava quando o caminho foi calculado) o monstro so segue os nos, com buscas locais.
+#define MAXIMO_NOS_CAMINHO 64 //caminhos mais longos guardam so o comeco e sao calculados de novo quando ele acaba
+typedef struct caminho_hpa
+{
+    int celulas[MAXIMO_NOS_CAMINHO]; //celula de cada no, sem a origem e sem o alvo
+    int num, proximo; //nos guardados e o proximo a alcancar (num = 0: sem caminho)
+    int cluster_alvo;
+} CAMINHO_HPA;
+
+//Memoria de trabalho do HPA* de um jogo: as buscas locais so usam um ou dois clusters, entao os vetores tem tamanho fixo.
+//A busca abstrata usa a arena do A* (ver busca_abstrata).
+typedef struct memoria_hpa
+{
+    CAMINHO_HPA *caminhos; //um por monstro (no bloco dos monstros, ver prepara_monstros)
+    int distancia_origem[LADO_CLUSTER * LADO_CLUSTER], distancia_alvo[LADO_CLUSTER * LADO_CLUSTER];
+    int distancia_local[2 * LADO_CLUSTER * LADO_CLUSTER], fila[2 * LADO_CLUSTER * LADO_CLUSTER];
+    long buscas_locais; //passos resolvidos dentro do cluster do Pac-Man
+    long reaproveitados; //passos que seguiram o caminho guardado
+    long buscas_abstratas; //caminhos calculados de novo (o Pac-Man saiu do corredor, o caminho acabou ou o monstro saiu dele)
+    long nos_expandidos; //nos do grafo abstrato expandidos nessas buscas
+    long sem_caminho;
+} MEMORIA_HPA;
+
+//Estrategias de IA dos monstros (ver move_monstros)
+#define IA_A_ESTRELA 0 //uma busca A* por monstro a cada passo
+#define IA_TABELA_ROTAS 1 //consulta na tabela de rotas pre-calculada do mapa (sem tabela, o HPA*)
+#define IA_CAMPO_FLUXO 2 //uma BFS a partir do Pac-Man compartilhada por todos os monstros
+#define IA_HIERARQUICA 3 //HPA*: busca no grafo abstrato, com o caminho guardado por monstro
+#define IA_INCREMENTAL 4 //D* Lite: cada monstro conserta a propria busca quando o Pac-Man se move
+
+//Mapa compilado: tudo que o jogo precisa de um mapa .txt, ja extraido (ver compila_matriz). O registro de tamanho fixo e seguido
+//dos vetores do mapa: os 4 bitboards (4 * altura * palavras LINHA_BITS), as posicoes iniciais dos monstros (num_monstros x e depois
+//num_monstros y, ints) e, se tem_rotas, componente (celulas unsigned short) e direcoes da tabela de rotas. Cada vetor depois dos
+//bitboards e completado ate um multiplo de 8 bytes. O arquivo de mapas compilados e um CABECALHO_MAPAS seguido
+//dos registros, gravados como estao na memoria, e fica aberto com mmap durante o programa.
+//Mudou algum campo? Aumente VERSAO_MAPAS_COMPILADOS: o arquivo antigo e recusado e os mapas sao compilados de novo.
+#define ARQUIVO_MAPAS_COMPILADOS "mapas.pmc"
+#define VERSAO_MAPAS_COMPILADOS 4 //4: o .txt e conferido pelo hash do conteudo (hash_fonte), nao pela data
+typedef struct cabecalho_mapas
+{
+    char assinatura[4]; //"PMMC"
+    int versao;
+    int num_mapas;
+    int tamanho_registro; //sizeof(MAPA_COMPILADO) de quem gravou
+    unsigned long long deslocamento[NUM_MAPAS]; //posicao de cada registro no arquivo
+} CABECALHO_MAPAS;
+
+typedef struct mapa_compilado
+{
+    char nome[32]; //arquivo .txt de onde o mapa veio
+    long long tamanho_fonte; //tamanho do .txt quando foi compilado (se mudou nem precisa calcular o hash)
+    unsigned long long hash_fonte; //hash dos bytes do .txt quando foi compilado (ver hash_arquivo)
+    int largura, altura, palavras;
+    int pacman_x, pacman_y;
+    int num_monstros; //sem limite: as posicoes vem depois dos bitboards (ver posicoes_monstros_compiladas)
+    int pontos_fase; //soma dos itens do mapa (soma em pontuacao_alvo)
+    int tem_rotas; //a tabela de rotas so existe nos mapas de ate MAXIMO_CELULAS_ROTAS celulas
+    unsigned long long hash_paredes;
+    unsigned long long tamanho_total; //bytes do registro junto com os vetores que vem depois dele
+} MAPA_COMPILADO;
+
+//Frequencia e duracao fixa de um tick da simulacao (em segundos). Nao depende do FPS da janela: a thread da simulacao acumula o tempo
+//que passou e executa quantos ticks couberem (ver avanca_simulacao). Mudar a frequencia muda o jogo, entao invalida os replays gravados.
+#define TICKS_POR_SEGUNDO 60
+#define DT_SIMULACAO (1.0f / TICKS_POR_SEGUNDO)
+#define MAXIMO_TICKS_POR_QUADRO 8 //depois de uma travada longa o jogo desacelera em vez de tentar recuperar todo o atraso de uma vez
+#define VEL_MONSTROS_INICIAL 0.30f //VELOCIDADE INVERSAMENTE PROPORCIONAL (tempo entre passos dos monstros no inicio de cada fase)
+
+//Comando do jogador em um tick da simulacao (ENTRADA_X - 1 e o indice da direcao no vetor direcoes)
+#define ENTRADA_NENHUMA 0
+#define ENTRADA_DIREITA 1
+#define ENTRADA_ESQUERDA 2
+#define ENTRADA_BAIXO 3
+#define ENTRADA_CIMA 4
+
+//Situacao do jogo
+#define JOGO_EM_ANDAMENTO 0
+#define JOGO_PERDIDO 1
+#define JOGO_VENCIDO 2
+
+//Bloco de memoria de um jogo: todos os vetores que dependem do tamanho do mapa (bitboards, coletaveis, fila de celulas alteradas,
+//arena do A*, campo de fluxo) saem de um unico malloc, dividido por prepara_memoria_jogo (as buscas incrementais tem um bloco a parte,
+//ver MEMORIA_INCREMENTAL). O bloco so cresce, e e reaproveitado entre fases e entre jogos (inicia_jogo nao o libera); libera_jogo devolve tudo.
+typedef struct memoria_jogo
+{
+    void *bloco;
+    size_t tamanho;
+} MEMORIA_JOGO;
+
+//Busca incremental (D* Lite com alvo movel) de um monstro: em vez de jogar fora a busca depois de cada passo, o monstro guarda para cada
+//celula a distancia (g) e a estimativa feita a partir dos vizinhos (rhs) ate a raiz, a celula em que ele estava quando a busca comecou.
+//A raiz fica parada, entao as distancias ja calculadas continuam certas quando o Pac-Man anda: o Pac-Man faz o papel do "start" do D* Lite
+//(km corrige as chaves) e a busca so expande o que falta ate a nova celula dele. Enquanto o monstro estiver em um caminho minimo da raiz
+//ate o Pac-Man, o resto desse caminho e um caminho minimo dele; quando sai (o Pac-Man voltou para tras dele, por exemplo), a busca
+//recomeca com a raiz na celula do monstro. Sao 24 bytes por celula por monstro, entao so e montada ate MAXIMO_CELULAS_INCREMENTAL;
+//acima disso os monstros usam o HPA*.
+#define MAXIMO_CELULAS_INCREMENTAL (2 * 1024 * 1024) //celulas do mapa x monstros
+#define DISTANCIA_INFINITA 0x3FFFFFFF
+typedef struct item_incremental
+{
+    int k1, k2; //chave: [min(g, rhs) + h + km; min(g, rhs)]
+    int celula;
+} ITEM_INCREMENTAL;
+
+typedef struct busca_incremental
+{
+    int *g, *rhs; //uma por celula
+    int *posicao_fila; //posicao de cada celula no heap (-1 = fora da fila)
+    ITEM_INCREMENTAL *fila; //heap das celulas inconsistentes (g != rhs), menor chave no topo
+    int tamanho_fila;
+    int km; //soma das heuristicas entre as posicoes do Pac-Man desde o inicio da busca
+    int ultimo_x, ultimo_y; //posicao do Pac-Man no ultimo passo
+    int raiz; //celula do monstro quando a busca comecou (a unica com rhs = 0)
+    int iniciada; //0 = a proxima consulta comeca do zero
+} BUSCA_INCREMENTAL;
+
+//Buscas incrementais de todos os monstros de um jogo, em um bloco proprio que so e montado no modo IA_INCREMENTAL
+typedef struct memoria_incremental
+{
+    MEMORIA_JOGO memoria;
+    BUSCA_INCREMENTAL *buscas; //uma por monstro, no comeco do bloco
+    int largura, altura, monstros; //para que mapa o bloco foi repartido (0 = ainda nao foi)
+    long reaproveitadas; //passos que consertaram a busca anterior (acertos)
+    long reiniciadas; //passos que comecaram uma busca do zero (falhas: primeira busca, monstro fora do caminho, mapa novo ou jogo carregado)
+    long nos_expandidos; //total de celulas tiradas da fila
+    long passos; //passos dos monstros (todos os monstros andando uma vez)
+    int nos_ultimo_passo, pico_nos_passo; //celulas expandidas no ultimo passo dos monstros e o maior valor ja visto
+} MEMORIA_INCREMENTAL;
+
+//Monstros de um jogo em estrutura de vetores: um vetor por campo, com um valor por monstro, entao os lacos que passam por todos os
+//monstros (move_monstros, o desenho, o checksum) leem memoria continua e so os campos que usam. Nao ha limite de monstros: os vetores,
+//os elos da grade de ocupacao e os caminhos do HPA* saem de um bloco que so cresce (ver prepara_monstros), como o bloco do jogo.
+#define CAMPOS_MONSTRO 8 //vetores de posicao, na ordem de vetores_monstros
+typedef struct monstros
+{
+    int *x, *y;
+    int *dx, *dy;
+    int *x_inicial, *y_inicial;
+    int *x_anterior, *y_anterior; //celula antes do ultimo passo (o desenho interpola entre ela e a atual)
+    int capacidade; //monstros que cabem no bloco repartido
+    MEMORIA_JOGO memoria;
+} MONSTROS;
+
+//Estado completo de um jogo. Tudo que a simulacao muda fica aqui dentro (nada em variaveis globais ou static),
+//entao varios jogos podem existir ao mesmo tempo e a simulacao pode rodar sem janela.
+//Os campos de pacman ate rng sao o estado salvo: so valores, sem ponteiros, copiados com um unico memcpy nos slots de save (SLOT_SAVE);
+//os bitboards do mapa e os vetores dos monstros tambem sao salvos, copiados a parte. Campos novos que precisem ser salvos vao antes de mapa; de mapa em
+//diante fica o que aponta para o bloco de memoria ou pode ser remontado (prepara_jogo_carregado).
+typedef struct jogo
+{
+    POS_PACMAN pacman;
+    STATUS_PLAYER player;
+    int num_monstros;
+    float vel_monstros; //VELOCIDADE INVERSAMENTE PROPORCIONAL, diminui conforme a dificuldade aumenta
+    float timer_pacman; //tempo acumulado desde o ultimo passo do Pac-Man
+    float timer_monstros; //tempo acumulado desde o ultimo passo dos monstros
+    int dificuldade_contador; //passos dos monstros desde o ultimo aumento de dificuldade
+    int estado; //JOGO_EM_ANDAMENTO, JOGO_PERDIDO ou JOGO_VENCIDO
+    long ticks; //ticks de simulacao executados
+    int modo_ia; //estrategia usada pelos monstros para perseguir o Pac-Man (IA_*)
+    unsigned long long semente; //semente com que o jogo foi iniciado
+    unsigned long long rng; //estado do gerador de numeros aleatorios do jogo (ver sorteia)
+    //--- fim do estado salvo copiado com memcpy ---
+    BITBOARDS_MAPA mapa; //paredes e itens da fase atual
+    MEMORIA_JOGO memoria;
+    MONSTROS monstros; //posicao de cada monstro
+    ARENA_NODES arena; //arena de nodes usada pelas buscas A* dos monstros
+    CAMPO_FLUXO campo_fluxo; //distancias ate o Pac-Man usadas no modo IA_CAMPO_FLUXO
+    const TABELA_ROTAS *tabela_rotas; //tabela de rotas do mapa atual (dentro do arquivo de mapas compilados, compartilhada entre jogos)
+    const GRAFO_HPA *grafo_hpa; //grafo abstrato do mapa atual (tambem compartilhado), NULL = os monstros usam o A*
+    MEMORIA_HPA hpa; //caminhos guardados e memoria de trabalho do HPA*
+    MEMORIA_INCREMENTAL incremental; //busca D* Lite de cada monstro (monstro i: incremental.buscas[i])
+    struct equipe_ia *equipe; //threads que dividem as decisoes dos monstros com a do jogo (NULL = so a do jogo, ver define_threads_ia)
+    int *ocupante; //grade de ocupacao: primeiro monstro de cada celula (-1 = nenhum), mantida a cada passo (ver ocupa_celula)
+    int *proximo_ocupante; //monstro seguinte na mesma celula (-1 = fim da lista), no bloco dos monstros
+    int *decisao_dx, *decisao_dy; //passo escolhido por cada monstro antes de qualquer um andar (ver decide_monstros), no bloco dos monstros
+    long passos_monstros; //vezes que os monstros andaram desde inicia_jogo (para os benchmarks)
+    int *coletaveis; //celulas que ainda tem '.', 'S' ou 'F' (em qualquer ordem)
+    int *posicao_coletavel; //posicao de cada celula em coletaveis (-1 = sem coletavel), para remover em O(1)
+    int num_coletaveis; //itens que faltam coletar na fase: quando chega a zero a fase acabou
+    int *celulas_alteradas; //fila das celulas mudadas por altera_celula desde o ultimo retrato (ver tira_retrato)
+    unsigned int *celula_na_fila; //bit ligado = a celula ja esta na fila (cada celula entra uma vez so)
+    int num_celulas_alteradas;
+    int mapa_alterado; //um mapa foi carregado: o proximo retrato copia o mapa inteiro e o desenho refaz a camada de paredes
+    long paredes_alteradas; //paredes mudadas por altera_celula (o desenho confere a camada de paredes quando o numero muda)
+} JOGO;
+
+//Replay: semente, mapa inicial e as entradas de cada tick, o suficiente para reproduzir um jogo exatamente.
+//As entradas sao gravadas em trechos (run-length): cada unsigned short guarda a entrada nos 3 bits de baixo e
+//(repeticoes - 1) nos outros 13 bits, entao longos periodos sem apertar nada ocupam 2 bytes.
+#define VERSAO_REPLAY 2 //2: monstros nao entram em celula ocupada por outro monstro (ver desvia_monstro)
+#define MAXIMO_REPETICOES_TRECHO 8192
+typedef struct cabecalho_replay
+{
+    char assinatura[4]; //"PMRP"
+    int versao;
+    unsigned long long semente;
+    int fase_inicial; //mapa em que o jogo comecou
+    int modo_ia;
+    int num_ticks;
+    int num_trechos;
+    int pontuacao_final, vida_final, fase_final;
+    unsigned int checksum; //checksum_jogo() do estado no fim da gravacao
+} CABECALHO_REPLAY;
+
+//Savegame binario ("savegame.bin"): cabecalho de TAMANHO_CABECALHO_SAVE bytes (assinatura "PMSV", versao, largura, altura,
+//numero de monstros, tamanho dos dados e CRC32 dos dados, cada um em 4 bytes little-endian) seguido dos dados de serializa_jogo.
+//Mudou algum campo dos dados? Aumente VERSAO_SAVE: savegames de outra versao sao recusados em vez de lidos errado.
+#define ARQUIVO_SAVE "savegame.bin"
+#define VERSAO_SAVE 3
+#define TAMANHO_CABECALHO_SAVE (4 + 6 * 4)
+#define TAMANHO_DADOS_SAVE(altura, palavras, monstros) (5 * 4                                           /* player */                         \
+                                                        + 8 * 4                                         /* pacman */                         \
+                                                        + 4 + (size_t)(monstros) * CAMPOS_MONSTRO * 4   /* monstros */                       \
+                                                        + 3 * 4 + 3 * 4                                 /* velocidade, timers, contadores */ \
+                                                        + 3 * 8                                         /* ticks, semente, rng */            \
+                                                        + 4 * (size_t)(altura) * (palavras) * 8) /* bitboards do mapa */
+
+//Slot de save: o estado salvo do jogo (o comeco da struct JOGO, ate antes de mapa), copiado com um memcpy, e os bitboards do mapa
+//e os vetores dos monstros copiados com outros. Salvar ou carregar um slot nao abre nenhum arquivo; gravar o slot no disco fica para o gravador em segundo plano.
+#define TAMANHO_ESTADO_JOGO offsetof(JOGO, mapa)
+#define NUM_SLOTS 5 //slot 0: savegame do menu de pause (ARQUIVO_SAVE); 1 a 4: saves rapidos (F5 salva, F9 carrega, 1-4 escolhe)
+typedef struct slot_save
+{
+    unsigned char estado[TAMANHO_ESTADO_JOGO];
+    int largura, altura;
+    LINHA_BITS *bitboards; //4 * altura * palavras, na ordem paredes, pontos, power, frutas
+    size_t capacidade; //LINHA_BITS alocados em bitboards
+    int *monstros; //CAMPOS_MONSTRO vetores de num_monstros ints, um depois do outro (ver vetores_monstros)
+    int num_monstros;
+    size_t capacidade_monstros; //ints alocados em monstros
+    int ocupado;
+} SLOT_SAVE;
+
+typedef struct replay
+{
+    CABECALHO_REPLAY cabecalho;
+    unsigned short *trechos;
+    int capacidade;
+    int incompleto; //faltou memoria para uma entrada: o replay nao reproduz mais o jogo e nao e gravado
+} REPLAY;
+
+//Fila de comandos entre duas threads, com um so produtor e um so consumidor e sem trava: a tela do jogo poe as teclas e a thread da
+//simulacao tira. Cada lado so escreve o proprio indice e le o do outro com acquire, entao quando o consumidor ve o fim novo o comando
+//ja esta no vetor. Os indices so crescem (o lugar de um comando e o indice % TAMANHO_FILA_COMANDOS).
+#define TAMANHO_FILA_COMANDOS 64 //potencia de 2
+typedef struct fila_comandos
+{
+    unsigned char comandos[TAMANHO_FILA_COMANDOS];
+    atomic_uint inicio; //proximo comando a tirar (so o consumidor escreve)
+    atomic_uint fim; //proximo lugar livre (so o produtor escreve)
+} FILA_COMANDOS;
+
+//Retrato de um jogo: o que o desenho precisa (mapa, Pac-Man, monstros, placar e timers da interpolacao), copiado do jogo pela thread da
+//simulacao depois de cada leva de ticks. Um retrato publicado nao muda ate o desenho devolver ele (ver SIMULACAO), entao o desenho le sem
+//trava. Os bitboards e os vetores dos monstros ficam em um bloco do retrato que so cresce.
+typedef struct retrato_jogo
+{
+    POS_PACMAN pacman;
+    STATUS_PLAYER player;
+    int estado;
+    long ticks;
+    float vel_monstros, timer_pacman, timer_monstros;
+    float tempo_pendente; //tempo que ja tinha passado e ainda nao era um tick quando o retrato foi tirado
+    double instante; //agora_segundos() em que o retrato foi tirado
+    float ms_simulacao; //tempo gasto nos ticks que levaram a este retrato
+    long buscas_a_estrela, nodes_a_estrela, bfs_fluxo, buscas_hpa, buscas_consertadas, buscas_do_zero; //buscas dos monstros no jogo (painel F3)
+    BITBOARDS_MAPA mapa;
+    int num_coletaveis;
+    unsigned int versao_mapa; //muda a cada mapa carregado (o desenho refaz a camada de paredes)
+    unsigned int versao_linhas; //linhas do mapa mudadas depois desta versao ainda nao foram copiadas para este retrato
+    long paredes_alteradas;
+    int num_monstros;
+    int *x, *y, *x_anterior, *y_anterior; //so os vetores que o desenho usa
+    int capacidade_monstros;
+    unsigned int checksum; //checksum_retrato, so com SIMULACAO.conferir (teste headless)
+    MEMORIA_JOGO memoria;
+} RETRATO_JOGO;
+
+//Simulacao em uma thread propria (ver executa_simulacao): a thread e dona do jogo enquanto roda, e a tela do jogo so conversa com ela pela
+//fila de entradas e pelos retratos. Sao tres retratos: o que a simulacao esta escrevendo, o que o desenho esta lendo e o ultimo completo,
+//trocados com atomic_exchange. Para cada thread e um double buffer comum, mas nenhuma espera a outra: a simulacao nunca escreve no retrato
+//que o desenho esta lendo, e o desenho sempre pega o retrato completo mais novo.
+#define RETRATO_NOVO 4 //bit de "pronto": o desenho ainda nao pegou o retrato
+typedef struct simulacao
+{
+    JOGO *jogo;
+    FILA_COMANDOS entradas; //ENTRADA_* apertadas na janela
+    RETRATO_JOGO retratos[3];
+    int escrita; //retrato da simulacao
+    int leitura; //retrato do desenho
+    atomic_int pronto; //ultimo retrato completo (mais RETRATO_NOVO se o desenho ainda nao pegou)
+    unsigned int versao_mapa, versao_linhas;
+    unsigned int *versao_linha; //versao_linhas de quando cada linha do mapa mudou pela ultima vez
+    int linhas; //lugares em versao_linha
+    float acumulador; //tempo real ainda nao simulado
+    double ultimo_instante;
+    int entrada_pendente; //tecla que chegou e ainda nao teve tick
+    REPLAY *replay; //grava a entrada de cada tick (NULL = sem replay)
+    int sem_relogio; //teste headless: cada comando da fila e a entrada de um tick, sem esperar o relogio
+    int conferir; //teste headless: cada retrato guarda o proprio checksum
+    atomic_int rodando;
+    int ativa; //iniciada e ainda nao parada (so quem iniciou usa)
+    int thread_ativa; //sem thread quem iniciou chama avanca_simulacao
+    pthread_t thread;
+} SIMULACAO;
+
 //DEFINDO VARIAVEIS GLOBAIS
-POS_MONSTRO monstros[MAXIMO_MONSTROS]; //definindo vetor que guardara a posicao de cada monstro
-int num_monstros = 0; //setando numero de monstros iniciais como 0
 float VEL_PACMAN = 0.15; //VEL INVERSAMENTE PROPORCIONAL
-float VEL_MONSTROS = 0.30; //VELOCIDADE INVERSAMENTE PROPORCIONAL
 const char *mapas[NUM_MAPAS] = {"mapa1.txt","mapa2.txt","mapa3.txt"};
+//                             dir      esq     baixo    cima
+const int direcoes[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}; //vetor das configuracoes de direcoes (direita, esquerda, baixo, cima)
 
 // Declarao das funes antes de serem usadas
-void exibe_highscores(TIPO_SCORE* scores);
-void insere_highscore_grafico(TIPO_SCORE* scores, int pontuacao);
 void game_over(STATUS_PLAYER *jogador);
 int le_arquivo(TIPO_SCORE* scores, char* nome_arq);
 void escreve_arquivo(TIPO_SCORE* scores, char* nome_arq);
 void atualiza_highscores(TIPO_SCORE scores[], int nelem, TIPO_SCORE novo_score);
+void inicia_jogo(JOGO *jogo);
+const MAPA_COMPILADO *mapa_compilado(int fase);
+const TABELA_ROTAS *rotas_do_mapa(int fase);
+const GRAFO_HPA *grafo_do_mapa(int fase);
+int num_fases(void);
+int define_threads_ia(JOGO *jogo, int threads);
 
-//FUNCAO que ira exibir o menu principal do jogo
-int chama_menu()
-{
-    // posicao do marcador
-    int posMarcador = 0;
-
-    //iniciando tela
-    InitWindow(LAR_TELA, ALT_TELA, "MENU");
-    SetTargetFPS(60);
-
-    //looping da tela
-    while (!WindowShouldClose())
-    {
-        //Interface grafica
-        BeginDrawing();
-        ClearBackground(BLACK);
-        DrawText("PAC-MAN", 30, 20, 130, YELLOW);
-        DrawText("NOVO-JOGO", 30, 160, 80, YELLOW);
-        DrawText("CARREGAR-JOGO", 30, 260, 80, YELLOW);
-        DrawText("HIGHSCORES", 30, 360, 80, YELLOW);
-        DrawText("SAIR", 30, 460, 80, YELLOW);
-        DrawText("|W| |S| |ENTER|", 580, 600, 30, GRAY);
-
-        //Interacoes com o menu
-        if (IsKeyPressed(KEY_W)) posMarcador--;
-        if (IsKeyPressed(KEY_S)) posMarcador++;
-        if (posMarcador == 0) DrawCircle(550, 195, 25, YELLOW);
-        if (posMarcador == 1) DrawCircle(765, 295, 25, YELLOW);
-        if (posMarcador == 2) DrawCircle(600, 398, 25, YELLOW);
-        if (posMarcador == 3) DrawCircle(262, 498, 25, YELLOW);
-        //"Vai e vem" do menu
-        if (posMarcador == 4) posMarcador = 0;
-        if (posMarcador == -1) posMarcador = 3;
-
-        //Se pressionar enter retorna valor selecionado para funcao main
-        if (IsKeyPressed(KEY_ENTER))
-        {
-            CloseWindow();
-            return posMarcador;
-        }
-        EndDrawing();
-    }
-    return -1;
-}
+#ifndef PACMAN_HEADLESS
+//Ritmo dos quadros, usado por todas as telas. F4 alterna durante o jogo, e tambem pode ser escolhido na linha de comando
+#define RITMO_LIMITADO 0 //SetTargetFPS(fps_alvo): a raylib espera no fim de cada quadro
+#define RITMO_VSYNC 1 //espera o retraco vertical do monitor, sem limite proprio
+#define RITMO_LIVRE 2 //sem vsync e sem limite da raylib; com fps_alvo > 0 o proprio jogo espera (ver espera_fim_do_quadro)
+#define NUM_RITMOS 3
+#define MARGEM_ESPERA 0.002 //no modo livre, quanto antes do prazo o jogo para de dormir e passa a girar (s)
+#define AMOSTRAS_QUADROS 240 //quadros usados nos percentis do painel (4 s a 60 FPS)
 
-// Funo para exibir os highscores
-void exibe_highscores(TIPO_SCORE* scores)
+typedef struct ritmo_quadros
 {
-    // Inicia a janela Raylib para a exibio dos highscores
-    InitWindow(LAR_TELA, ALT_TELA, "HIGHSCORES");
-    SetTargetFPS(60);
-
-    while (!WindowShouldClose())
-    {
-        BeginDrawing();
-        ClearBackground(BLACK);
+    int modo; //RITMO_*
+    int fps_alvo; //0 = sem limite no modo livre
+} RITMO_QUADROS;
 
-        DrawText("HIGHSCORES", LAR_TELA/2 - MeasureText("HIGHSCORES", 40)/2, ALT_TELA/8, 40, YELLOW);
-        for (int i = 0; i < MAXSCORES; i++)
-        {
-            char buffer[64];
-            sprintf(buffer, "%d. %s - %d", i + 1, scores[i].nome, scores[i].score);
-            DrawText(buffer, LAR_TELA/4, ALT_TELA/4 + 40*i, 30, WHITE);
-        }
+//Medidas dos ultimos quadros para o painel de desempenho (F3)
+typedef struct estatisticas_quadros
+{
+    float duracao[AMOSTRAS_QUADROS]; //ms de cada quadro, em anel
+    int proxima; //posicao do anel onde entra o proximo quadro
+    int preenchidas;
+    float ms_simulacao; //ticks do ultimo retrato desenhado (na thread da simulacao, fora do quadro)
+    float ms_desenho, ms_espera; //divisao do ultimo quadro: desenho, EndDrawing + espera
+    int ticks_no_segundo; //ticks simulados desde inicio_segundo
+    int ticks_por_segundo; //ticks simulados no ultimo segundo completo
+    double inicio_segundo;
+    double prazo; //fim do quadro atual no modo livre
+} ESTATISTICAS_QUADROS;
 
-        DrawText("Pressione TAB para voltar", LAR_TELA/2 - MeasureText("Pressione TAB para voltar", 20)/2, ALT_TELA - 60, 20, GRAY);
+const char *nomes_ritmos[NUM_RITMOS] = {"limitado", "vsync", "livre"};
+RITMO_QUADROS ritmo = {RITMO_LIMITADO, 60};
+ESTATISTICAS_QUADROS quadros;
 
-        EndDrawing();
+//Aplica o modo de ritmo na janela atual (chamada ao abrir uma janela e ao trocar de modo)
+void aplica_ritmo_quadros(void)
+{
+    if (ritmo.modo == RITMO_VSYNC)
+        SetWindowState(FLAG_VSYNC_HINT);
+    else
+        ClearWindowState(FLAG_VSYNC_HINT);
+    SetTargetFPS(ritmo.modo == RITMO_LIMITADO ? ritmo.fps_alvo : 0);
+    quadros.prazo = 0;
+}
 
-        if (IsKeyPressed(KEY_TAB))    // Verifica se o TAB foi pressionado para voltar ao menu
-        {
-            break;
-        }
-        if (IsKeyPressed(KEY_ESCAPE))    // Verifica se o ESC foi pressionado para fechar o jogo
-        {
-            CloseWindow();  // Fecha a janela
-            exit(0);  // Encerra o programa
-        }
+//Chamada logo depois de EndDrawing. No modo livre com fps_alvo espera o fim do quadro: dorme quase todo o tempo que falta
+//(o sono do sistema tem ~1 ms de precisao) e gira os ultimos MARGEM_ESPERA segundos para acertar o prazo.
+void espera_fim_do_quadro(void)
+{
+    if (ritmo.modo != RITMO_LIVRE || ritmo.fps_alvo <= 0) return;
+    double periodo = 1.0 / ritmo.fps_alvo;
+    double agora = GetTime();
+    if (quadros.prazo < agora - periodo) quadros.prazo = agora; //atrasou mais de um quadro: recomeca em vez de correr atras
+    quadros.prazo += periodo;
+    if (quadros.prazo - agora > MARGEM_ESPERA)
+        WaitTime(quadros.prazo - agora - MARGEM_ESPERA);
+    while (GetTime() < quadros.prazo)
+    {
+        //espera ativa
     }
-
-    CloseWindow();
 }
 
-// Funo para verificar se o jogador entra no ranking e inserir a pontuao
-void insere_highscore_grafico(TIPO_SCORE* scores, int pontuacao)
+//Guarda as medidas de um quadro do jogo (tempos em segundos, de GetTime). ticks sao os que a simulacao rodou desde o retrato anterior.
+void registra_quadro(double inicio, double fim_desenho, double fim, int ticks, float ms_simulacao)
 {
-    char nome[30] = "\0";
-    int letra_atual = 0;
+    quadros.duracao[quadros.proxima] = (float)((fim - inicio) * 1000.0);
+    quadros.proxima = (quadros.proxima + 1) % AMOSTRAS_QUADROS;
+    if (quadros.preenchidas < AMOSTRAS_QUADROS) quadros.preenchidas++;
+    quadros.ms_simulacao = ms_simulacao;
+    quadros.ms_desenho = (float)((fim_desenho - inicio) * 1000.0);
+    quadros.ms_espera = (float)((fim - fim_desenho) * 1000.0);
 
-    while (!WindowShouldClose())
+    quadros.ticks_no_segundo += ticks;
+    if (fim - quadros.inicio_segundo >= 1.0)
     {
-        BeginDrawing();
-        ClearBackground(BLACK);
-        DrawText("Novo Highscore!", LAR_TELA / 2 - MeasureText("Novo Highscore!", 40) / 2, ALT_TELA / 4, 40, YELLOW);
-        DrawText("Digite seu nome:", LAR_TELA / 2 - MeasureText("Digite seu nome:", 30) / 2, ALT_TELA / 2 - 50, 30, WHITE);
-        DrawText(nome, LAR_TELA / 2 - MeasureText(nome, 30) / 2, ALT_TELA / 2, 30, WHITE);
-
-        EndDrawing();
-
-        int key = GetCharPressed();
-
-        if ((key >= 32) && (key <= 125) && (letra_atual < 29))  // Verifica se  uma letra vlida e se h espao no buffer
-        {
-            nome[letra_atual] = (char)key;
-            letra_atual++;
-            nome[letra_atual] = '\0';  // Atualiza a string com o novo caractere
-        }
-
-        if (IsKeyPressed(KEY_BACKSPACE) && letra_atual > 0)  // Verifica se o backspace foi pressionado
-        {
-            letra_atual--;
-            nome[letra_atual] = '\0';
-        }
-
-        if (IsKeyPressed(KEY_ENTER) && letra_atual > 0)  // Se o jogador pressionar ENTER e tiver digitado um nome
-        {
-            TIPO_SCORE novo_score;
-            novo_score.score = pontuacao;
-            strcpy(novo_score.nome, nome);
-            atualiza_highscores(scores, MAXSCORES, novo_score);
-            escreve_arquivo(scores, "highscores.bin");
-            break;
-        }
+        quadros.ticks_por_segundo = (int)(quadros.ticks_no_segundo / (fim - quadros.inicio_segundo) + 0.5);
+        quadros.ticks_no_segundo = 0;
+        quadros.inicio_segundo = fim;
     }
 }
 
+int compara_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+#endif
 
 // Funo para ler o arquivo de highscores
 int le_arquivo(TIPO_SCORE* scores, char* nome_arq)
@@ -266,691 +689,5194 @@ void atualiza_highscores(TIPO_SCORE scores[], int nelem, TIPO_SCORE novo_score)
     }
 }
 
-//FUNCAO que ira exibir o menu de pause do jogo
-int chama_menu_pause()
+//Testa se a celula (x, y) e parede. Fora do mapa tudo e parede, entao quem anda pelo mapa nao precisa testar as bordas
+int eh_parede(const BITBOARDS_MAPA *mapa, int x, int y)
 {
-    int posMarcador = 0; // posicao do marcador
-    while (!WindowShouldClose()) //loping do pause
-    {
-        BeginDrawing();
-        ClearBackground(BLACK);
-        DrawText("PAUSE", 170, 20, 140, YELLOW);
-        DrawText("CONTINUAR", 30, 160, 80, YELLOW);
-        DrawText("SALVAR JOGO", 30, 260, 80, YELLOW);
-        DrawText("SAIR", 30, 360, 80, YELLOW);
-        DrawText("|W| |S| |ENTER|", 580, 600, 30, GRAY);
+    if ((unsigned)x >= (unsigned)mapa->largura || (unsigned)y >= (unsigned)mapa->altura) return 1;
+    return (int)((mapa->paredes[y * mapa->palavras + PALAVRA_COLUNA(x)] >> (x & 63)) & 1u);
+}
 
-        //Interacoes com o menu
-        if (IsKeyPressed(KEY_W)) posMarcador--;
-        if (IsKeyPressed(KEY_S)) posMarcador++;
-        if (posMarcador == 0) DrawCircle(550, 195, 25, YELLOW);
-        if (posMarcador == 1) DrawCircle(640, 295, 25, YELLOW);
-        if (posMarcador == 2) DrawCircle(255, 398, 25, YELLOW);
-        if (posMarcador == 3) posMarcador = 0;
-        if (posMarcador == -1) posMarcador = 2;
-        //Se apertar enter a funcao retorna o valor da opcao selecionada
-        if (IsKeyPressed(KEY_ENTER))
-        {
-            return posMarcador;
-        }
-        EndDrawing();
-    }
-    return -1;
+//Testa o bit da celula (x, y), que tem que estar dentro do mapa, em um dos bitboards do mapa
+int testa_celula(const BITBOARDS_MAPA *mapa, const LINHA_BITS *bitboard, int x, int y)
+{
+    return (int)((bitboard[y * mapa->palavras + PALAVRA_COLUNA(x)] >> (x & 63)) & 1u);
+}
+
+//Quantidade de bits ligados em uma linha
+int conta_bits(LINHA_BITS linha)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(linha);
+#else
+    int total = 0;
+    for (; linha; linha &= linha - 1) total++;
+    return total;
+#endif
 }
-void salvar_jogo(char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], STATUS_PLAYER *status_player, POS_PACMAN *pos_player, POS_MONSTRO *monstros)
+
+//Coluna do bit ligado mais baixo de uma linha (a linha nao pode ser zero)
+int menor_bit(LINHA_BITS linha)
 {
-    FILE *file = fopen("savegame.txt", "w");
-    if (file == NULL)
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(linha);
+#else
+    int coluna = 0;
+    while (!(linha & 1u))
     {
-        printf("Erro ao salvar jogo\n");
-        return;
+        linha >>= 1;
+        coluna++;
     }
+    return coluna;
+#endif
+}
 
-    // Salva as informaes do player
-    fprintf(file, "%d %d %d %d %d\n", status_player->vida, status_player->pontuacao, status_player->fase, status_player->dificuldade, status_player->pontuacao_alvo);
+//Quantidade de bits ligados em um bitboard inteiro
+int conta_bitboard(const BITBOARDS_MAPA *mapa, const LINHA_BITS *bitboard)
+{
+    int total = 0;
+    for (int i = 0; i < mapa->altura * mapa->palavras; i++)
+        total += conta_bits(bitboard[i]);
+    return total;
+}
 
-    // Salva a posio inicial e atual do Pac-Man
-    fprintf(file, "%d %d %d %d\n", pos_player->x_inicial, pos_player->y_inicial, pos_player->x, pos_player->y);
+//Aponta os 4 bitboards do mapa para um vetor de 4 * altura * palavras LINHA_BITS, um bitboard depois do outro
+//(paredes, pontos, power, frutas). Estar em sequencia deixa copiar o mapa inteiro com um memcpy.
+void aponta_bitboards(BITBOARDS_MAPA *mapa, LINHA_BITS *bitboards, int largura, int altura)
+{
+    size_t tamanho;
+    mapa->largura = largura;
+    mapa->altura = altura;
+    mapa->palavras = PALAVRAS_LINHA(largura);
+    tamanho = (size_t)altura * mapa->palavras;
+    mapa->paredes = bitboards;
+    mapa->pontos = bitboards + tamanho;
+    mapa->power = bitboards + 2 * tamanho;
+    mapa->frutas = bitboards + 3 * tamanho;
+}
 
-    // Salva a velocidade dos monstros
-    fprintf(file, "%f\n", VEL_MONSTROS);
+//LINHA_BITS dos 4 bitboards de um mapa
+size_t tamanho_bitboards(int largura, int altura)
+{
+    return 4 * (size_t)altura * PALAVRAS_LINHA(largura);
+}
 
-    // Salva o nmero de monstros e suas posies iniciais e atuais
-    fprintf(file, "%d\n", num_monstros);
-    for (int i = 0; i < num_monstros; i++)
-    {
-        fprintf(file, "%d %d %d %d ", monstros[i].x_inicial, monstros[i].y_inicial, monstros[i].x, monstros[i].y);
-    }
-    // Salva o estado do mapa
-    for (int i = 0; i < LINHAS_MAPA; i++)
+//Converte a matriz de char lida de um arquivo (altura linhas de largura caracteres) para bitboards; qualquer outro caractere vira celula vazia.
+//Os bitboards ja devem estar apontados (aponta_bitboards) para um vetor do tamanho do mapa.
+void monta_bitboards(BITBOARDS_MAPA *mapa, const char *matriz_mapa)
+{
+    memset(mapa->paredes, 0, tamanho_bitboards(mapa->largura, mapa->altura) * sizeof(LINHA_BITS));
+    for (int i = 0; i < mapa->altura; i++)
     {
-        for (int j = 0; j < COLUNAS_MAPA; j++)
+        for (int j = 0; j < mapa->largura; j++)
         {
-            fputc(matriz_mapa[i][j], file);
+            size_t palavra = (size_t)i * mapa->palavras + PALAVRA_COLUNA(j);
+            switch (matriz_mapa[(size_t)i * mapa->largura + j])
+            {
+            case 'W': mapa->paredes[palavra] |= BIT_COLUNA(j); break;
+            case '.': mapa->pontos[palavra] |= BIT_COLUNA(j); break;
+            case 'S': mapa->power[palavra] |= BIT_COLUNA(j); break;
+            case 'F': mapa->frutas[palavra] |= BIT_COLUNA(j); break;
+            default: break;
+            }
         }
-        fputc('\n', file);
     }
-
-    fclose(file);
-    CloseWindow();
-    exit(0);
 }
 
+//Caractere da celula (x, y) como ele aparece nos arquivos de mapa
+char celula_do_mapa(const BITBOARDS_MAPA *mapa, int x, int y)
+{
+    size_t palavra = (size_t)y * mapa->palavras + PALAVRA_COLUNA(x);
+    LINHA_BITS bit = BIT_COLUNA(x);
+    if (mapa->paredes[palavra] & bit) return 'W';
+    if (mapa->pontos[palavra] & bit) return '.';
+    if (mapa->power[palavra] & bit) return 'S';
+    if (mapa->frutas[palavra] & bit) return 'F';
+    return ' ';
+}
 
-void carregar_jogo(char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], STATUS_PLAYER *player, POS_PACMAN *pacman)
+//Calcula um hash (FNV-1a de 64 bits) do layout das paredes do mapa. Identifica para quais paredes uma tabela de rotas foi montada:
+//um jogo carregado so usa a tabela do mapa compilado se as paredes forem as mesmas.
+unsigned long long hash_paredes(const BITBOARDS_MAPA *mapa)
 {
-    FILE *file = fopen("savegame.txt", "r");
-    if (file == NULL)
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < mapa->altura; i++)
     {
-        printf("Erro ao carregar jogo\n");
-        return;
+        for (int j = 0; j < mapa->largura; j++)
+        {
+            hash ^= (unsigned char)testa_celula(mapa, mapa->paredes, j, i);
+            hash *= 1099511628211ULL;
+        }
     }
+    return hash;
+}
 
-    // Carrega as informaes do player
-    fscanf(file, "%d %d %d %d %d\n", &player->vida, &player->pontuacao, &player->fase, &player->dificuldade, &player->pontuacao_alvo);
+//Separa pedacos de um bloco de memoria, cada um alinhado em 32 bytes (o bastante para os kernels AVX2).
+//Com base NULL so mede: o mesmo codigo que reparte o bloco calcula o tamanho que ele precisa ter.
+typedef struct divisor_bloco
+{
+    unsigned char *base;
+    size_t usado;
+} DIVISOR_BLOCO;
 
-    // Carrega a posio atual do Pac-Man
-    fscanf(file, "%d %d %d %d\n", &pacman->x_inicial, &pacman->y_inicial, &pacman->x, &pacman->y);
-    pacman->dx = 0;
-    pacman->dy = 0;
-    // Carrega a velocidade dos monstros
-    fscanf(file, "%f\n", &VEL_MONSTROS);
+void *reserva_bloco(DIVISOR_BLOCO *divisor, size_t tamanho)
+{
+    size_t inicio = (divisor->usado + 31) & ~(size_t)31;
+    divisor->usado = inicio + tamanho;
+    return divisor->base ? divisor->base + inicio : NULL;
+}
 
-    // Carrega o nmero de monstros e suas posies atuais
-    fscanf(file, "%d\n", &num_monstros);
-    for (int i = 0; i < num_monstros; i++)
+//Garante que o bloco tenha pelo menos "usado" bytes. Quem reparte um bloco passa duas vezes pelos reserva_bloco: a primeira so mede
+//(base NULL), depois chama esta funcao, e a segunda reparte o bloco. O bloco so cresce; sem memoria o bloco antigo fica como estava,
+//e o aviso diz para que era ("o_que") antes de retornar 0.
+int cresce_memoria(MEMORIA_JOGO *memoria, size_t usado, const char *o_que)
+{
+    if (usado <= memoria->tamanho) return 1;
+    void *bloco = malloc(usado);
+    if (bloco == NULL)
     {
-        fscanf(file, "%d %d %d %d", &monstros[i].x_inicial, &monstros[i].y_inicial, &monstros[i].x, &monstros[i].y);
-        monstros[i].dx = 1;
-        monstros[i].dy = 0;
+        printf("Erro: sem memoria para %s (%zu bytes)\n", o_que, usado);
+        return 0;
     }
+    free(memoria->bloco);
+    memoria->bloco = bloco;
+    memoria->tamanho = usado;
+    return 1;
+}
 
+//Reparte a memoria de trabalho das BFS de um mapa
+void divide_memoria_bfs(MEMORIA_BFS *memoria, DIVISOR_BLOCO *divisor, int largura, int altura)
+{
+    size_t palavras = (size_t)altura * PALAVRAS_LINHA(largura);
+    size_t palavras_frente = (size_t)(altura + 2) * PALAVRAS_LINHA(largura) + 2;
+    memoria->fila = (int *)reserva_bloco(divisor, (size_t)largura * altura * sizeof(int));
+    memoria->frente = (LINHA_BITS *)reserva_bloco(divisor, palavras_frente * sizeof(LINHA_BITS));
+    memoria->proxima = (LINHA_BITS *)reserva_bloco(divisor, palavras_frente * sizeof(LINHA_BITS));
+    memoria->visitados = (LINHA_BITS *)reserva_bloco(divisor, palavras * sizeof(LINHA_BITS));
+    memoria->livres = (LINHA_BITS *)reserva_bloco(divisor, palavras * sizeof(LINHA_BITS));
+}
 
-    for (int i = 0; i < LINHAS_MAPA; i++)
+//BFS reversa a partir da celula alvo: preenche distancia[] com o numero de passos de cada celula ate o alvo (-1 = parede ou inalcancavel).
+//A fila termina com as celulas alcancadas em ordem de distancia; retorna quantas sao.
+int bfs_distancias(const BITBOARDS_MAPA *mapa, int alvo, int *distancia, int *fila)
+{
+    int inicio_fila = 0, fim_fila = 0;
+    memset(distancia, -1, (size_t)CELULAS_MAPA(mapa) * sizeof(int));
+    if (eh_parede(mapa, alvo % mapa->largura, alvo / mapa->largura)) return 0;
+    distancia[alvo] = 0;
+    fila[fim_fila++] = alvo;
+    while (inicio_fila < fim_fila)
     {
-        int j = 0;
-        char c;
-        while ((c = fgetc(file)) != '\n' && c != EOF)
-        {
-            if (j < COLUNAS_MAPA)
-            {
-                matriz_mapa[i][j] = c;
-                j++;
-            }
-        }
-        while (j < COLUNAS_MAPA)
+        int atual = fila[inicio_fila++];
+        int x = atual % mapa->largura, y = atual / mapa->largura;
+        for (int d = 0; d < 4; d++)
         {
-            matriz_mapa[i][j] = ' ';
-            j++;
+            int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+            if (eh_parede(mapa, nx, ny) || distancia[INDICE_CELULA(mapa, nx, ny)] >= 0) continue;
+            distancia[INDICE_CELULA(mapa, nx, ny)] = distancia[atual] + 1;
+            fila[fim_fila++] = INDICE_CELULA(mapa, nx, ny);
         }
     }
-
-    fclose(file);
+    return fim_fila;
 }
 
-void carrega_mapa(const char *nome_mapa, char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], POS_PACMAN *pacman, STATUS_PLAYER *player)
+//BFS restrita ao retangulo [x0, x1) x [y0, y1) a partir de (origem_x, origem_y): distancia[] recebe os passos de cada celula do retangulo
+//ate a origem sem sair dele (-1 = parede ou so alcancavel por fora), indexada por (y - y0) * (x1 - x0) + (x - x0). E a busca local do
+//HPA*: o retangulo e um cluster, ou dois vizinhos, entao o custo nao depende do tamanho do mapa.
+void bfs_retangulo(const BITBOARDS_MAPA *mapa, int x0, int y0, int x1, int y1, int origem_x, int origem_y, int *distancia, int *fila)
 {
-    FILE *mapa;
-    int i, j;
-    if (nome_mapa == "mapa1.txt") // se for o primeiro mapa a pontuacao alvo  iniciada em zero
-    {
-        player->pontuacao_alvo = 0;
-    }
-    num_monstros = 0;  // Reinicializa o nmero de monstros para evitar duplicaes
-    mapa = fopen(nome_mapa, "r");
-    if (mapa == NULL)
-    {
-        printf("Erro ao abrir mapa");
-        return;
-    }
-
-    for (i = 0; i < LINHAS_MAPA; i++)
+    int largura = x1 - x0, inicio_fila = 0, fim_fila = 0;
+    memset(distancia, -1, (size_t)largura * (y1 - y0) * sizeof(int));
+    if (eh_parede(mapa, origem_x, origem_y)) return;
+    distancia[(origem_y - y0) * largura + origem_x - x0] = 0;
+    fila[fim_fila++] = (origem_y - y0) * largura + origem_x - x0;
+    while (inicio_fila < fim_fila)
     {
-        fgets(matriz_mapa[i], COLUNAS_MAPA + 2, mapa);
-        for (j = 0; j < COLUNAS_MAPA; j++)
+        int atual = fila[inicio_fila++];
+        int x = x0 + atual % largura, y = y0 + atual / largura;
+        for (int d = 0; d < 4; d++)
         {
-            switch (matriz_mapa[i][j])
-            {
-            case 'J':
-                pacman->x = j;
-                pacman->y = i;
-                pacman->x_inicial = j;
-                pacman->y_inicial = i;
-                pacman->dx = 0;
-                pacman->dy = 0;
-                matriz_mapa[i][j] = ' ';
-                break;
-            case 'M':
-                monstros[num_monstros].x = j;
-                monstros[num_monstros].y = i;
-                monstros[num_monstros].x_inicial = j;
-                monstros[num_monstros].y_inicial = i;
-                monstros[num_monstros].dx = 1;
-                monstros[num_monstros].dy = 0;
-                num_monstros++;
-                matriz_mapa[i][j] = ' ';
-                break;
-            case '.':
-                player->pontuacao_alvo += 10;
-                break;
-            case 'S':
-                player->pontuacao_alvo += 20;
-                break;
-            case 'F':
-                player->pontuacao_alvo += 30;
-                break;
-            default:
-                break;
-            }
+            int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+            if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1 || eh_parede(mapa, nx, ny)) continue;
+            int vizinho = (ny - y0) * largura + nx - x0;
+            if (distancia[vizinho] >= 0) continue;
+            distancia[vizinho] = distancia[atual] + 1;
+            fila[fim_fila++] = vizinho;
         }
     }
-
-    fclose(mapa);
 }
 
+//Distancias por frente de onda bit-paralela (alternativa a bfs_distancias sem fila).
+//A frente de cada passo e um bitboard: os vizinhos de todas as celulas da frente saem de uma vez com shifts de 1 bit
+//(esquerda/direita, levando o bit que passa de uma palavra para a outra) e das linhas de cima e de baixo, e um AND com as celulas
+//livres ainda nao visitadas da a proxima frente. Cada passo custa algumas operacoes por palavra do mapa independentemente de quantas
+//celulas estao na frente, e com SSE2/AVX2 sao 2 ou 4 palavras por instrucao. A coluna de folga no fim de cada linha nunca e livre,
+//entao o bit que "passa" do fim de uma linha para o comeco da seguinte e sempre zero e o mapa inteiro e tratado como uma fila de palavras.
+//Como o numero de passos cresce com o tamanho do mapa, em mapas grandes a BFS com fila e mais rapida (ver bfs_bits).
+#define KERNEL_BFS_ESCALAR 0
+#define KERNEL_BFS_SSE2 1
+#define KERNEL_BFS_AVX2 2
+#define NUM_KERNELS_BFS 3
+const char *nomes_kernels_bfs[NUM_KERNELS_BFS] = {"escalar", "SSE2", "AVX2"};
+#define MAXIMO_PALAVRAS_BFS_BITS 256 //mapas com mais palavras de bitboard que isso usam a BFS com fila
 
-
-//Funcao responsavel por graficar elementos da matriz
-void desenha_mapa(char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], POS_PACMAN pacman, STATUS_PLAYER player)
+//Um passo da frente de onda nas palavras [inicio, fim) do mapa. frente e proxima apontam para a palavra 0 da linha 0 dentro do vetor
+//com as linhas extras, entao frente[i - palavras] e frente[i + palavras] sao as palavras de cima e de baixo.
+//Retorna diferente de zero se alguma celula nova foi alcancada.
+LINHA_BITS expande_frente_escalar(const LINHA_BITS *frente, LINHA_BITS *proxima, LINHA_BITS *visitados, const LINHA_BITS *livres, int palavras, int inicio, int fim)
 {
-    //corre linhas e colunas da matriz e grafica seus respectivos elementos
-    int i, j;
-    for (i = 0; i < LINHAS_MAPA; i++)
+    LINHA_BITS alguma = 0;
+    for (int i = inicio; i < fim; i++)
     {
-        for (j = 0; j < COLUNAS_MAPA; j++)
-        {
-            switch (matriz_mapa[i][j])
-            {
-            case 'W':
-                DrawRectangle(j * TAM_PIXEL, i * TAM_PIXEL, TAM_PIXEL, TAM_PIXEL, BLUE);
-                break;
-            case 'F':
-                DrawCircle(j * TAM_PIXEL + TAM_PIXEL / 2, i * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, RED);
-                break;
-            case 'M':
-                DrawCircle(j * TAM_PIXEL + TAM_PIXEL / 2, i * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, PURPLE);
-                break;
-            case '.':
-                DrawCircle(j * TAM_PIXEL + TAM_PIXEL / 2, i * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 4, WHITE);
-                break;
-            case 'S':
-                DrawCircle(j * TAM_PIXEL + TAM_PIXEL / 2, i * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, ORANGE);
-                break;
-            default:
-                break;
-            }
-        }
+        LINHA_BITS f = frente[i];
+        LINHA_BITS vizinhos = (f << 1) | (frente[i - 1] >> 63) | (f >> 1) | (frente[i + 1] << 63) | frente[i - palavras] | frente[i + palavras];
+        LINHA_BITS nova = vizinhos & livres[i] & ~visitados[i];
+        proxima[i] = nova;
+        visitados[i] |= nova;
+        alguma |= nova;
     }
+    return alguma;
+}
 
-    // Desenha o Pacman
-    DrawCircle(pacman.x * TAM_PIXEL + TAM_PIXEL / 2, pacman.y * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, YELLOW);
-
-    // Desenha os monstros
-    for (i = 0; i < num_monstros; i++)
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BFS_BITS_X86
+//As versoes vetoriais sao compiladas com o atributo target, entao nao precisam de -msse2/-mavx2: a escolha e feita
+//em tempo de execucao (ver melhor_kernel_bfs), e o mesmo executavel roda em processadores sem AVX2
+__attribute__((target("sse2")))
+LINHA_BITS expande_frente_sse2(const LINHA_BITS *frente, LINHA_BITS *proxima, LINHA_BITS *visitados, const LINHA_BITS *livres, int palavras, int total)
+{
+    __m128i alguma = _mm_setzero_si128();
+    int i;
+    for (i = 0; i + 2 <= total; i += 2) //2 palavras por registrador
     {
-        DrawCircle(monstros[i].x * TAM_PIXEL + TAM_PIXEL / 2, monstros[i].y * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, PURPLE);
+        __m128i f = _mm_loadu_si128((const __m128i *)&frente[i]);
+        __m128i lados = _mm_or_si128(_mm_or_si128(_mm_slli_epi64(f, 1), _mm_srli_epi64(_mm_loadu_si128((const __m128i *)&frente[i - 1]), 63)),
+                                     _mm_or_si128(_mm_srli_epi64(f, 1), _mm_slli_epi64(_mm_loadu_si128((const __m128i *)&frente[i + 1]), 63)));
+        __m128i vizinhos = _mm_or_si128(lados, _mm_or_si128(_mm_loadu_si128((const __m128i *)&frente[i - palavras]),
+                                                            _mm_loadu_si128((const __m128i *)&frente[i + palavras])));
+        __m128i vis = _mm_loadu_si128((const __m128i *)&visitados[i]);
+        __m128i nova = _mm_andnot_si128(vis, _mm_and_si128(vizinhos, _mm_loadu_si128((const __m128i *)&livres[i])));
+        _mm_storeu_si128((__m128i *)&proxima[i], nova);
+        _mm_storeu_si128((__m128i *)&visitados[i], _mm_or_si128(vis, nova));
+        alguma = _mm_or_si128(alguma, nova);
     }
+    LINHA_BITS partes[2];
+    _mm_storeu_si128((__m128i *)partes, alguma);
+    return partes[0] | partes[1] | expande_frente_escalar(frente, proxima, visitados, livres, palavras, i, total);
+}
 
-    // Desenha a pontuao e vidas
-    DrawText(TextFormat("Vidas: %d", player.vida), 10, 5, 30, RED);
-    DrawText(TextFormat("Pontos: %d", player.pontuacao), 180, 5, 30, BLUE);
-    DrawText(TextFormat("Fase: %d", player.fase), 400, 5, 30, YELLOW);
-    DrawText(TextFormat("Dificuldade: %d", player.dificuldade), 590, 5, 30, ORANGE);
+__attribute__((target("avx2")))
+LINHA_BITS expande_frente_avx2(const LINHA_BITS *frente, LINHA_BITS *proxima, LINHA_BITS *visitados, const LINHA_BITS *livres, int palavras, int total)
+{
+    __m256i alguma = _mm256_setzero_si256();
+    int i;
+    for (i = 0; i + 4 <= total; i += 4) //4 palavras por registrador
+    {
+        __m256i f = _mm256_loadu_si256((const __m256i *)&frente[i]);
+        __m256i lados = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(f, 1), _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *)&frente[i - 1]), 63)),
+                                        _mm256_or_si256(_mm256_srli_epi64(f, 1), _mm256_slli_epi64(_mm256_loadu_si256((const __m256i *)&frente[i + 1]), 63)));
+        __m256i vizinhos = _mm256_or_si256(lados, _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&frente[i - palavras]),
+                                                                  _mm256_loadu_si256((const __m256i *)&frente[i + palavras])));
+        __m256i vis = _mm256_loadu_si256((const __m256i *)&visitados[i]);
+        __m256i nova = _mm256_andnot_si256(vis, _mm256_and_si256(vizinhos, _mm256_loadu_si256((const __m256i *)&livres[i])));
+        _mm256_storeu_si256((__m256i *)&proxima[i], nova);
+        _mm256_storeu_si256((__m256i *)&visitados[i], _mm256_or_si256(vis, nova));
+        alguma = _mm256_or_si256(alguma, nova);
+    }
+    LINHA_BITS resto = expande_frente_escalar(frente, proxima, visitados, livres, palavras, i, total);
+    return (LINHA_BITS)!_mm256_testz_si256(alguma, alguma) | resto;
 }
-//Funcao acionada caso player colida em um monstro
-void trata_colisao(POS_PACMAN *pacman, STATUS_PLAYER *player)
+#endif
+
+//Diz se o processador tem o conjunto de instrucoes do kernel
+int kernel_bfs_disponivel(int kernel)
 {
-    player->vida--;
-    pacman->x = pacman->x_inicial;
-    pacman->y = pacman->y_inicial;
+#ifdef BFS_BITS_X86
+    if (kernel == KERNEL_BFS_SSE2) return __builtin_cpu_supports("sse2");
+    if (kernel == KERNEL_BFS_AVX2) return __builtin_cpu_supports("avx2");
+#endif
+    return kernel == KERNEL_BFS_ESCALAR;
+}
 
-    for (int j = 0; j < num_monstros; j++)
+//Kernel mais rapido disponivel neste processador
+int melhor_kernel_bfs(void)
+{
+    for (int kernel = NUM_KERNELS_BFS - 1; kernel > 0; kernel--)
     {
-        monstros[j].x = monstros[j].x_inicial;
-        monstros[j].y = monstros[j].y_inicial;
+        if (kernel_bfs_disponivel(kernel)) return kernel;
     }
+    return KERNEL_BFS_ESCALAR;
 }
-//Funcao para evitar que dois monstros ocupem o mesmo pixel
-void trata_colisao_monstros(POS_MONSTRO *monstros)
+
+//Preenche distancia[] (passos ate o alvo, -1 = parede ou inalcancavel) expandindo a frente de onda com o kernel escolhido.
+//Da as mesmas distancias que bfs_distancias. Retorna quantas celulas foram alcancadas.
+int bfs_bits_kernel(const BITBOARDS_MAPA *mapa, int alvo, int *distancia, MEMORIA_BFS *memoria, int kernel)
 {
-    for (int i = 0; i < num_monstros; i++)
+    int palavras = mapa->palavras;
+    int total = mapa->altura * palavras;
+    //palavra 0 da linha 0: antes dela ficam a linha extra de cima e uma palavra a mais, lida pelo shift da primeira palavra
+    LINHA_BITS *frente = memoria->frente + palavras + 1, *proxima = memoria->proxima + palavras + 1;
+    LINHA_BITS *visitados = memoria->visitados, *livres = memoria->livres;
+    int alvo_x = alvo % mapa->largura, alvo_y = alvo / mapa->largura;
+    int alcancadas = 1;
+
+    memset(distancia, -1, (size_t)CELULAS_MAPA(mapa) * sizeof(int));
+    if (eh_parede(mapa, alvo_x, alvo_y)) return 0;
+    memset(memoria->frente, 0, ((size_t)total + 2 * palavras + 2) * sizeof(LINHA_BITS));
+    memset(memoria->proxima, 0, ((size_t)total + 2 * palavras + 2) * sizeof(LINHA_BITS));
+    memset(visitados, 0, (size_t)total * sizeof(LINHA_BITS));
+    for (int y = 0; y < mapa->altura; y++)
+    {
+        for (int k = 0; k < palavras; k++)
+        {
+            int colunas = mapa->largura - 64 * k; //colunas do mapa nesta palavra
+            LINHA_BITS mascara = colunas >= 64 ? ~0ULL : (colunas > 0 ? (1ULL << colunas) - 1 : 0);
+            livres[y * palavras + k] = ~mapa->paredes[y * palavras + k] & mascara;
+        }
+    }
+    frente[alvo_y * palavras + PALAVRA_COLUNA(alvo_x)] = BIT_COLUNA(alvo_x);
+    visitados[alvo_y * palavras + PALAVRA_COLUNA(alvo_x)] = BIT_COLUNA(alvo_x);
+    distancia[alvo] = 0;
+
+    for (int d = 1; ; d++)
     {
-        for (int j = i + 1; j < num_monstros; j++)
+        LINHA_BITS alguma;
+#ifdef BFS_BITS_X86
+        if (kernel == KERNEL_BFS_AVX2) alguma = expande_frente_avx2(frente, proxima, visitados, livres, palavras, total);
+        else if (kernel == KERNEL_BFS_SSE2) alguma = expande_frente_sse2(frente, proxima, visitados, livres, palavras, total);
+        else
+#endif
+        alguma = expande_frente_escalar(frente, proxima, visitados, livres, palavras, 0, total);
+        if (!alguma) break;
+
+        //grava a distancia so das celulas que entraram nesta frente
+        for (int y = 0; y < mapa->altura; y++)
         {
-            if (monstros[i].x == monstros[j].x && monstros[i].y == monstros[j].y)
+            for (int k = 0; k < palavras; k++)
             {
-                if (monstros[i].dx != 0)
+                for (LINHA_BITS bits = proxima[y * palavras + k]; bits; bits &= bits - 1)
                 {
-                    monstros[i].dx = 0;
-                    monstros[i].dy = (rand() % 2) ? 1 : -1; // sorteia uma direcao para o monstro seguir
-                }
-                else
-                {
-                    monstros[i].dy = 0;
-                    monstros[i].dx = (rand() % 2) ? 1 : -1; // sorteia uma direcao para o monstro seguir
+                    distancia[INDICE_CELULA(mapa, 64 * k + menor_bit(bits), y)] = d;
+                    alcancadas++;
                 }
             }
         }
+        LINHA_BITS *troca = frente;
+        frente = proxima;
+        proxima = troca;
     }
+    return alcancadas;
 }
 
-int verifica_fim_de_fase(STATUS_PLAYER *player)
+//Distancias ate o alvo com o melhor kernel do processador, ou com a fila se o mapa for grande demais para a frente de onda
+int bfs_bits(const BITBOARDS_MAPA *mapa, int alvo, int *distancia, MEMORIA_BFS *memoria)
 {
-    return player->pontuacao >= player->pontuacao_alvo;
+    if (mapa->altura * mapa->palavras > MAXIMO_PALAVRAS_BFS_BITS)
+        return bfs_distancias(mapa, alvo, distancia, memoria->fila);
+    return bfs_bits_kernel(mapa, alvo, distancia, memoria, melhor_kernel_bfs());
 }
-//Verifica se o pacman nao esta ocupando uma posicao com coletavel, se sim faz a coleta e substitui por um espaco vazio.
-void verifica_coleta(POS_PACMAN *pacman, char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], STATUS_PLAYER *player)
+
+//Desce um passo no campo de distancias: retorna a primeira direcao (na ordem de direcoes[]) que leva a um vizinho
+//mais perto do alvo, ou -1 se a origem ja e o alvo ou nao alcanca o alvo
+int passo_descendo(const BITBOARDS_MAPA *mapa, const int *distancia, int origem)
 {
-    char item = matriz_mapa[pacman->y][pacman->x];
-    switch (item)
+    int x = origem % mapa->largura, y = origem / mapa->largura;
+    if (distancia[origem] <= 0) return -1;
+    for (int d = 0; d < 4; d++)
     {
-    case '.':
-        player->pontuacao += 10;
-        matriz_mapa[pacman->y][pacman->x] = ' ';
-        break;
-    case 'S':
-        player->pontuacao += 20;
-        matriz_mapa[pacman->y][pacman->x] = ' ';
-        break;
-    case 'F':
-        player->pontuacao += 30;
-        matriz_mapa[pacman->y][pacman->x] = ' ';
-        break;
-    default:
-        break;
+        int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+        if (nx < 0 || nx >= mapa->largura || ny < 0 || ny >= mapa->altura) continue;
+        if (distancia[INDICE_CELULA(mapa, nx, ny)] == distancia[origem] - 1)
+            return d;
     }
+    return -1;
 }
-void controla_dificuldade(STATUS_PLAYER *player)
+
+//Grava a direcao (0 a 3, indice de direcoes[]) da entrada (origem, alvo) da tabela
+void grava_rota(TABELA_ROTAS *tabela, int origem, int alvo, int direcao)
 {
-    player->dificuldade++;
-    VEL_MONSTROS = VEL_MONSTROS-0.05;
+    long long entrada = (long long)alvo * tabela->celulas + origem;
+    tabela->direcoes[entrada >> 2] &= (unsigned char)~(3u << ((entrada & 3) * 2));
+    tabela->direcoes[entrada >> 2] |= (unsigned char)(direcao << ((entrada & 3) * 2));
 }
 
-//funcao responsavel pela movimentacao do pac-man
-void move_pacman(POS_PACMAN *pacman, char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], STATUS_PLAYER *player, float deltaTime)
+//Preenche a tabela de rotas a partir das paredes do mapa. Os vetores da tabela ja devem apontar para o espaco do mapa compilado.
+//Para cada celula alvo e feita uma BFS reversa (bfs_bits), que da a distancia de todas as celulas ate o alvo. A direcao guardada para
+//cada origem e a primeira (na ordem de direcoes[]) que leva a um vizinho mais perto do alvo, ou seja, sempre um menor caminho.
+//Retorna 0 se faltou memoria.
+int calcula_tabela_rotas(TABELA_ROTAS *tabela, const BITBOARDS_MAPA *mapa)
 {
-    static float timer = 0.0f;
-    //Quando se usa o "static"o valor da variavel fica armazenado na memoria, mesmo que o programa saia dessa funcao o valor nao ira mudar (nao voltara pra zero)
-    timer += deltaTime; //temporizador para cadenciar movimentos do pacman (controlar velocidade)
-    if (timer >= VEL_PACMAN) //Se o valor chegar na velocidade de pacman entra no looping
+    int celulas = CELULAS_MAPA(mapa);
+    unsigned short num_componentes = 0;
+    MEMORIA_BFS memoria;
+    DIVISOR_BLOCO divisor = {NULL, 0};
+
+    //mede e depois reparte um bloco com as distancias e a memoria da BFS
+    reserva_bloco(&divisor, (size_t)celulas * sizeof(int));
+    divide_memoria_bfs(&memoria, &divisor, mapa->largura, mapa->altura);
+    divisor.base = (unsigned char *)malloc(divisor.usado);
+    if (divisor.base == NULL) return 0;
+    divisor.usado = 0;
+    int *distancia = (int *)reserva_bloco(&divisor, (size_t)celulas * sizeof(int));
+    divide_memoria_bfs(&memoria, &divisor, mapa->largura, mapa->altura);
+
+    tabela->celulas = celulas;
+    tabela->largura = mapa->largura;
+    memset(tabela->componente, 0, (size_t)celulas * sizeof(unsigned short));
+    memset(tabela->direcoes, 0, ((size_t)celulas * celulas + 3) / 4);
+
+    for (int alvo = 0; alvo < celulas; alvo++)
     {
-        int novoX = pacman->x + pacman->dx; //move nova posicao do pacman na direcao do vetor "acionado"
-        int novoY = pacman->y + pacman->dy;
+        if (eh_parede(mapa, alvo % mapa->largura, alvo / mapa->largura)) continue;
 
-        if (matriz_mapa[novoY][novoX] != 'W')  // se essa posicao NAO for uma parede, o pacman vai para nova posicao
+        bfs_bits(mapa, alvo, distancia, &memoria);
+
+        //A primeira BFS que chega numa celula ainda sem componente define a regiao conexa dela
+        if (tabela->componente[alvo] == 0)
         {
-            pacman->x = novoX;
-            pacman->y = novoY;
-            // verifica se essa posicao nao  a mesma de nem um dos monstro, se for, aciona a funcao trata_colisao
-            for (int i = 0; i < num_monstros; i++)
+            num_componentes++;
+            for (int celula = 0; celula < celulas; celula++)
             {
-                if (pacman->x == monstros[i].x && pacman->y == monstros[i].y)
-                {
-                    trata_colisao(pacman, player);
-                    return;
-                }
+                if (distancia[celula] >= 0)
+                    tabela->componente[celula] = num_componentes;
             }
-            //Aciona funcao para verificar se coleta foi feita
-            verifica_coleta(pacman, matriz_mapa, player);
         }
-        timer = 0.0f; //Zera timer
+
+        //Para cada origem alcancada escolhe o passo que diminui a distancia ate o alvo
+        for (int origem = 0; origem < celulas; origem++)
+        {
+            if (distancia[origem] > 0)
+                grava_rota(tabela, origem, alvo, passo_descendo(mapa, distancia, origem));
+        }
     }
+    free(divisor.base);
+    return 1;
 }
 
+//Consulta o proximo passo de (origem_x, origem_y) em direcao a (alvo_x, alvo_y).
+//Retorna 0 (e *dx = *dy = 0) se o alvo for a propria origem ou se nao houver caminho ate ele.
+int consulta_rota(const TABELA_ROTAS *tabela, int origem_x, int origem_y, int alvo_x, int alvo_y, int *dx, int *dy)
+{
+    int origem = origem_y * tabela->largura + origem_x;
+    int alvo = alvo_y * tabela->largura + alvo_x;
+    *dx = 0;
+    *dy = 0;
+    if (origem == alvo || tabela->componente[origem] == 0 || tabela->componente[origem] != tabela->componente[alvo])
+        return 0;
 
-//Funcao heuristica para apoio do algoritmo A*
-int heuristica(int x1, int y1, int x2, int y2)
+    long long entrada = (long long)alvo * tabela->celulas + origem;
+    int direcao = (tabela->direcoes[entrada >> 2] >> ((entrada & 3) * 2)) & 3;
+    *dx = direcoes[direcao][0];
+    *dy = direcoes[direcao][1];
+    return 1;
+}
+
+//Atualiza o campo de fluxo para o alvo (normalmente a posicao do Pac-Man). Se o alvo nao mudou desde o ultimo calculo
+//a BFS nao e refeita, entao em ticks em que o Pac-Man fica parado o campo sai de graca.
+void atualiza_campo_fluxo(CAMPO_FLUXO *campo, const BITBOARDS_MAPA *mapa, int alvo_x, int alvo_y)
 {
-    return abs(x1 - x2) + abs(y1 - y2); //Retorna a soma das distancias entre as coordenadas x e y de dois pontos.
+    if (campo->valido && campo->alvo_x == alvo_x && campo->alvo_y == alvo_y)
+    {
+        campo->reaproveitados++;
+        return;
+    }
+    bfs_bits(mapa, INDICE_CELULA(mapa, alvo_x, alvo_y), campo->distancia, &campo->bfs);
+    campo->alvo_x = alvo_x;
+    campo->alvo_y = alvo_y;
+    campo->valido = 1;
+    campo->calculos++;
 }
 
-//Funcao para prencher os valores de um Node
-//Cria e inicializa um novo Node com as coordenadas fornecidas, custo g, heurstica h, e uma referncia ao node original.
-Node *cria_node(int x, int y, int g, int h, Node *parent)
+//Proximo passo de (origem_x, origem_y) descendo o campo de fluxo. Retorna 0 (parado) se ja esta no alvo ou nao ha caminho.
+int consulta_campo_fluxo(const CAMPO_FLUXO *campo, const BITBOARDS_MAPA *mapa, int origem_x, int origem_y, int *dx, int *dy)
 {
-    //Vetor node (*node)
-    Node *node = (Node *)malloc(sizeof(Node));
-    //  necessario alocar memria suficiente para armazenar um Node e retorna um ponteiro para esse espao de memria.
-    //(Node *) Faz um casting que indica que  um ponteiro do tipo Node.
-    node->x = x;
-    node->y = y;
-    node->g = g;
-    node->h = h;
-    node->f = g + h;
-    node->parent = parent;
-    return node;
+    int direcao = passo_descendo(mapa, campo->distancia, INDICE_CELULA(mapa, origem_x, origem_y));
+    *dx = 0;
+    *dy = 0;
+    if (direcao < 0) return 0;
+    *dx = direcoes[direcao][0];
+    *dy = direcoes[direcao][1];
+    return 1;
 }
 
-// Funo de comparao usada pela funcao qsort para ordenar ns na lista aberta.
-int compara_nodes(const void *a, const void *b)
-// declarados como constantes vazias, pois valores no serao alterados (valores serao apenas comparados nessa funcao).
+//Celulas do cluster: [x0, x1) x [y0, y1) (os clusters da ultima coluna e da ultima linha podem ser menores)
+void limites_cluster(const GRAFO_HPA *grafo, int cluster, int *x0, int *y0, int *x1, int *y1)
 {
-//Compara os valores f de dois ns. Isso garante que os ns na lista aberta sejam processados na ordem de menor custo total f.
-    Node *nodeA = *(Node **)a;
-    Node *nodeB = *(Node **)b;
-    //Sintaxe chata de entender, mas passo a passo:
-    // "a"  um ponteiro genrico (void *), (Node **)a:  um casting (converso de tipo) do ponteiro genrico "a" para um ponteiro de Node (tipo Node).
-    // *(Node **)a - desreferencianmento do ponteiro resultante do casting. Ou seja, est acessando o valor para o qual o ponteiro (agora do tipo Node) est apontando.
-    // Node *nodeA = *(Node **)b  - No final armazena esse valor apontado em NodeA
-    return nodeA->f - nodeB->f;  //Se o f do A for maior que o f do B retornara um valor positivo, se os "f" forem iguais retornara 0, se f do A for menor que f do B retornara negativo.
+    *x0 = cluster % grafo->clusters_x * LADO_CLUSTER;
+    *y0 = cluster / grafo->clusters_x * LADO_CLUSTER;
+    *x1 = *x0 + LADO_CLUSTER < grafo->largura ? *x0 + LADO_CLUSTER : grafo->largura;
+    *y1 = *y0 + LADO_CLUSTER < grafo->altura ? *y0 + LADO_CLUSTER : grafo->altura;
 }
 
-//funo para atualizar o movimento dos monstros em direo ao Pac-Man usando o algoritmo A* e fazendo alguns outros tratamentos
-void move_monstros(POS_PACMAN *pacman, STATUS_PLAYER *player, char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], float deltaTime)
+//No do grafo que esta na celula (procura entre os nos do cluster dela), ou -1
+int no_da_celula_hpa(const GRAFO_HPA *grafo, int cluster, int celula)
+{
+    for (int no = grafo->inicio_nos_cluster[cluster]; no < grafo->inicio_nos_cluster[cluster + 1]; no++)
+    {
+        if (grafo->celula_no[no] == celula)
+            return no;
+    }
+    return -1;
+}
+
+void libera_grafo_hpa(GRAFO_HPA *grafo)
 {
-    static float timer = 0.0f;
-    static int dificuldade_contador=0;
+    free(grafo->bloco);
+    memset(grafo, 0, sizeof(*grafo));
+}
 
-    timer += deltaTime;
-    if (dificuldade_contador >=TEMPO_DIFICULDADE)
+//Monta o grafo abstrato do HPA* a partir das paredes do mapa.
+//Primeiro marca as celulas das entradas em cada borda entre clusters; depois percorre os clusters duas vezes: na primeira numera os nos
+//e conta as arestas, na segunda (com os vetores ja reservados em um unico bloco) grava os nos e as arestas. As arestas de dentro do cluster
+//saem de uma BFS local a partir de cada no. Retorna 0 se faltou memoria.
+int monta_grafo_hpa(GRAFO_HPA *grafo, const BITBOARDS_MAPA *mapa)
+{
+    int distancia[LADO_CLUSTER * LADO_CLUSTER], fila[LADO_CLUSTER * LADO_CLUSTER];
+    int *no_da_celula = (int *)malloc((size_t)CELULAS_MAPA(mapa) * sizeof(int)); //-1 = nao e no; -2 = entrada ainda sem numero
+    memset(grafo, 0, sizeof(*grafo));
+    if (no_da_celula == NULL)
     {
-        dificuldade_contador=0;
-        controla_dificuldade(player);
+        printf("Erro: sem memoria para montar o grafo do HPA*\n");
+        return 0;
     }
+    memset(no_da_celula, -1, (size_t)CELULAS_MAPA(mapa) * sizeof(int));
+    grafo->largura = mapa->largura;
+    grafo->altura = mapa->altura;
+    grafo->clusters_x = (mapa->largura + LADO_CLUSTER - 1) / LADO_CLUSTER;
+    grafo->clusters_y = (mapa->altura + LADO_CLUSTER - 1) / LADO_CLUSTER;
+    int clusters = grafo->clusters_x * grafo->clusters_y;
 
-    if (timer >= VEL_MONSTROS) //Mesma logica do move_pacman
+    //entradas: a borda da direita e a de baixo de cada cluster (as outras sao a da direita/baixo do vizinho)
+    for (int cluster = 0; cluster < clusters; cluster++)
     {
-        dificuldade_contador++;
-        for (int i = 0; i < num_monstros; i++) //A operacao para mover os monstros ira se repetir para todos os monstros
+        int x0, y0, x1, y1;
+        limites_cluster(grafo, cluster, &x0, &y0, &x1, &y1);
+        for (int lado = 0; lado < 2; lado++)
         {
-            //                    dir      esq     baixo    cima
-            int direcoes[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}; //vetor das configuracoes de direcoes (direita, esquerda, baixo, cima)
-            int melhor_dx = 0, melhor_dy = 0; //iniciando parado
-
-            Node *abertos[LINHAS_MAPA * COLUNAS_MAPA]; //Vetor de nos abertos
-            int num_abertos = 0; //Numero de nodes abertos
-            Node *fechados[LINHAS_MAPA * COLUNAS_MAPA]; //Vetor de nos Fechados
-            int num_fechados = 0; //Numero de nodes fechados
-
-            Node *inicio = cria_node(monstros[i].x, monstros[i].y, 0, heuristica(monstros[i].x, monstros[i].y, pacman->x, pacman->y), NULL);
-            //                                                        ^chama funcao heuristica
-            abertos[num_abertos++] = inicio;//adiciona posicao inicial a lista aberta
-
-            while (num_abertos > 0)
+            if (lado == 0 ? x1 >= mapa->largura : y1 >= mapa->altura) continue;
+            int borda_x = lado == 0 ? x1 - 1 : x0, borda_y = lado == 0 ? y0 : y1 - 1; //primeira celula da borda, deste lado
+            int passo_x = lado == 1, passo_y = lado == 0; //ao longo da borda
+            int comprimento = lado == 0 ? y1 - y0 : x1 - x0;
+            int inicio_trecho = -1;
+            for (int k = 0; k <= comprimento; k++)
             {
-                qsort(abertos, num_abertos, sizeof(Node *), compara_nodes);//Funcao responsavel pela ordenacao/organizacao da lista aberta
-//parametros do qsort(vetor que sera organizado, numero de elementos no vetor, tamanho em bytes dos elementos do vetor, funcao para comparar elementos)
-                Node *atual = abertos[0]; //Node *atual = o elemento com o valor de menor F da lista aberta
+                int x = borda_x + k * passo_x, y = borda_y + k * passo_y;
+                int livre = k < comprimento && !eh_parede(mapa, x, y) && !eh_parede(mapa, x + passo_y, y + passo_x);
+                if (livre && inicio_trecho < 0) inicio_trecho = k;
+                if (livre || inicio_trecho < 0) continue;
 
-                for (int j = 0; j < num_abertos - 1; j++)
+                int pontas[2] = {inicio_trecho, k - 1};
+                if (k - inicio_trecho < TRECHO_DUAS_ENTRADAS)
+                    pontas[0] = pontas[1] = (inicio_trecho + k - 1) / 2;
+                for (int p = 0; p < 2; p++)
                 {
-                    abertos[j] = abertos[j + 1]; //move todos os ns na lista de "abertos" uma posio para a esquerda, removendo o primeiro n (abertos[0]) que j est sendo explorado.
+                    int ex = borda_x + pontas[p] * passo_x, ey = borda_y + pontas[p] * passo_y;
+                    no_da_celula[INDICE_CELULA(mapa, ex, ey)] = -2;
+                    no_da_celula[INDICE_CELULA(mapa, ex + passo_y, ey + passo_x)] = -2;
                 }
-                num_abertos--; // Diminui o numero de nodes na lista aberta
+                inicio_trecho = -1;
+            }
+        }
+    }
 
-                fechados[num_fechados++] = atual;//Adiciona posicao atual a lista fechada
-                //PASSOS CASO NODE ATUAL SEJA A POSICAO DO PACMAN
-                if (atual->x == pacman->x && atual->y == pacman->y) // se a posicao atual for a do pacman:
+    for (int passo = 0; passo < 2; passo++) //primeiro numera e conta, depois grava
+    {
+        int num_nos = 0, num_arestas = 0;
+        for (int cluster = 0; cluster < clusters; cluster++)
+        {
+            int x0, y0, x1, y1;
+            limites_cluster(grafo, cluster, &x0, &y0, &x1, &y1);
+            if (passo == 1) grafo->inicio_nos_cluster[cluster] = num_nos;
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
                 {
-                    Node *caminho = atual;//Um ponteiro que aponta para o node atual do pacman
-                    while (caminho->parent->parent)
-                        //Essa condicao do loop while no  trivial. Ela vai seguir os ns anteriores enquanto o ultimo parent (node pai) no for vazio (null).
-                        //Nesse caso, um parent vazio significa que encontramos a posicao inicial, (a posicao sem node pai) mas como queremos a proxima posicao (seguinte a posicao inicial)
-                        //o loop ira rodar at encontrar uma posicao que tenha o "Node vo" vazio.
+                    int celula = INDICE_CELULA(mapa, x, y);
+                    if (no_da_celula[celula] == -1) continue;
+                    if (passo == 0)
+                        no_da_celula[celula] = num_nos;
+                    else
+                    {
+                        grafo->celula_no[num_nos] = celula;
+                        grafo->inicio_arestas[num_nos] = num_arestas;
+                    }
+                    num_nos++;
+
+                    //para fora do cluster: nos vizinhos de outro cluster, custo 1
+                    for (int d = 0; d < 4; d++)
+                    {
+                        int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+                        if (nx < 0 || nx >= mapa->largura || ny < 0 || ny >= mapa->altura) continue;
+                        if (CLUSTER_DA_CELULA(grafo, nx, ny) == cluster || no_da_celula[INDICE_CELULA(mapa, nx, ny)] == -1) continue;
+                        if (passo == 1)
+                        {
+                            grafo->destino_aresta[num_arestas] = no_da_celula[INDICE_CELULA(mapa, nx, ny)];
+                            grafo->custo_aresta[num_arestas] = 1;
+                        }
+                        num_arestas++;
+                    }
+                    //dentro do cluster: os outros nos alcancaveis sem sair dele
+                    bfs_retangulo(mapa, x0, y0, x1, y1, x, y, distancia, fila);
+                    for (int oy = y0; oy < y1; oy++)
                     {
-                        caminho = caminho->parent; //Avancamos, ou melhor, recuamos um no, como visto acima o objetivo e recuar ate encontrar o no que antecede a posicao com o parent vazio, ou seja a posicao inicial
+                        for (int ox = x0; ox < x1; ox++)
+                        {
+                            int outra = INDICE_CELULA(mapa, ox, oy), passos = distancia[(oy - y0) * (x1 - x0) + ox - x0];
+                            if (outra == celula || no_da_celula[outra] == -1 || passos < 0) continue;
+                            if (passo == 1)
+                            {
+                                grafo->destino_aresta[num_arestas] = no_da_celula[outra];
+                                grafo->custo_aresta[num_arestas] = passos;
+                            }
+                            num_arestas++;
+                        }
                     }
-                    melhor_dx = caminho->x - monstros[i].x;//proxima posicao menos posicao atual do monstro para x
-                    melhor_dy = caminho->y - monstros[i].y;//proxima posicao menos posicao atual do monstro para y
-                    //Legenda
+                }
+            }
+        }
+        if (passo == 1)
+        {
+            grafo->inicio_nos_cluster[clusters] = num_nos;
+            grafo->inicio_arestas[num_nos] = num_arestas;
+            break;
+        }
+
+        grafo->num_nos = num_nos;
+        grafo->num_arestas = num_arestas;
+        DIVISOR_BLOCO divisor = {NULL, 0};
+        for (int parte = 0; parte < 2; parte++) //mede, depois reparte
+        {
+            divisor.usado = 0;
+            grafo->celula_no = (int *)reserva_bloco(&divisor, (size_t)num_nos * sizeof(int));
+            grafo->inicio_nos_cluster = (int *)reserva_bloco(&divisor, ((size_t)clusters + 1) * sizeof(int));
+            grafo->inicio_arestas = (int *)reserva_bloco(&divisor, ((size_t)num_nos + 1) * sizeof(int));
+            grafo->destino_aresta = (int *)reserva_bloco(&divisor, (size_t)num_arestas * sizeof(int));
+            grafo->custo_aresta = (int *)reserva_bloco(&divisor, (size_t)num_arestas * sizeof(int));
+            if (parte == 0)
+            {
+                grafo->bloco = malloc(divisor.usado);
+                if (grafo->bloco == NULL)
+                {
+                    printf("Erro: sem memoria para montar o grafo do HPA*\n");
+                    free(no_da_celula);
+                    memset(grafo, 0, sizeof(*grafo));
+                    return 0;
+                }
+                divisor.base = (unsigned char *)grafo->bloco;
+            }
+        }
+    }
+    free(no_da_celula);
+    grafo->hash = hash_paredes(mapa);
+    grafo->pronto = 1;
+    return 1;
+}
+
+//Descarta os caminhos guardados dos monstros (mapa novo, jogo carregado ou monstros de volta ao inicio)
+void invalida_caminhos_hpa(JOGO *jogo)
+{
+    for (int i = 0; i < jogo->num_monstros; i++)
+        jogo->hpa.caminhos[i].num = jogo->hpa.caminhos[i].proximo = 0;
+}
+
+//Faz a proxima consulta de cada monstro comecar a busca incremental do zero (mapa novo, paredes mudadas ou jogo carregado)
+void invalida_buscas_incrementais(JOGO *jogo)
+{
+    for (int i = 0; i < jogo->incremental.monstros; i++)
+        jogo->incremental.buscas[i].iniciada = 0;
+}
+
+//Funcoes auxiliares para os mapas de bits (um bit por celula, indexado por INDICE_CELULA)
+int testa_bit(const unsigned int *bits, int indice)
+{
+    return (bits[indice >> 5] >> (indice & 31)) & 1u;
+}
+
+void liga_bit(unsigned int *bits, int indice)
+{
+    bits[indice >> 5] |= 1u << (indice & 31);
+}
+
+void desliga_bit(unsigned int *bits, int indice)
+{
+    bits[indice >> 5] &= ~(1u << (indice & 31));
+}
+
+int eh_coletavel(char c)
+{
+    return c == '.' || c == 'S' || c == 'F';
+}
+
+//Reparte os vetores da arena do A* para um mapa de "celulas" celulas. Os bits voltam com lixo: quem chama zera (as buscas os deixam zerados)
+void divide_arena(ARENA_NODES *arena, DIVISOR_BLOCO *divisor, size_t celulas)
+{
+    arena->nodes = (Node *)reserva_bloco(divisor, celulas * sizeof(Node));
+    arena->abertos.itens = (Node **)reserva_bloco(divisor, celulas * sizeof(Node *));
+    arena->node_da_celula = (Node **)reserva_bloco(divisor, celulas * sizeof(Node *));
+    arena->bits_abertos = (unsigned int *)reserva_bloco(divisor, PALAVRAS_BITS(celulas) * sizeof(unsigned int));
+    arena->bits_fechados = (unsigned int *)reserva_bloco(divisor, PALAVRAS_BITS(celulas) * sizeof(unsigned int));
+}
+
+//Reparte o bloco de memoria do jogo para um mapa de largura x altura: bitboards, lista de coletaveis, fila de celulas alteradas,
+//grade de ocupacao, arena do A* e campo de fluxo. O bloco so e realocado quando o mapa novo precisa de mais memoria que o anterior; trocar para um
+//mapa do mesmo tamanho nao faz nada. Os bitboards voltam com lixo: quem chama preenche. Retorna 0 se faltou memoria.
+int prepara_memoria_jogo(JOGO *jogo, int largura, int altura)
+{
+    DIVISOR_BLOCO divisor = {NULL, 0};
+    if (jogo->memoria.bloco != NULL && jogo->mapa.largura == largura && jogo->mapa.altura == altura) return 1;
+
+    for (int passo = 0; passo < 2; passo++)
+    {
+        size_t celulas = (size_t)largura * altura;
+        size_t palavras_bits = PALAVRAS_BITS(celulas);
+        divisor.usado = 0;
+        LINHA_BITS *bitboards = (LINHA_BITS *)reserva_bloco(&divisor, tamanho_bitboards(largura, altura) * sizeof(LINHA_BITS));
+        jogo->coletaveis = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+        jogo->posicao_coletavel = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+        jogo->celulas_alteradas = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+        jogo->celula_na_fila = (unsigned int *)reserva_bloco(&divisor, palavras_bits * sizeof(unsigned int));
+        jogo->ocupante = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+        divide_arena(&jogo->arena, &divisor, celulas);
+        jogo->campo_fluxo.distancia = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+        divide_memoria_bfs(&jogo->campo_fluxo.bfs, &divisor, largura, altura);
+        aponta_bitboards(&jogo->mapa, bitboards, largura, altura);
+
+        if (passo == 0 && !cresce_memoria(&jogo->memoria, divisor.usado, "um mapa"))
+        {
+            memset(&jogo->mapa, 0, sizeof(jogo->mapa));
+            return 0;
+        }
+        divisor.base = (unsigned char *)jogo->memoria.bloco;
+    }
+    memset(jogo->celula_na_fila, 0, PALAVRAS_BITS((size_t)largura * altura) * sizeof(unsigned int));
+    memset(jogo->arena.bits_abertos, 0, PALAVRAS_BITS((size_t)largura * altura) * sizeof(unsigned int)); //as buscas deixam os bits zerados
+    memset(jogo->arena.bits_fechados, 0, PALAVRAS_BITS((size_t)largura * altura) * sizeof(unsigned int));
+    jogo->num_celulas_alteradas = 0;
+    return 1;
+}
+
+//Os vetores de posicao dos monstros em uma ordem fixa (a de escreve_posicao), para copiar todos com um laco
+void vetores_monstros(const MONSTROS *monstros, int *vetores[CAMPOS_MONSTRO])
+{
+    int *todos[CAMPOS_MONSTRO] = {monstros->x, monstros->y, monstros->dx, monstros->dy,
+                                  monstros->x_inicial, monstros->y_inicial, monstros->x_anterior, monstros->y_anterior};
+    memcpy(vetores, todos, sizeof(todos));
+}
+
+//Reparte o bloco dos monstros para "quantidade" monstros: os vetores de MONSTROS, os elos da grade de ocupacao, as decisoes e os caminhos do HPA*.
+//Como o bloco do jogo, so e realocado quando precisa crescer. Os valores nao sao mantidos: quem chama preenche as posicoes.
+//Retorna 0 se faltou memoria.
+int prepara_monstros(JOGO *jogo, int quantidade)
+{
+    MONSTROS *monstros = &jogo->monstros;
+    DIVISOR_BLOCO divisor = {NULL, 0};
+    if (quantidade <= monstros->capacidade) return 1;
+
+    for (int passo = 0; passo < 2; passo++)
+    {
+        int **vetores[CAMPOS_MONSTRO] = {&monstros->x, &monstros->y, &monstros->dx, &monstros->dy,
+                                         &monstros->x_inicial, &monstros->y_inicial, &monstros->x_anterior, &monstros->y_anterior};
+        divisor.usado = 0;
+        for (int v = 0; v < CAMPOS_MONSTRO; v++)
+            *vetores[v] = (int *)reserva_bloco(&divisor, (size_t)quantidade * sizeof(int));
+        jogo->proximo_ocupante = (int *)reserva_bloco(&divisor, (size_t)quantidade * sizeof(int));
+        jogo->decisao_dx = (int *)reserva_bloco(&divisor, (size_t)quantidade * sizeof(int));
+        jogo->decisao_dy = (int *)reserva_bloco(&divisor, (size_t)quantidade * sizeof(int));
+        jogo->hpa.caminhos = (CAMINHO_HPA *)reserva_bloco(&divisor, (size_t)quantidade * sizeof(CAMINHO_HPA));
+
+        if (passo == 0 && !cresce_memoria(&monstros->memoria, divisor.usado, "os monstros"))
+        {
+            monstros->capacidade = 0;
+            return 0;
+        }
+        divisor.base = (unsigned char *)monstros->memoria.bloco;
+    }
+    monstros->capacidade = quantidade;
+    return 1;
+}
+
+//Devolve os blocos de memoria do jogo. O jogo volta a precisar de prepara_memoria_jogo (carrega_mapa) antes de ser usado
+void libera_jogo(JOGO *jogo)
+{
+    define_threads_ia(jogo, 1);
+    free(jogo->memoria.bloco);
+    free(jogo->incremental.memoria.bloco);
+    free(jogo->monstros.memoria.bloco);
+    memset(&jogo->memoria, 0, sizeof(jogo->memoria));
+    memset(&jogo->incremental, 0, sizeof(jogo->incremental));
+    memset(&jogo->monstros, 0, sizeof(jogo->monstros));
+    memset(&jogo->mapa, 0, sizeof(jogo->mapa));
+}
+
+//Monta a lista de coletaveis a partir dos bitboards. Chamada sempre que o mapa inteiro e trocado (mapa novo ou jogo salvo)
+void monta_lista_coletaveis(JOGO *jogo)
+{
+    const BITBOARDS_MAPA *mapa = &jogo->mapa;
+    jogo->num_coletaveis = 0;
+    memset(jogo->posicao_coletavel, -1, (size_t)CELULAS_MAPA(mapa) * sizeof(int));
+    for (int i = 0; i < mapa->altura; i++)
+    {
+        for (int k = 0; k < mapa->palavras; k++)
+        {
+            //percorre so os bits ligados da linha, da coluna menor para a maior
+            size_t palavra = (size_t)i * mapa->palavras + k;
+            for (LINHA_BITS itens = mapa->pontos[palavra] | mapa->power[palavra] | mapa->frutas[palavra]; itens; itens &= itens - 1)
+            {
+                int celula = INDICE_CELULA(mapa, 64 * k + menor_bit(itens), i);
+                jogo->posicao_coletavel[celula] = jogo->num_coletaveis;
+                jogo->coletaveis[jogo->num_coletaveis++] = celula;
+            }
+        }
+    }
+    //o mapa inteiro mudou: em vez de enfileirar todas as celulas, o proximo retrato copia tudo
+    jogo->num_celulas_alteradas = 0;
+    memset(jogo->celula_na_fila, 0, PALAVRAS_BITS((size_t)CELULAS_MAPA(mapa)) * sizeof(unsigned int));
+    jogo->mapa_alterado = 1;
+}
+
+//Tira uma celula da lista de coletaveis colocando o ultimo item no lugar dela
+void remove_coletavel(JOGO *jogo, int x, int y)
+{
+    int celula = INDICE_CELULA(&jogo->mapa, x, y);
+    int posicao = jogo->posicao_coletavel[celula];
+    if (posicao < 0) return;
+    int ultima = jogo->coletaveis[--jogo->num_coletaveis];
+    jogo->coletaveis[posicao] = ultima;
+    jogo->posicao_coletavel[ultima] = posicao;
+    jogo->posicao_coletavel[celula] = -1;
+}
+
+//Poe uma celula no fim da lista de coletaveis
+void insere_coletavel(JOGO *jogo, int x, int y)
+{
+    int celula = INDICE_CELULA(&jogo->mapa, x, y);
+    if (jogo->posicao_coletavel[celula] >= 0) return;
+    jogo->posicao_coletavel[celula] = jogo->num_coletaveis;
+    jogo->coletaveis[jogo->num_coletaveis++] = celula;
+}
+
+//Unico ponto em que uma celula do mapa muda durante o jogo. Atualiza a lista de coletaveis (e com ela o contador do fim de fase),
+//descarta os caminhos pre-calculados se uma parede mudou e poe a celula na fila que o proximo retrato consome.
+void altera_celula(JOGO *jogo, int x, int y, char novo)
+{
+    BITBOARDS_MAPA *mapa = &jogo->mapa;
+    char antigo = celula_do_mapa(mapa, x, y);
+    int celula = INDICE_CELULA(mapa, x, y);
+    size_t palavra = (size_t)y * mapa->palavras + PALAVRA_COLUNA(x);
+    if (antigo == novo) return;
+
+    mapa->paredes[palavra] &= ~BIT_COLUNA(x);
+    mapa->pontos[palavra] &= ~BIT_COLUNA(x);
+    mapa->power[palavra] &= ~BIT_COLUNA(x);
+    mapa->frutas[palavra] &= ~BIT_COLUNA(x);
+    switch (novo)
+    {
+    case 'W': mapa->paredes[palavra] |= BIT_COLUNA(x); break;
+    case '.': mapa->pontos[palavra] |= BIT_COLUNA(x); break;
+    case 'S': mapa->power[palavra] |= BIT_COLUNA(x); break;
+    case 'F': mapa->frutas[palavra] |= BIT_COLUNA(x); break;
+    default: break;
+    }
+    if (eh_coletavel(antigo)) remove_coletavel(jogo, x, y);
+    if (eh_coletavel(novo)) insere_coletavel(jogo, x, y);
+    if ((antigo == 'W') != (novo == 'W'))
+    {
+        //a tabela de rotas e o grafo do HPA* sao compartilhados e so valem para as paredes originais do mapa: este jogo passa a usar o A*
+        jogo->tabela_rotas = NULL;
+        jogo->grafo_hpa = NULL;
+        invalida_buscas_incrementais(jogo);
+        jogo->campo_fluxo.valido = 0;
+        jogo->paredes_alteradas++;
+    }
+    if (!testa_bit(jogo->celula_na_fila, celula))
+    {
+        liga_bit(jogo->celula_na_fila, celula);
+        jogo->celulas_alteradas[jogo->num_celulas_alteradas++] = celula;
+    }
+}
+
+//Grade de ocupacao dos monstros: cada celula guarda o primeiro monstro que esta nela e cada monstro o proximo da mesma celula,
+//entao saber se ha um monstro em uma celula e uma consulta, sem percorrer os monstros. Como nenhum monstro entra em celula
+//ocupada (ver desvia_monstro), a lista so passa de um quando um jogo salvo ja vem com monstros empilhados.
+int monstro_na_celula(const JOGO *jogo, int x, int y)
+{
+    return jogo->ocupante[INDICE_CELULA(&jogo->mapa, x, y)];
+}
+
+void ocupa_celula(JOGO *jogo, int monstro)
+{
+    int celula = INDICE_CELULA(&jogo->mapa, jogo->monstros.x[monstro], jogo->monstros.y[monstro]);
+    jogo->proximo_ocupante[monstro] = jogo->ocupante[celula];
+    jogo->ocupante[celula] = monstro;
+}
+
+//Tira o monstro da lista da celula em que ele esta (chamada antes de mudar a posicao dele)
+void desocupa_celula(JOGO *jogo, int monstro)
+{
+    int *elo = &jogo->ocupante[INDICE_CELULA(&jogo->mapa, jogo->monstros.x[monstro], jogo->monstros.y[monstro])];
+    while (*elo != monstro)
+        elo = &jogo->proximo_ocupante[*elo];
+    *elo = jogo->proximo_ocupante[monstro];
+}
+
+//Refaz a grade inteira a partir das posicoes dos monstros (mapa novo ou jogo carregado)
+void monta_ocupacao(JOGO *jogo)
+{
+    memset(jogo->ocupante, -1, (size_t)CELULAS_MAPA(&jogo->mapa) * sizeof(int));
+    for (int i = 0; i < jogo->num_monstros; i++)
+        ocupa_celula(jogo, i);
+}
+
+//Faz a posicao anterior de todos os personagens ser a atual, para o desenho nao interpolar um "teleporte"
+//(mapa ou jogo carregado, ou volta para o inicio depois de uma colisao)
+void fixa_posicoes_anteriores(JOGO *jogo)
+{
+    jogo->pacman.x_anterior = jogo->pacman.x;
+    jogo->pacman.y_anterior = jogo->pacman.y;
+    if (jogo->num_monstros == 0) return;
+    memcpy(jogo->monstros.x_anterior, jogo->monstros.x, (size_t)jogo->num_monstros * sizeof(int));
+    memcpy(jogo->monstros.y_anterior, jogo->monstros.y, (size_t)jogo->num_monstros * sizeof(int));
+}
+
+//CRC32 (o mesmo polinomio do zip/png) de um bloco de bytes. O savegame e pequeno, entao o calculo bit a bit, sem tabela, basta
+unsigned int crc32_bytes(const unsigned char *dados, size_t tamanho)
+{
+    unsigned int crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < tamanho; i++)
+    {
+        crc ^= dados[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+//Escrita e leitura de inteiros em little-endian, byte a byte: o arquivo tem o mesmo formato em qualquer maquina e nao depende do
+//alinhamento/padding das structs (que so mudam de tamanho quando o codigo muda, sem a versao mudar junto)
+void escreve_u32(unsigned char **p, unsigned int valor)
+{
+    for (int i = 0; i < 4; i++)
+        *(*p)++ = (unsigned char)(valor >> (8 * i));
+}
+
+void escreve_u64(unsigned char **p, unsigned long long valor)
+{
+    escreve_u32(p, (unsigned int)valor);
+    escreve_u32(p, (unsigned int)(valor >> 32));
+}
+
+void escreve_f32(unsigned char **p, float valor)
+{
+    unsigned int bits;
+    memcpy(&bits, &valor, sizeof(bits));
+    escreve_u32(p, bits);
+}
+
+unsigned int le_u32(const unsigned char **p)
+{
+    unsigned int valor = 0;
+    for (int i = 0; i < 4; i++)
+        valor |= (unsigned int)*(*p)++ << (8 * i);
+    return valor;
+}
+
+unsigned long long le_u64(const unsigned char **p)
+{
+    unsigned long long baixo = le_u32(p);
+    return baixo | (unsigned long long)le_u32(p) << 32;
+}
+
+float le_f32(const unsigned char **p)
+{
+    unsigned int bits = le_u32(p);
+    float valor;
+    memcpy(&valor, &bits, sizeof(valor));
+    return valor;
+}
+
+void escreve_posicao(unsigned char **p, int x, int y, int dx, int dy, int x_inicial, int y_inicial, int x_anterior, int y_anterior)
+{
+    int campos[8] = {x, y, dx, dy, x_inicial, y_inicial, x_anterior, y_anterior};
+    for (int i = 0; i < 8; i++)
+        escreve_u32(p, (unsigned int)campos[i]);
+}
+
+//Converte o estado da simulacao nos dados do savegame (TAMANHO_DADOS_SAVE bytes para o tamanho do mapa e os monstros). So fica de fora o que e
+//derivado (lista de coletaveis, tabela de rotas, campo de fluxo, arena do A*), que e remontado no carregamento.
+void serializa_jogo(const JOGO *jogo, unsigned char *dados)
+{
+    unsigned char *p = dados;
+    const STATUS_PLAYER *player = &jogo->player;
+    const POS_PACMAN *pacman = &jogo->pacman;
+
+    escreve_u32(&p, (unsigned int)player->vida);
+    escreve_u32(&p, (unsigned int)player->pontuacao);
+    escreve_u32(&p, (unsigned int)player->fase);
+    escreve_u32(&p, (unsigned int)player->pontuacao_alvo);
+    escreve_u32(&p, (unsigned int)player->dificuldade);
+    escreve_posicao(&p, pacman->x, pacman->y, pacman->dx, pacman->dy, pacman->x_inicial, pacman->y_inicial, pacman->x_anterior, pacman->y_anterior);
+    escreve_u32(&p, (unsigned int)jogo->num_monstros);
+    for (int i = 0; i < jogo->num_monstros; i++)
+    {
+        const MONSTROS *m = &jogo->monstros;
+        escreve_posicao(&p, m->x[i], m->y[i], m->dx[i], m->dy[i], m->x_inicial[i], m->y_inicial[i], m->x_anterior[i], m->y_anterior[i]);
+    }
+    escreve_f32(&p, jogo->vel_monstros);
+    escreve_f32(&p, jogo->timer_pacman);
+    escreve_f32(&p, jogo->timer_monstros);
+    escreve_u32(&p, (unsigned int)jogo->dificuldade_contador);
+    escreve_u32(&p, (unsigned int)jogo->estado);
+    escreve_u32(&p, (unsigned int)jogo->modo_ia);
+    escreve_u64(&p, (unsigned long long)jogo->ticks);
+    escreve_u64(&p, jogo->semente);
+    escreve_u64(&p, jogo->rng);
+    //os 4 bitboards estao em sequencia (paredes, pontos, power, frutas)
+    size_t palavras = tamanho_bitboards(jogo->mapa.largura, jogo->mapa.altura);
+    for (size_t i = 0; i < palavras; i++) escreve_u64(&p, jogo->mapa.paredes[i]);
+}
+
+void le_posicao(const unsigned char **p, int *x, int *y, int *dx, int *dy, int *x_inicial, int *y_inicial, int *x_anterior, int *y_anterior)
+{
+    int *campos[8] = {x, y, dx, dy, x_inicial, y_inicial, x_anterior, y_anterior};
+    for (int i = 0; i < 8; i++)
+        *campos[i] = (int)le_u32(p);
+}
+
+//Inverso de serializa_jogo. O jogo deve ter sido zerado com inicia_jogo e ter a memoria preparada para o tamanho do mapa salvo
+//e para os monstros antes (o numero de monstros lido dos dados tem que ser o do cabecalho)
+void desserializa_jogo(JOGO *jogo, const unsigned char *dados)
+{
+    const unsigned char *p = dados;
+    STATUS_PLAYER *player = &jogo->player;
+    POS_PACMAN *pacman = &jogo->pacman;
+
+    player->vida = (int)le_u32(&p);
+    player->pontuacao = (int)le_u32(&p);
+    player->fase = (int)le_u32(&p);
+    player->pontuacao_alvo = (int)le_u32(&p);
+    player->dificuldade = (int)le_u32(&p);
+    le_posicao(&p, &pacman->x, &pacman->y, &pacman->dx, &pacman->dy, &pacman->x_inicial, &pacman->y_inicial, &pacman->x_anterior, &pacman->y_anterior);
+    jogo->num_monstros = (int)le_u32(&p);
+    for (int i = 0; i < jogo->num_monstros && i < jogo->monstros.capacidade; i++) //num_monstros diferente do cabecalho e recusado depois
+    {
+        MONSTROS *m = &jogo->monstros;
+        le_posicao(&p, &m->x[i], &m->y[i], &m->dx[i], &m->dy[i], &m->x_inicial[i], &m->y_inicial[i], &m->x_anterior[i], &m->y_anterior[i]);
+    }
+    jogo->vel_monstros = le_f32(&p);
+    jogo->timer_pacman = le_f32(&p);
+    jogo->timer_monstros = le_f32(&p);
+    jogo->dificuldade_contador = (int)le_u32(&p);
+    jogo->estado = (int)le_u32(&p);
+    jogo->modo_ia = (int)le_u32(&p);
+    jogo->ticks = (long)le_u64(&p);
+    jogo->semente = le_u64(&p);
+    jogo->rng = le_u64(&p);
+    size_t palavras = tamanho_bitboards(jogo->mapa.largura, jogo->mapa.altura);
+    for (size_t i = 0; i < palavras; i++) jogo->mapa.paredes[i] = le_u64(&p);
+}
+
+//Troca o arquivo destino pelo temporario de uma vez so: quem abrir o savegame ve o antigo inteiro ou o novo inteiro, nunca um meio gravado
+int substitui_arquivo(const char *temporario, const char *destino)
+{
+#ifdef _WIN32
+    //no Windows o rename falha se o destino existe; MoveFileExA (declarada aqui porque windows.h conflita com a raylib) substitui
+    return MoveFileExA(temporario, destino, 0x1 /*MOVEFILE_REPLACE_EXISTING*/ | 0x8 /*MOVEFILE_WRITE_THROUGH*/) != 0;
+#else
+    return rename(temporario, destino) == 0;
+#endif
+}
+
+//Grava um savegame: cabecalho + dados binarios, primeiro em "<nome_arq>.tmp" e depois renomeado por cima do arquivo anterior.
+//Retorna 1 se gravou.
+int grava_savegame(const JOGO *jogo, const char *nome_arq)
+{
+    size_t tamanho_dados = TAMANHO_DADOS_SAVE(jogo->mapa.altura, jogo->mapa.palavras, jogo->num_monstros);
+    unsigned char *arquivo_save = (unsigned char *)malloc(TAMANHO_CABECALHO_SAVE + tamanho_dados);
+    unsigned char *p = arquivo_save;
+    char temporario[256];
+    FILE *file = NULL;
+
+    snprintf(temporario, sizeof(temporario), "%s.tmp", nome_arq);
+    if (arquivo_save == NULL || (file = fopen(temporario, "wb")) == NULL)
+    {
+        printf("Erro ao salvar jogo em %s\n", nome_arq);
+        free(arquivo_save);
+        return 0;
+    }
+    unsigned char *dados = arquivo_save + TAMANHO_CABECALHO_SAVE;
+    serializa_jogo(jogo, dados);
+    memcpy(p, "PMSV", 4);
+    p += 4;
+    escreve_u32(&p, VERSAO_SAVE);
+    escreve_u32(&p, (unsigned int)jogo->mapa.largura);
+    escreve_u32(&p, (unsigned int)jogo->mapa.altura);
+    escreve_u32(&p, (unsigned int)jogo->num_monstros);
+    escreve_u32(&p, (unsigned int)tamanho_dados);
+    escreve_u32(&p, crc32_bytes(dados, tamanho_dados));
+
+    int ok = fwrite(arquivo_save, TAMANHO_CABECALHO_SAVE + tamanho_dados, 1, file) == 1 && fflush(file) == 0;
+    free(arquivo_save);
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0; //garante que os dados estao no disco antes de trocar os arquivos
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+    if (!ok || !substitui_arquivo(temporario, nome_arq))
+    {
+        printf("Erro ao salvar jogo em %s\n", nome_arq);
+        remove(temporario);
+        return 0;
+    }
+    return 1;
+}
+
+//Le um savegame com uma unica leitura e confere assinatura, versao, dimensoes do mapa, tamanho, CRC32 e os valores antes de aceitar.
+//So preenche o estado salvo (ver SLOT_SAVE); o resto e remontado por prepara_jogo_carregado. Retorna 1 se leu;
+//se o arquivo nao existe ou esta corrompido retorna 0 e o jogo pode ter ficado pela metade.
+int le_savegame(JOGO *jogo, const char *nome_arq)
+{
+    unsigned char *arquivo_save = NULL;
+    const unsigned char *p;
+    struct stat info;
+    size_t tamanho = 0;
+    int largura = 0, altura = 0, monstros = 0;
+
+    FILE *file = fopen(nome_arq, "rb");
+    if (file == NULL) return 0;
+    //o tamanho depende do mapa: o arquivo inteiro vem em uma unica leitura para um bloco do tamanho dele
+    int ok = fstat(fileno(file), &info) == 0 && info.st_size >= TAMANHO_CABECALHO_SAVE;
+    if (ok)
+    {
+        tamanho = (size_t)info.st_size;
+        arquivo_save = (unsigned char *)malloc(tamanho);
+        ok = arquivo_save != NULL && fread(arquivo_save, 1, tamanho, file) == tamanho;
+    }
+    fclose(file);
+
+    p = arquivo_save;
+    ok = ok && memcmp(p, "PMSV", 4) == 0;
+    if (ok)
+    {
+        p += 4;
+        ok = le_u32(&p) == VERSAO_SAVE;
+        largura = (int)le_u32(&p);
+        altura = (int)le_u32(&p);
+        monstros = (int)le_u32(&p);
+        ok = ok && largura > 0 && altura > 0 && largura <= MAXIMO_LADO_MAPA && altura <= MAXIMO_LADO_MAPA
+             && monstros >= 0 && monstros <= largura * altura;
+        ok = ok && tamanho == TAMANHO_CABECALHO_SAVE + TAMANHO_DADOS_SAVE(altura, PALAVRAS_LINHA(largura), monstros);
+        ok = ok && le_u32(&p) == tamanho - TAMANHO_CABECALHO_SAVE;
+        unsigned int crc = le_u32(&p); //lido antes: a ordem dos dois lados do == nao e definida
+        ok = ok && crc == crc32_bytes(p, tamanho - TAMANHO_CABECALHO_SAVE);
+    }
+    if (ok)
+    {
+        inicia_jogo(jogo);
+        ok = prepara_memoria_jogo(jogo, largura, altura) && prepara_monstros(jogo, monstros);
+    }
+    if (ok)
+    {
+        desserializa_jogo(jogo, arquivo_save + TAMANHO_CABECALHO_SAVE);
+        ok = jogo->player.fase >= 1 && jogo->player.fase <= num_fases() && jogo->num_monstros == monstros
+             && jogo->modo_ia >= IA_A_ESTRELA && jogo->modo_ia <= IA_INCREMENTAL
+             && jogo->estado >= JOGO_EM_ANDAMENTO && jogo->estado <= JOGO_VENCIDO
+             && !eh_parede(&jogo->mapa, jogo->pacman.x, jogo->pacman.y)
+             && !eh_parede(&jogo->mapa, jogo->pacman.x_inicial, jogo->pacman.y_inicial);
+        //a grade de ocupacao e indexada pela posicao dos monstros, e trata_colisao leva todos de volta para o inicio
+        for (int i = 0; ok && i < monstros; i++)
+            ok = !eh_parede(&jogo->mapa, jogo->monstros.x[i], jogo->monstros.y[i])
+                 && !eh_parede(&jogo->mapa, jogo->monstros.x_inicial[i], jogo->monstros.y_inicial[i]);
+    }
+    free(arquivo_save);
+    if (!ok) printf("Erro ao carregar jogo: %s invalido ou de outra versao\n", nome_arq);
+    return ok;
+}
+
+//Remonta o que nao faz parte do estado salvo (lista de coletaveis, grade de ocupacao, tabela de rotas, grafo do HPA*, campo de fluxo)
+//depois de trocar o estado do jogo
+void prepara_jogo_carregado(JOGO *jogo)
+{
+    unsigned long long hash = hash_paredes(&jogo->mapa);
+    monta_lista_coletaveis(jogo);
+    monta_ocupacao(jogo);
+    const TABELA_ROTAS *rotas = rotas_do_mapa(jogo->player.fase);
+    jogo->tabela_rotas = rotas->pronta && rotas->largura == jogo->mapa.largura && rotas->celulas == CELULAS_MAPA(&jogo->mapa)
+                         && rotas->hash == hash ? rotas : NULL; //sem tabela os monstros usam o HPA*
+    const GRAFO_HPA *grafo = grafo_do_mapa(jogo->player.fase);
+    jogo->grafo_hpa = grafo->pronto && grafo->largura == jogo->mapa.largura && grafo->altura == jogo->mapa.altura
+                      && grafo->hash == hash ? grafo : NULL; //sem grafo, o A*
+    invalida_caminhos_hpa(jogo);
+    invalida_buscas_incrementais(jogo);
+    jogo->campo_fluxo.valido = 0;
+}
+
+//Guarda o estado do jogo no slot: um memcpy do comeco da struct JOGO e outro dos bitboards do mapa.
+//O vetor dos bitboards do slot so e realocado se o mapa for maior que o do ultimo save.
+void copia_para_slot(SLOT_SAVE *slot, const JOGO *jogo)
+{
+    size_t palavras = tamanho_bitboards(jogo->mapa.largura, jogo->mapa.altura);
+    size_t ints_monstros = (size_t)CAMPOS_MONSTRO * jogo->num_monstros;
+    int *vetores[CAMPOS_MONSTRO];
+    if (ints_monstros > slot->capacidade_monstros)
+    {
+        int *monstros = (int *)realloc(slot->monstros, ints_monstros * sizeof(int));
+        if (monstros == NULL)
+        {
+            printf("Erro: sem memoria para o slot de save\n");
+            slot->ocupado = 0;
+            return;
+        }
+        slot->monstros = monstros;
+        slot->capacidade_monstros = ints_monstros;
+    }
+    if (palavras > slot->capacidade)
+    {
+        LINHA_BITS *bitboards = (LINHA_BITS *)realloc(slot->bitboards, palavras * sizeof(LINHA_BITS));
+        if (bitboards == NULL)
+        {
+            printf("Erro: sem memoria para o slot de save\n");
+            slot->ocupado = 0;
+            return;
+        }
+        slot->bitboards = bitboards;
+        slot->capacidade = palavras;
+    }
+    memcpy(slot->estado, jogo, TAMANHO_ESTADO_JOGO);
+    memcpy(slot->bitboards, jogo->mapa.paredes, palavras * sizeof(LINHA_BITS));
+    vetores_monstros(&jogo->monstros, vetores);
+    for (int v = 0; v < CAMPOS_MONSTRO && jogo->num_monstros > 0; v++)
+        memcpy(slot->monstros + (size_t)v * jogo->num_monstros, vetores[v], (size_t)jogo->num_monstros * sizeof(int));
+    slot->num_monstros = jogo->num_monstros;
+    slot->largura = jogo->mapa.largura;
+    slot->altura = jogo->mapa.altura;
+    slot->ocupado = 1;
+}
+
+//Copia o estado salvo no slot (estado, bitboards e monstros) para o jogo, sem remontar o resto. Retorna 0 se o slot esta vazio
+int copia_do_slot(JOGO *jogo, const SLOT_SAVE *slot)
+{
+    int *vetores[CAMPOS_MONSTRO];
+    if (!slot->ocupado || !prepara_memoria_jogo(jogo, slot->largura, slot->altura) || !prepara_monstros(jogo, slot->num_monstros)) return 0;
+    memcpy(jogo, slot->estado, TAMANHO_ESTADO_JOGO);
+    memcpy(jogo->mapa.paredes, slot->bitboards, tamanho_bitboards(slot->largura, slot->altura) * sizeof(LINHA_BITS));
+    vetores_monstros(&jogo->monstros, vetores);
+    for (int v = 0; v < CAMPOS_MONSTRO && slot->num_monstros > 0; v++)
+        memcpy(vetores[v], slot->monstros + (size_t)v * slot->num_monstros, (size_t)slot->num_monstros * sizeof(int));
+    return 1;
+}
+
+//Volta o jogo para o estado guardado no slot, sem ler nenhum arquivo. Retorna 0 se o slot esta vazio
+int restaura_slot(JOGO *jogo, const SLOT_SAVE *slot)
+{
+    if (!copia_do_slot(jogo, slot)) return 0;
+    prepara_jogo_carregado(jogo);
+    return 1;
+}
+
+void libera_slot(SLOT_SAVE *slot)
+{
+    free(slot->bitboards);
+    free(slot->monstros);
+    memset(slot, 0, sizeof(*slot));
+}
+
+//Bytes de um mapa compilado junto com os vetores que vem depois do registro (ver MAPA_COMPILADO). Sempre multiplo de 8,
+//entao o registro seguinte no arquivo tambem fica alinhado
+size_t tamanho_mapa_compilado(int largura, int altura, int num_monstros, int tem_rotas)
+{
+    size_t celulas = (size_t)largura * altura;
+    size_t tamanho = sizeof(MAPA_COMPILADO) + tamanho_bitboards(largura, altura) * sizeof(LINHA_BITS);
+    tamanho += (2 * (size_t)num_monstros * sizeof(int) + 7) & ~(size_t)7;
+    if (tem_rotas)
+        tamanho += ((celulas * sizeof(unsigned short) + 7) & ~(size_t)7) + ((((celulas * celulas + 3) / 4) + 7) & ~(size_t)7);
+    return tamanho;
+}
+
+//Visao dos bitboards gravados logo depois do registro compilado
+BITBOARDS_MAPA bitboards_compilados(const MAPA_COMPILADO *compilado)
+{
+    BITBOARDS_MAPA mapa;
+    aponta_bitboards(&mapa, (LINHA_BITS *)(compilado + 1), compilado->largura, compilado->altura);
+    return mapa;
+}
+
+//Posicoes iniciais dos monstros gravadas depois dos bitboards do registro compilado: num_monstros x e, em seguida, num_monstros y
+const int *posicoes_monstros_compiladas(const MAPA_COMPILADO *compilado)
+{
+    return (const int *)((const LINHA_BITS *)(compilado + 1) + tamanho_bitboards(compilado->largura, compilado->altura));
+}
+
+//Aponta a tabela de rotas para os vetores gravados depois das posicoes dos monstros do registro compilado
+void aponta_rotas_compiladas(TABELA_ROTAS *tabela, const MAPA_COMPILADO *compilado)
+{
+    size_t celulas = (size_t)compilado->largura * compilado->altura;
+    unsigned char *vetores = (unsigned char *)posicoes_monstros_compiladas(compilado) + ((2 * (size_t)compilado->num_monstros * sizeof(int) + 7) & ~(size_t)7);
+    memset(tabela, 0, sizeof(*tabela));
+    if (!compilado->tem_rotas) return;
+    tabela->componente = (unsigned short *)vetores;
+    tabela->direcoes = vetores + ((celulas * sizeof(unsigned short) + 7) & ~(size_t)7);
+    tabela->celulas = (int)celulas;
+    tabela->largura = compilado->largura;
+    tabela->hash = compilado->hash_paredes;
+    tabela->pronta = 1;
+}
+
+//Compila um mapa ja lido para uma matriz de char (altura linhas de largura caracteres): posicoes iniciais, bitboards, pontos da fase e,
+//nos mapas pequenos, a tabela de rotas. A matriz perde os 'J' e 'M', que viram espaco. Retorna o registro em um bloco do malloc
+//(registro e vetores juntos, como vao para o arquivo) ou NULL se o mapa nao tem exatamente um Pac-Man ou faltou memoria.
+MAPA_COMPILADO *compila_matriz(char *matriz_mapa, int largura, int altura, const char *nome_mapa)
+{
+    int tem_rotas = (long long)largura * altura <= MAXIMO_CELULAS_ROTAS;
+    int num_monstros = 0, num_pacman = 0;
+    for (size_t c = 0; c < (size_t)largura * altura; c++) //o tamanho do registro depende de quantos monstros o mapa tem
+    {
+        num_monstros += matriz_mapa[c] == 'M';
+        num_pacman += matriz_mapa[c] == 'J';
+    }
+    if (num_pacman != 1) //sem 'J' o Pac-Man comecaria em (0, 0), dentro da parede
+    {
+        printf("%s: o mapa precisa ter exatamente um Pac-Man ('J'), tem %d\n", nome_mapa, num_pacman);
+        return NULL;
+    }
+    size_t tamanho = tamanho_mapa_compilado(largura, altura, num_monstros, tem_rotas);
+    MAPA_COMPILADO *compilado = (MAPA_COMPILADO *)calloc(1, tamanho);
+    if (compilado == NULL)
+    {
+        printf("%s: sem memoria para compilar o mapa\n", nome_mapa);
+        return NULL;
+    }
+    snprintf(compilado->nome, sizeof(compilado->nome), "%s", nome_mapa);
+    compilado->largura = largura;
+    compilado->altura = altura;
+    compilado->palavras = PALAVRAS_LINHA(largura);
+    compilado->tem_rotas = tem_rotas;
+    compilado->tamanho_total = tamanho;
+    int *monstros_x = (int *)posicoes_monstros_compiladas(compilado), *monstros_y = monstros_x + num_monstros;
+
+    for (int i = 0; i < altura; i++)
+    {
+        for (int j = 0; j < largura; j++)
+        {
+            char *celula = &matriz_mapa[(size_t)i * largura + j];
+            switch (*celula)
+            {
+            case 'J':
+                compilado->pacman_x = j;
+                compilado->pacman_y = i;
+                *celula = ' ';
+                break;
+            case 'M':
+                monstros_x[compilado->num_monstros] = j;
+                monstros_y[compilado->num_monstros] = i;
+                compilado->num_monstros++;
+                *celula = ' ';
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    BITBOARDS_MAPA mapa = bitboards_compilados(compilado);
+    monta_bitboards(&mapa, matriz_mapa);
+    compilado->pontos_fase = 10 * conta_bitboard(&mapa, mapa.pontos) + 20 * conta_bitboard(&mapa, mapa.power) + 30 * conta_bitboard(&mapa, mapa.frutas);
+    compilado->hash_paredes = hash_paredes(&mapa);
+    if (tem_rotas)
+    {
+        TABELA_ROTAS rotas;
+        aponta_rotas_compiladas(&rotas, compilado);
+        if (!calcula_tabela_rotas(&rotas, &mapa))
+        {
+            printf("%s: sem memoria para a tabela de rotas\n", nome_mapa);
+            free(compilado);
+            return NULL;
+        }
+    }
+    return compilado;
+}
+
+//Le uma linha do arquivo de mapa guardando ate "maximo" caracteres; o resto da linha e descartado. Guarda so ate o '\r' dos mapas
+//gravados no Windows, para ele nao desalinhar as colunas quando o jogo e compilado em outros sistemas.
+//Retorna quantos caracteres guardou, ou -1 se o arquivo ja tinha acabado.
+int le_linha_mapa(FILE *arquivo, char *linha, int maximo)
+{
+    int c, n = 0, fim_linha = 0;
+    while ((c = getc(arquivo)) != EOF && c != '\n')
+    {
+        if (c == '\r') fim_linha = 1;
+        if (!fim_linha && n < maximo) linha[n++] = (char)c;
+    }
+    return (c == EOF && n == 0) ? -1 : n;
+}
+
+//Calcula o hash (FNV-1a de 64 bits) dos bytes de um arquivo. Retorna 0 se nao conseguiu ler o arquivo inteiro
+int hash_arquivo(const char *nome_arq, unsigned long long *hash)
+{
+    unsigned char bloco[4096];
+    size_t lidos;
+    FILE *arquivo = fopen(nome_arq, "rb");
+    if (arquivo == NULL) return 0;
+    *hash = 14695981039346656037ULL;
+    while ((lidos = fread(bloco, 1, sizeof(bloco), arquivo)) > 0)
+    {
+        for (size_t i = 0; i < lidos; i++)
+        {
+            *hash ^= bloco[i];
+            *hash *= 1099511628211ULL;
+        }
+    }
+    int ok = !ferror(arquivo);
+    fclose(arquivo);
+    return ok;
+}
+
+//Compilador de mapas: le um arquivo de mapa .txt e monta o registro pronto para o jogo (ver compila_matriz).
+//O arquivo pode comecar com a linha "#mapa <largura> <altura>"; sem ela o mapa tem COLUNAS_MAPA_PADRAO x LINHAS_MAPA_PADRAO.
+//Linhas curtas sao completadas com espacos e o que passar da largura e ignorado.
+//Roda uma vez, fora do jogo (pacman_headless --compila-mapas) ou quando o arquivo de mapas compilados nao bate com os .txt.
+//Retorna o registro (do malloc) ou NULL se nao conseguiu ler o mapa.
+MAPA_COMPILADO *compila_mapa(const char *nome_mapa)
+{
+    FILE *arquivo;
+    struct stat info;
+    int largura = COLUNAS_MAPA_PADRAO, altura = LINHAS_MAPA_PADRAO;
+    int guardados, primeira_linha_do_mapa = 1;
+    unsigned long long hash_fonte = 0;
+
+    //o hash e calculado antes de ler o mapa: se o .txt mudar no meio, o hash guardado e o antigo e o mapa e compilado de novo na proxima vez
+    arquivo = hash_arquivo(nome_mapa, &hash_fonte) ? fopen(nome_mapa, "r") : NULL;
+    if (arquivo == NULL || fstat(fileno(arquivo), &info) != 0)
+    {
+        printf("Erro ao abrir mapa %s\n", nome_mapa);
+        if (arquivo) fclose(arquivo);
+        return NULL;
+    }
+    char *linha = (char *)malloc(MAXIMO_LADO_MAPA + 1);
+    if (linha == NULL)
+    {
+        fclose(arquivo);
+        return NULL;
+    }
+    guardados = le_linha_mapa(arquivo, linha, MAXIMO_LADO_MAPA);
+    linha[guardados > 0 ? guardados : 0] = '\0';
+    if (strncmp(linha, "#mapa", 5) == 0)
+    {
+        if (sscanf(linha + 5, "%d %d", &largura, &altura) != 2 || largura < 3 || altura < 3 || largura > MAXIMO_LADO_MAPA
+            || altura > MAXIMO_LADO_MAPA || (long long)largura * altura > MAXIMO_CELULAS_MAPA)
+        {
+            printf("%s: cabecalho invalido (esperado \"#mapa <largura> <altura>\", no maximo %dx%d)\n", nome_mapa, MAXIMO_LADO_MAPA, MAXIMO_LADO_MAPA);
+            free(linha);
+            fclose(arquivo);
+            return NULL;
+        }
+        primeira_linha_do_mapa = 0;
+    }
+
+    char *matriz_mapa = (char *)malloc((size_t)largura * altura); //mapa como esta no arquivo, antes de virar bitboards
+    if (matriz_mapa == NULL)
+    {
+        printf("%s: sem memoria para um mapa de %dx%d\n", nome_mapa, largura, altura);
+        free(linha);
+        fclose(arquivo);
+        return NULL;
+    }
+    memset(matriz_mapa, ' ', (size_t)largura * altura);
+    for (int i = 0; i < altura; i++)
+    {
+        if (i > 0 || !primeira_linha_do_mapa)
+            guardados = le_linha_mapa(arquivo, linha, largura);
+        if (guardados > 0)
+            memcpy(&matriz_mapa[(size_t)i * largura], linha, guardados < largura ? guardados : largura);
+    }
+    free(linha);
+    fclose(arquivo);
+
+    MAPA_COMPILADO *compilado = compila_matriz(matriz_mapa, largura, altura, nome_mapa);
+    free(matriz_mapa);
+    if (compilado != NULL)
+    {
+        compilado->tamanho_fonte = (long long)info.st_size;
+        compilado->hash_fonte = hash_fonte;
+    }
+    return compilado;
+}
+
+//Compila todos os mapas do jogo e grava o arquivo de mapas compilados (temporario + rename, como o savegame). Retorna 1 se gravou.
+int compila_mapas(const char *nome_arq)
+{
+    MAPA_COMPILADO *compilados[NUM_MAPAS] = {NULL};
+    CABECALHO_MAPAS cabecalho;
+    char temporario[256];
+    int ok = 1;
+
+    memset(&cabecalho, 0, sizeof(cabecalho));
+    memcpy(cabecalho.assinatura, "PMMC", 4);
+    cabecalho.versao = VERSAO_MAPAS_COMPILADOS;
+    cabecalho.num_mapas = NUM_MAPAS;
+    cabecalho.tamanho_registro = sizeof(MAPA_COMPILADO);
+    unsigned long long deslocamento = sizeof(cabecalho);
+    for (int i = 0; i < NUM_MAPAS && ok; i++)
+    {
+        compilados[i] = compila_mapa(mapas[i]);
+        ok = compilados[i] != NULL;
+        if (!ok) break;
+        cabecalho.deslocamento[i] = deslocamento;
+        deslocamento += compilados[i]->tamanho_total;
+        printf("%s: %dx%d, %d monstros, %d pontos%s\n", mapas[i], compilados[i]->largura, compilados[i]->altura, compilados[i]->num_monstros,
+               compilados[i]->pontos_fase, compilados[i]->tem_rotas ? "" : ", sem tabela de rotas (mapa grande)");
+    }
+
+    FILE *arquivo = NULL;
+    if (ok)
+    {
+        snprintf(temporario, sizeof(temporario), "%s.tmp", nome_arq);
+        arquivo = fopen(temporario, "wb");
+        ok = arquivo != NULL && fwrite(&cabecalho, sizeof(cabecalho), 1, arquivo) == 1;
+        for (int i = 0; i < NUM_MAPAS && ok; i++)
+            ok = fwrite(compilados[i], compilados[i]->tamanho_total, 1, arquivo) == 1;
+        if (arquivo != NULL) ok = fclose(arquivo) == 0 && ok;
+    }
+    for (int i = 0; i < NUM_MAPAS; i++)
+        free(compilados[i]);
+    if (!ok || !substitui_arquivo(temporario, nome_arq))
+    {
+        printf("Erro ao gravar %s\n", nome_arq);
+        if (arquivo != NULL) remove(temporario);
+        return 0;
+    }
+    return 1;
+}
+
+//Mapas do jogo abertos durante todo o programa: o arquivo de mapas compilados na memoria (mmap) ou um mapa avulso (--mapa),
+//compilado na hora e jogado como fase unica
+typedef struct arquivo_mapas
+{
+    const unsigned char *dados; //cabecalho seguido dos NUM_MAPAS registros compilados
+    size_t tamanho;
+    int mapeado; //1 = mmap, 0 = lido para um bloco do malloc
+    MAPA_COMPILADO *avulso; //mapa escolhido na linha de comando (do malloc)
+    const MAPA_COMPILADO *registros[NUM_MAPAS]; //registro de cada fase
+    TABELA_ROTAS rotas[NUM_MAPAS]; //tabela de rotas de cada fase (aponta para dentro do registro)
+    GRAFO_HPA grafos[NUM_MAPAS]; //grafo do HPA* de cada fase, montado quando os mapas sao abertos
+    int num_fases;
+} ARQUIVO_MAPAS;
+
+ARQUIVO_MAPAS arquivo_mapas;
+
+void fecha_mapas_compilados(void)
+{
+    if (arquivo_mapas.dados != NULL)
+    {
+#ifndef _WIN32
+        if (arquivo_mapas.mapeado)
+            munmap((void *)arquivo_mapas.dados, arquivo_mapas.tamanho);
+        else
+#endif
+            free((void *)arquivo_mapas.dados);
+    }
+    free(arquivo_mapas.avulso);
+    for (int i = 0; i < NUM_MAPAS; i++)
+        libera_grafo_hpa(&arquivo_mapas.grafos[i]);
+    memset(&arquivo_mapas, 0, sizeof(arquivo_mapas));
+}
+
+//Coloca o arquivo inteiro na memoria: mmap (as paginas so sao lidas do disco quando usadas e sao compartilhadas entre processos)
+//ou, no Windows, uma unica leitura para um bloco do malloc. Retorna 1 se conseguiu.
+int mapeia_arquivo_mapas(const char *nome_arq)
+{
+    FILE *arquivo = fopen(nome_arq, "rb");
+    struct stat info;
+    if (arquivo == NULL) return 0;
+    if (fstat(fileno(arquivo), &info) != 0 || info.st_size <= 0)
+    {
+        fclose(arquivo);
+        return 0;
+    }
+    arquivo_mapas.tamanho = (size_t)info.st_size;
+    arquivo_mapas.mapeado = 0;
+#ifndef _WIN32
+    void *dados = mmap(NULL, arquivo_mapas.tamanho, PROT_READ, MAP_PRIVATE, fileno(arquivo), 0);
+    if (dados != MAP_FAILED)
+    {
+        arquivo_mapas.dados = (const unsigned char *)dados;
+        arquivo_mapas.mapeado = 1;
+    }
+    else
+#endif
+    {
+        unsigned char *bloco = (unsigned char *)malloc(arquivo_mapas.tamanho);
+        if (bloco != NULL && fread(bloco, 1, arquivo_mapas.tamanho, arquivo) == arquivo_mapas.tamanho)
+            arquivo_mapas.dados = bloco;
+        else
+            free(bloco);
+    }
+    fclose(arquivo);
+    return arquivo_mapas.dados != NULL;
+}
+
+//Confere que o Pac-Man e todos os monstros de um registro compilado comecam em celulas livres dentro do mapa: carrega_mapa copia essas
+//posicoes para o jogo sem olhar, e a grade de ocupacao e indexada por elas
+int posicoes_compiladas_validas(const MAPA_COMPILADO *compilado)
+{
+    BITBOARDS_MAPA paredes = bitboards_compilados(compilado);
+    const int *monstros_x = posicoes_monstros_compiladas(compilado), *monstros_y = monstros_x + compilado->num_monstros;
+    if (eh_parede(&paredes, compilado->pacman_x, compilado->pacman_y)) return 0;
+    for (int i = 0; i < compilado->num_monstros; i++)
+        if (eh_parede(&paredes, monstros_x[i], monstros_y[i])) return 0;
+    return 1;
+}
+
+//Confere se o arquivo aberto e desta versao do jogo, se cada registro cabe no arquivo e se cada mapa foi compilado do .txt que esta
+//na pasta (mesmo tamanho e mesmo hash dos bytes; se o .txt nao existir vale o que foi compilado). Se estiver tudo certo aponta as fases para os registros.
+int mapas_compilados_validos(void)
+{
+    const CABECALHO_MAPAS *cabecalho = (const CABECALHO_MAPAS *)arquivo_mapas.dados;
+    if (arquivo_mapas.tamanho < sizeof(CABECALHO_MAPAS)
+        || memcmp(cabecalho->assinatura, "PMMC", 4) != 0 || cabecalho->versao != VERSAO_MAPAS_COMPILADOS
+        || cabecalho->num_mapas != NUM_MAPAS || cabecalho->tamanho_registro != (int)sizeof(MAPA_COMPILADO))
+        return 0;
+
+    for (int i = 0; i < NUM_MAPAS; i++)
+    {
+        unsigned long long deslocamento = cabecalho->deslocamento[i];
+        if (deslocamento % 8 != 0 || deslocamento + sizeof(MAPA_COMPILADO) > arquivo_mapas.tamanho) return 0;
+        const MAPA_COMPILADO *compilado = (const MAPA_COMPILADO *)(arquivo_mapas.dados + deslocamento);
+        if (compilado->largura < 1 || compilado->altura < 1 || compilado->largura > MAXIMO_LADO_MAPA || compilado->altura > MAXIMO_LADO_MAPA
+            || compilado->num_monstros < 0 || compilado->num_monstros > compilado->largura * compilado->altura
+            || compilado->tamanho_total != tamanho_mapa_compilado(compilado->largura, compilado->altura, compilado->num_monstros, compilado->tem_rotas)
+            || deslocamento + compilado->tamanho_total > arquivo_mapas.tamanho || !posicoes_compiladas_validas(compilado))
+            return 0;
+
+        struct stat info;
+        unsigned long long hash_fonte;
+        if (strcmp(compilado->nome, mapas[i]) != 0) return 0;
+        //a data nao serve: um .txt editado no mesmo segundo ou copiado com a data antiga passaria
+        if (stat(mapas[i], &info) == 0
+            && ((long long)info.st_size != compilado->tamanho_fonte || !hash_arquivo(mapas[i], &hash_fonte) || hash_fonte != compilado->hash_fonte))
+            return 0;
+        arquivo_mapas.registros[i] = compilado;
+        aponta_rotas_compiladas(&arquivo_mapas.rotas[i], compilado);
+    }
+    for (int i = 0; i < NUM_MAPAS; i++)
+    {
+        BITBOARDS_MAPA paredes = bitboards_compilados(arquivo_mapas.registros[i]);
+        monta_grafo_hpa(&arquivo_mapas.grafos[i], &paredes); //sem memoria para o grafo os monstros usam o A*
+    }
+    arquivo_mapas.num_fases = NUM_MAPAS;
+    return 1;
+}
+
+//Abre os mapas compilados uma vez no inicio do programa, compilando de novo se o arquivo faltar ou estiver desatualizado.
+//Depois disso trocar de fase nao le nenhum arquivo. Retorna 1 se os mapas estao prontos.
+int abre_mapas_compilados(void)
+{
+    if (arquivo_mapas.num_fases > 0) return 1;
+    if (mapeia_arquivo_mapas(ARQUIVO_MAPAS_COMPILADOS) && mapas_compilados_validos()) return 1;
+
+    fecha_mapas_compilados();
+    printf("Compilando os mapas em %s...\n", ARQUIVO_MAPAS_COMPILADOS);
+    if (compila_mapas(ARQUIVO_MAPAS_COMPILADOS) && mapeia_arquivo_mapas(ARQUIVO_MAPAS_COMPILADOS) && mapas_compilados_validos()) return 1;
+
+    fecha_mapas_compilados();
+    printf("Erro ao abrir os mapas compilados\n");
+    return 0;
+}
+
+//Troca os mapas do jogo por um unico mapa avulso ja compilado (do malloc, passa a ser dos mapas do jogo). O jogo passa a ter uma fase so.
+void usa_mapa_avulso(MAPA_COMPILADO *compilado)
+{
+    fecha_mapas_compilados();
+    arquivo_mapas.avulso = compilado;
+    arquivo_mapas.registros[0] = compilado;
+    aponta_rotas_compiladas(&arquivo_mapas.rotas[0], compilado);
+    BITBOARDS_MAPA paredes = bitboards_compilados(compilado);
+    monta_grafo_hpa(&arquivo_mapas.grafos[0], &paredes);
+    arquivo_mapas.num_fases = 1;
+}
+
+//Joga so o mapa do .txt, compilado agora (pode ter qualquer tamanho, ver compila_mapa). Retorna 1 se o mapa foi lido.
+int abre_mapa_avulso(const char *nome_mapa)
+{
+    MAPA_COMPILADO *compilado = compila_mapa(nome_mapa);
+    if (compilado == NULL) return 0;
+    usa_mapa_avulso(compilado);
+    printf("%s: %dx%d, %d monstros, %d pontos%s\n", nome_mapa, compilado->largura, compilado->altura, compilado->num_monstros,
+           compilado->pontos_fase, compilado->tem_rotas ? "" : " (sem tabela de rotas: os monstros usam o HPA*)");
+    return 1;
+}
+
+//Quantidade de fases do jogo: NUM_MAPAS, ou 1 com um mapa avulso
+int num_fases(void)
+{
+    if (!abre_mapas_compilados())
+        exit(1); //sem mapas nao ha jogo
+    return arquivo_mapas.num_fases;
+}
+
+//Registro compilado do mapa de uma fase (1 a num_fases()). Se os mapas ainda nao foram abertos, abre agora
+const MAPA_COMPILADO *mapa_compilado(int fase)
+{
+    if (!abre_mapas_compilados())
+        exit(1); //sem mapas nao ha jogo
+    return arquivo_mapas.registros[fase - 1];
+}
+
+//Tabela de rotas do mapa de uma fase (pronta = 0 se o mapa e grande demais para ter uma)
+const TABELA_ROTAS *rotas_do_mapa(int fase)
+{
+    mapa_compilado(fase);
+    return &arquivo_mapas.rotas[fase - 1];
+}
+
+//Grafo do HPA* do mapa de uma fase (pronto = 0 se faltou memoria para monta-lo)
+const GRAFO_HPA *grafo_do_mapa(int fase)
+{
+    mapa_compilado(fase);
+    return &arquivo_mapas.grafos[fase - 1];
+}
+
+//Coloca o mapa da fase no jogo: so copias a partir do registro compilado, que ja esta na memoria
+void carrega_mapa(JOGO *jogo, int fase)
+{
+    const MAPA_COMPILADO *compilado = mapa_compilado(fase);
+    STATUS_PLAYER *player = &jogo->player;
+    POS_PACMAN *pacman = &jogo->pacman;
+    MONSTROS *monstros = &jogo->monstros;
+    const int *monstros_x = posicoes_monstros_compiladas(compilado), *monstros_y = monstros_x + compilado->num_monstros;
+
+    if (fase == 1) // se for o primeiro mapa a pontuacao alvo  iniciada em zero
+    {
+        player->pontuacao_alvo = 0;
+    }
+    player->pontuacao_alvo += compilado->pontos_fase;
+
+    if (!prepara_memoria_jogo(jogo, compilado->largura, compilado->altura) || !prepara_monstros(jogo, compilado->num_monstros))
+        exit(1);
+    memcpy(jogo->mapa.paredes, compilado + 1, tamanho_bitboards(compilado->largura, compilado->altura) * sizeof(LINHA_BITS));
+    pacman->x = pacman->x_inicial = compilado->pacman_x;
+    pacman->y = pacman->y_inicial = compilado->pacman_y;
+    pacman->dx = 0;
+    pacman->dy = 0;
+    jogo->num_monstros = compilado->num_monstros;
+    for (int i = 0; i < jogo->num_monstros; i++)
+    {
+        monstros->x[i] = monstros->x_inicial[i] = monstros_x[i];
+        monstros->y[i] = monstros->y_inicial[i] = monstros_y[i];
+        monstros->dx[i] = 1;
+        monstros->dy[i] = 0;
+    }
+    fixa_posicoes_anteriores(jogo);
+    monta_lista_coletaveis(jogo);
+    monta_ocupacao(jogo);
+
+    //a tabela de rotas fica no arquivo compilado, so para leitura: varios jogos podem usar o mesmo mapa ao mesmo tempo
+    jogo->tabela_rotas = compilado->tem_rotas ? rotas_do_mapa(fase) : NULL;
+    jogo->grafo_hpa = grafo_do_mapa(fase)->pronto ? grafo_do_mapa(fase) : NULL;
+    invalida_caminhos_hpa(jogo);
+    invalida_buscas_incrementais(jogo);
+    jogo->campo_fluxo.valido = 0; //o campo de fluxo do mapa anterior nao vale mais
+}
+
+#ifndef PACMAN_HEADLESS
+//Sprites do atlas: circulos brancos de TAM_PIXEL x TAM_PIXEL lado a lado; a cor de cada item vem da cor do vertice
+#define SPRITE_GRANDE 0 //raio TAM_PIXEL/2 (power pellet, fruta, Pac-Man e monstros)
+#define SPRITE_PEQUENO 1 //raio TAM_PIXEL/4 (ponto)
+#define NUM_SPRITES 2
+#define VERTICES_CIRCULO 72 //um DrawCircle da raylib sao 36 segmentos enviados como 18 quads
+
+//Recursos da GPU usados por desenha_mapa. Pertencem a janela do jogo: sao criados depois de InitWindow e liberados antes de CloseWindow.
+#define MAXIMO_PIXELS_CAMADA 4096 //maior lado da camada de paredes; em mapas maiores as paredes visiveis sao desenhadas a cada quadro
+typedef struct recursos_graficos
+{
+    //as paredes nao mudam durante uma fase, entao sao desenhadas uma unica vez nesta textura (do tamanho do mapa)
+    //e copiadas para a tela com uma so chamada por quadro, em vez de um DrawRectangle por parede
+    RenderTexture2D camada_paredes;
+    int largura_camada, altura_camada; //em celulas; 0 = sem camada
+    unsigned int *parede_desenhada; //celulas que estao pintadas como parede na camada (um bit por celula do mapa)
+    unsigned int versao_mapa; //versao_mapa do retrato desenhado na camada (0 = nenhum)
+    long paredes_alteradas; //paredes_alteradas do retrato desenhado na camada
+    Texture2D atlas; //circulos pre-desenhados no tamanho TAM_PIXEL (ver SPRITE_*)
+    int carregados;
+} RECURSOS_GRAFICOS;
+
+//Contadores do quadro mostrados no painel de desempenho (F3). F2 troca entre o lote de sprites e um DrawCircle por item, para comparar.
+typedef struct estatisticas_desenho
+{
+    int chamadas; //chamadas de desenho feitas pelo jogo no quadro (o lote de sprites conta como uma)
+    int vertices; //vertices enviados no quadro
+    int lote; //1 = sprites em um unico lote rlgl, 0 = um DrawCircle por item
+    int painel_visivel;
+} ESTATISTICAS_DESENHO;
+
+//Camera do jogo: o pedaco do mapa (em pixels) que aparece na janela. Mapas que cabem na janela ficam parados no canto como sempre;
+//nos maiores a camera segue o Pac-Man sem sair do mapa, e so as celulas dentro dela sao desenhadas.
+typedef struct camera_mapa
+{
+    int x, y; //canto de cima da janela no mapa, em pixels
+    int coluna_inicial, linha_inicial; //celulas visiveis: [inicial, final)
+    int coluna_final, linha_final;
+} CAMERA_MAPA;
+
+RECURSOS_GRAFICOS recursos;
+ESTATISTICAS_DESENHO desenho = {0, 0, 1, 0};
+
+//Cria o atlas de sprites na janela atual (a camada de paredes e criada no tamanho do primeiro mapa desenhado)
+void carrega_recursos_graficos(void)
+{
+    Image imagem = GenImageColor(NUM_SPRITES * TAM_PIXEL, TAM_PIXEL, BLANK);
+    ImageDrawCircle(&imagem, SPRITE_GRANDE * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, TAM_PIXEL / 2, WHITE);
+    ImageDrawCircle(&imagem, SPRITE_PEQUENO * TAM_PIXEL + TAM_PIXEL / 2, TAM_PIXEL / 2, TAM_PIXEL / 4, WHITE);
+    recursos.atlas = LoadTextureFromImage(imagem);
+    UnloadImage(imagem);
+    recursos.carregados = 1;
+}
+
+//Descarta a camada de paredes (mapa de outro tamanho ou janela fechando)
+void libera_camada_paredes(void)
+{
+    if (recursos.largura_camada > 0)
+        UnloadRenderTexture(recursos.camada_paredes);
+    free(recursos.parede_desenhada);
+    recursos.parede_desenhada = NULL;
+    recursos.largura_camada = recursos.altura_camada = 0;
+    recursos.versao_mapa = 0;
+}
+
+//Libera os recursos da janela (antes de fechar a janela, que leva junto o contexto OpenGL)
+void libera_recursos_graficos(void)
+{
+    if (recursos.carregados)
+    {
+        UnloadTexture(recursos.atlas);
+        libera_camada_paredes();
+    }
+    recursos.carregados = 0;
+}
+
+//Diz se as paredes do mapa cabem em uma camada (textura do tamanho do mapa)
+int usa_camada_paredes(const BITBOARDS_MAPA *mapa)
+{
+    return mapa->largura * TAM_PIXEL <= MAXIMO_PIXELS_CAMADA && mapa->altura * TAM_PIXEL <= MAXIMO_PIXELS_CAMADA;
+}
+
+//Redesenha todas as paredes do mapa atual na camada (mapa novo ou janela nova), criando a camada de novo se o mapa mudou de tamanho
+void redesenha_camada_paredes(const BITBOARDS_MAPA *mapa)
+{
+    if (recursos.largura_camada != mapa->largura || recursos.altura_camada != mapa->altura)
+    {
+        libera_camada_paredes();
+        if (!usa_camada_paredes(mapa)) return;
+        recursos.camada_paredes = LoadRenderTexture(mapa->largura * TAM_PIXEL, mapa->altura * TAM_PIXEL);
+        recursos.parede_desenhada = (unsigned int *)malloc(PALAVRAS_BITS((size_t)CELULAS_MAPA(mapa)) * sizeof(unsigned int));
+        recursos.largura_camada = mapa->largura;
+        recursos.altura_camada = mapa->altura;
+    }
+    memset(recursos.parede_desenhada, 0, PALAVRAS_BITS((size_t)CELULAS_MAPA(mapa)) * sizeof(unsigned int));
+    BeginTextureMode(recursos.camada_paredes);
+    ClearBackground(BLANK);
+    for (int i = 0; i < mapa->altura; i++)
+    {
+        for (int j = 0; j < mapa->largura; j++)
+        {
+            if (testa_celula(mapa, mapa->paredes, j, i))
+            {
+                DrawRectangle(j * TAM_PIXEL, i * TAM_PIXEL, TAM_PIXEL, TAM_PIXEL, BLUE);
+                liga_bit(recursos.parede_desenhada, INDICE_CELULA(mapa, j, i));
+            }
+        }
+    }
+    EndTextureMode();
+}
+
+//Deixa a camada de paredes em dia com o mapa do retrato: refaz tudo quando o mapa e outro e, quando so algumas paredes mudaram
+//(o que quase nunca acontece), pinta as celulas em que o mapa e a camada discordam. Tem que ser chamada fora de BeginDrawing/EndDrawing
+void atualiza_camada_paredes(const RETRATO_JOGO *retrato)
+{
+    const BITBOARDS_MAPA *mapa = &retrato->mapa;
+    int desenhando = 0;
+    if (recursos.versao_mapa != retrato->versao_mapa)
+    {
+        redesenha_camada_paredes(mapa);
+        recursos.versao_mapa = retrato->versao_mapa;
+        recursos.paredes_alteradas = retrato->paredes_alteradas;
+        return;
+    }
+    if (recursos.paredes_alteradas == retrato->paredes_alteradas) return;
+    recursos.paredes_alteradas = retrato->paredes_alteradas;
+    if (recursos.largura_camada == 0) return; //sem camada as paredes sao lidas do retrato a cada quadro
+
+    for (int y = 0; y < mapa->altura; y++)
+    {
+        for (int x = 0; x < mapa->largura; x++)
+        {
+            int celula = INDICE_CELULA(mapa, x, y);
+            int parede = testa_celula(mapa, mapa->paredes, x, y);
+            if (parede == testa_bit(recursos.parede_desenhada, celula)) continue;
+            if (!desenhando)
+            {
+                BeginTextureMode(recursos.camada_paredes);
+                desenhando = 1;
+            }
+            //preto opaco fica igual ao fundo da tela, que e limpo com BLACK
+            DrawRectangle(x * TAM_PIXEL, y * TAM_PIXEL, TAM_PIXEL, TAM_PIXEL, parede ? BLUE : BLACK);
+            if (parede) liga_bit(recursos.parede_desenhada, celula);
+            else desliga_bit(recursos.parede_desenhada, celula);
+        }
+    }
+    if (desenhando) EndTextureMode();
+}
+
+//Desenha um sprite na celula (x, y), que pode ser fracionaria (personagem entre duas celulas). No modo lote so acrescenta um quad ao lote aberto em desenha_mapa
+void desenha_sprite(float x, float y, int sprite, Color cor)
+{
+    if (!desenho.lote)
+    {
+        DrawCircleV((Vector2){x * TAM_PIXEL + TAM_PIXEL / 2, y * TAM_PIXEL + TAM_PIXEL / 2}, sprite == SPRITE_GRANDE ? TAM_PIXEL / 2 : TAM_PIXEL / 4, cor);
+        desenho.chamadas++;
+        desenho.vertices += VERTICES_CIRCULO;
+        return;
+    }
+    float u0 = (float)sprite / NUM_SPRITES, u1 = (float)(sprite + 1) / NUM_SPRITES;
+    float px = x * TAM_PIXEL, py = y * TAM_PIXEL;
+    rlColor4ub(cor.r, cor.g, cor.b, cor.a);
+    rlTexCoord2f(u0, 0.0f); rlVertex2f(px, py);
+    rlTexCoord2f(u0, 1.0f); rlVertex2f(px, py + TAM_PIXEL);
+    rlTexCoord2f(u1, 1.0f); rlVertex2f(px + TAM_PIXEL, py + TAM_PIXEL);
+    rlTexCoord2f(u1, 0.0f); rlVertex2f(px + TAM_PIXEL, py);
+    desenho.vertices += 4;
+}
+
+//DrawText contando a chamada e os vertices (a raylib desenha cada caractere como um quad)
+void desenha_texto(const char *texto, int x, int y, int tamanho, Color cor)
+{
+    DrawText(texto, x, y, tamanho, cor);
+    desenho.chamadas++;
+    desenho.vertices += 4 * (int)strlen(texto);
+}
+
+//Fracao (0 a 1) do caminho entre a celula anterior e a atual de um personagem que anda a cada "intervalo" segundos.
+//"tempo" e o tempo desde o ultimo passo, somado ao tempo que ainda esta no acumulador e nao virou tick.
+float fracao_interpolacao(float tempo, float intervalo)
+{
+    float fracao = intervalo > 0.0f ? tempo / intervalo : 1.0f;
+    return fracao < 0.0f ? 0.0f : (fracao > 1.0f ? 1.0f : fracao);
+}
+
+//Posiciona a camera centrada no ponto (em pixels do mapa) sem deixar ela sair do mapa, e calcula as celulas visiveis
+void posiciona_camera(CAMERA_MAPA *camera, const BITBOARDS_MAPA *mapa, float centro_x, float centro_y)
+{
+    int largura = mapa->largura * TAM_PIXEL, altura = mapa->altura * TAM_PIXEL;
+    camera->x = largura <= LAR_TELA ? 0 : (int)centro_x - LAR_TELA / 2;
+    camera->y = altura <= ALT_TELA ? 0 : (int)centro_y - ALT_TELA / 2;
+    if (camera->x > largura - LAR_TELA) camera->x = largura - LAR_TELA;
+    if (camera->y > altura - ALT_TELA) camera->y = altura - ALT_TELA;
+    if (camera->x < 0) camera->x = 0;
+    if (camera->y < 0) camera->y = 0;
+    camera->coluna_inicial = camera->x / TAM_PIXEL;
+    camera->linha_inicial = camera->y / TAM_PIXEL;
+    camera->coluna_final = (camera->x + LAR_TELA + TAM_PIXEL - 1) / TAM_PIXEL;
+    camera->linha_final = (camera->y + ALT_TELA + TAM_PIXEL - 1) / TAM_PIXEL;
+    if (camera->coluna_final > mapa->largura) camera->coluna_final = mapa->largura;
+    if (camera->linha_final > mapa->altura) camera->linha_final = mapa->altura;
+}
+
+//Diz se a celula (x, y), que pode ser fracionaria, aparece (mesmo que em parte) na camera
+int celula_visivel(const CAMERA_MAPA *camera, float x, float y)
+{
+    return x > camera->coluna_inicial - 1 && x < camera->coluna_final && y > camera->linha_inicial - 1 && y < camera->linha_final;
+}
+
+//Bits das colunas [inicio, fim) que caem na palavra k de uma linha de bitboard
+LINHA_BITS mascara_colunas(int k, int inicio, int fim)
+{
+    int de = inicio - 64 * k, ate = fim - 64 * k;
+    if (de < 0) de = 0;
+    if (ate > 64) ate = 64;
+    if (de >= ate) return 0;
+    LINHA_BITS mascara = ate == 64 ? ~0ULL : (1ULL << ate) - 1;
+    return mascara & ~((1ULL << de) - 1);
+}
+
+//Mapas sem camada: desenha as paredes visiveis a cada quadro, um DrawRectangle por trecho horizontal de paredes seguidas
+void desenha_paredes_visiveis(const BITBOARDS_MAPA *mapa, const CAMERA_MAPA *camera)
+{
+    for (int y = camera->linha_inicial; y < camera->linha_final; y++)
+    {
+        int x = camera->coluna_inicial;
+        while (x < camera->coluna_final)
+        {
+            if (!testa_celula(mapa, mapa->paredes, x, y))
+            {
+                x++;
+                continue;
+            }
+            int inicio = x;
+            while (x < camera->coluna_final && testa_celula(mapa, mapa->paredes, x, y)) x++;
+            DrawRectangle(inicio * TAM_PIXEL, y * TAM_PIXEL, (x - inicio) * TAM_PIXEL, TAM_PIXEL, BLUE);
+            desenho.chamadas++;
+            desenho.vertices += 4;
+        }
+    }
+}
+
+//Funcao responsavel por graficar elementos da matriz, a partir de um retrato do jogo (so le, sem trava). tempo_pendente e o tempo que
+//ainda nao foi simulado (menos de um tick), usado para desenhar os personagens entre duas celulas. So o que esta dentro da camera e desenhado.
+void desenha_mapa(const RETRATO_JOGO *retrato, float tempo_pendente)
+{
+    const BITBOARDS_MAPA *mapa = &retrato->mapa;
+    float fracao_pacman = fracao_interpolacao(retrato->timer_pacman + tempo_pendente, VEL_PACMAN);
+    float fracao_monstros = fracao_interpolacao(retrato->timer_monstros + tempo_pendente, retrato->vel_monstros);
+    float pacman_x = retrato->pacman.x_anterior + (retrato->pacman.x - retrato->pacman.x_anterior) * fracao_pacman;
+    float pacman_y = retrato->pacman.y_anterior + (retrato->pacman.y - retrato->pacman.y_anterior) * fracao_pacman;
+    CAMERA_MAPA camera;
+    int i;
+    desenho.chamadas = 0;
+    desenho.vertices = 0;
+
+    posiciona_camera(&camera, mapa, pacman_x * TAM_PIXEL + TAM_PIXEL / 2, pacman_y * TAM_PIXEL + TAM_PIXEL / 2);
+    BeginMode2D((Camera2D){{0, 0}, {(float)camera.x, (float)camera.y}, 0.0f, 1.0f});
+
+    //paredes: a parte visivel da camada pronta (a altura negativa desvira a textura, que o OpenGL guarda de cabeca para baixo,
+    //e por isso a linha de cima da camera fica a altura_camera pixels do fim da textura)
+    if (recursos.largura_camada > 0)
+    {
+        float largura_camera = (float)(camera.coluna_final * TAM_PIXEL - camera.x);
+        float altura_camera = (float)(camera.linha_final * TAM_PIXEL - camera.y);
+        float altura_textura = (float)(recursos.altura_camada * TAM_PIXEL);
+        DrawTextureRec(recursos.camada_paredes.texture, (Rectangle){(float)camera.x, altura_textura - camera.y - altura_camera, largura_camera, -altura_camera},
+                       (Vector2){(float)camera.x, (float)camera.y}, WHITE);
+        desenho.chamadas++;
+        desenho.vertices += 4;
+    }
+    else
+    {
+        desenha_paredes_visiveis(mapa, &camera);
+    }
+
+    //coletaveis, Pac-Man e monstros: todos sao quads do mesmo atlas, entao vao juntos em um unico lote
+    if (desenho.lote)
+    {
+        //no maximo um coletavel e um monstro por celula visivel (os monstros nao dividem celula), mais o Pac-Man
+        rlCheckRenderBatchLimit(4 * (2 * (camera.coluna_final - camera.coluna_inicial) * (camera.linha_final - camera.linha_inicial) + 1));
+        rlSetTexture(recursos.atlas.id);
+        rlBegin(RL_QUADS);
+    }
+
+    //coletaveis: so os bits ligados das linhas visiveis, em vez de correr a matriz inteira ou a lista de todos os itens do mapa
+    for (int y = camera.linha_inicial; y < camera.linha_final; y++)
+    {
+        for (int k = PALAVRA_COLUNA(camera.coluna_inicial); k <= PALAVRA_COLUNA(camera.coluna_final - 1); k++)
+        {
+            size_t palavra = (size_t)y * mapa->palavras + k;
+            LINHA_BITS visiveis = mascara_colunas(k, camera.coluna_inicial, camera.coluna_final);
+            for (LINHA_BITS bits = mapa->pontos[palavra] & visiveis; bits; bits &= bits - 1)
+                desenha_sprite(64 * k + menor_bit(bits), y, SPRITE_PEQUENO, WHITE);
+            for (LINHA_BITS bits = mapa->power[palavra] & visiveis; bits; bits &= bits - 1)
+                desenha_sprite(64 * k + menor_bit(bits), y, SPRITE_GRANDE, ORANGE);
+            for (LINHA_BITS bits = mapa->frutas[palavra] & visiveis; bits; bits &= bits - 1)
+                desenha_sprite(64 * k + menor_bit(bits), y, SPRITE_GRANDE, RED);
+        }
+    }
+
+    // Desenha o Pacman
+    desenha_sprite(pacman_x, pacman_y, SPRITE_GRANDE, YELLOW);
+
+    // Desenha os monstros que estao na camera (so os 4 vetores de posicao sao lidos, em sequencia)
+    for (i = 0; i < retrato->num_monstros; i++)
+    {
+        float x = retrato->x_anterior[i] + (retrato->x[i] - retrato->x_anterior[i]) * fracao_monstros;
+        float y = retrato->y_anterior[i] + (retrato->y[i] - retrato->y_anterior[i]) * fracao_monstros;
+        if (celula_visivel(&camera, x, y))
+            desenha_sprite(x, y, SPRITE_GRANDE, PURPLE);
+    }
+
+    if (desenho.lote)
+    {
+        rlEnd();
+        rlSetTexture(0);
+        desenho.chamadas++;
+    }
+    EndMode2D();
+
+    // Desenha a pontuao e vidas
+    desenha_texto(TextFormat("Vidas: %d", retrato->player.vida), 10, 5, 30, RED);
+    desenha_texto(TextFormat("Pontos: %d", retrato->player.pontuacao), 180, 5, 30, BLUE);
+    desenha_texto(TextFormat("Fase: %d", retrato->player.fase), 400, 5, 30, YELLOW);
+    desenha_texto(TextFormat("Dificuldade: %d", retrato->player.dificuldade), 590, 5, 30, ORANGE);
+
+}
+
+//Painel de desempenho (F3): chamadas de desenho do quadro, percentis do tempo de quadro, ticks por segundo, onde o tempo foi gasto e
+//quanto os monstros buscaram no jogo. Mostra os numeros do mapa antes de desenhar o proprio painel, e os tempos dos quadros ja terminados.
+void desenha_painel_desempenho(const RETRATO_JOGO *retrato)
+{
+    float ordenadas[AMOSTRAS_QUADROS];
+    float p50 = 0, p99 = 0, maximo = 0;
+    if (!desenho.painel_visivel) return;
+
+    if (quadros.preenchidas > 0)
+    {
+        memcpy(ordenadas, quadros.duracao, quadros.preenchidas * sizeof(float));
+        qsort(ordenadas, quadros.preenchidas, sizeof(float), compara_floats);
+        p50 = ordenadas[(quadros.preenchidas - 1) * 50 / 100];
+        p99 = ordenadas[(quadros.preenchidas - 1) * 99 / 100];
+        maximo = ordenadas[quadros.preenchidas - 1];
+    }
+
+    DrawRectangle(0, ALT_TELA - 79, LAR_TELA, 79, BLACK);
+    DrawText(TextFormat("buscas: A* %ld (%ld nodes) | BFS %ld | HPA* %ld | D* Lite %ld + %ld do zero", retrato->buscas_a_estrela,
+                        retrato->nodes_a_estrela, retrato->bfs_fluxo, retrato->buscas_hpa, retrato->buscas_consertadas, retrato->buscas_do_zero),
+             5, ALT_TELA - 77, 16, GREEN);
+    DrawText(TextFormat("%d chamadas | %d vertices | sprites: %s (F2)", desenho.chamadas, desenho.vertices, desenho.lote ? "lote rlgl" : "DrawCircle"),
+             5, ALT_TELA - 58, 16, GREEN);
+    DrawText(TextFormat("quadro p50 %.2f  p99 %.2f  max %.2f ms (%d quadros) | %d ticks/s", p50, p99, maximo, quadros.preenchidas, quadros.ticks_por_segundo),
+             5, ALT_TELA - 39, 16, GREEN);
+    DrawText(TextFormat("simulacao %.2f  desenho %.2f  espera %.2f ms | ritmo: %s %d (F4)", quadros.ms_simulacao, quadros.ms_desenho,
+                        quadros.ms_espera, nomes_ritmos[ritmo.modo], ritmo.modo == RITMO_VSYNC ? 0 : ritmo.fps_alvo),
+             5, ALT_TELA - 20, 16, GREEN);
+}
+#endif
+//Funcao acionada caso player colida em um monstro
+void trata_colisao(JOGO *jogo)
+{
+    jogo->player.vida--;
+    jogo->pacman.x = jogo->pacman.x_inicial;
+    jogo->pacman.y = jogo->pacman.y_inicial;
+
+    for (int j = 0; j < jogo->num_monstros; j++)
+    {
+        desocupa_celula(jogo, j);
+        jogo->monstros.x[j] = jogo->monstros.x_inicial[j];
+        jogo->monstros.y[j] = jogo->monstros.y_inicial[j];
+        ocupa_celula(jogo, j);
+    }
+    fixa_posicoes_anteriores(jogo);
+    invalida_caminhos_hpa(jogo);
+}
+//Gerador de numeros pseudoaleatorios PCG32. Cada jogo tem o seu proprio estado (jogo->rng), entao a mesma semente
+//sempre produz a mesma sequencia de sorteios, independente de outros jogos ou do rand() da biblioteca padrao.
+unsigned int sorteia(unsigned long long *estado)
+{
+    unsigned long long anterior = *estado;
+    *estado = anterior * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned int xorshift = (unsigned int)(((anterior >> 18u) ^ anterior) >> 27u);
+    unsigned int rotacao = (unsigned int)(anterior >> 59u);
+    return (xorshift >> rotacao) | (xorshift << ((-rotacao) & 31));
+}
+
+//Inicia o estado do gerador a partir de uma semente
+void semeia(unsigned long long *estado, unsigned long long semente)
+{
+    *estado = 0;
+    sorteia(estado);
+    *estado += semente;
+    sorteia(estado);
+}
+
+//Funcao para evitar que dois monstros ocupem o mesmo pixel: chamada quando a celula para onde o monstro ia ja tem outro monstro.
+//Sorteia um dos dois lados perpendiculares e tenta ele e depois o outro (livres de parede e de monstro); se nenhum servir, o monstro
+//espera no lugar. Como um monstro nunca entra em celula ocupada, dois monstros tambem nao atravessam um ao outro trocando de celula.
+void desvia_monstro(JOGO *jogo, int x, int y, int *dx, int *dy)
+{
+    int lado = (sorteia(&jogo->rng) % 2) ? 1 : -1; // sorteia uma direcao para o monstro seguir
+    int lado_dx = *dy * lado, lado_dy = *dx * lado;
+    for (int tentativa = 0; tentativa < 2; tentativa++)
+    {
+        if (!eh_parede(&jogo->mapa, x + lado_dx, y + lado_dy) && monstro_na_celula(jogo, x + lado_dx, y + lado_dy) < 0)
+        {
+            *dx = lado_dx;
+            *dy = lado_dy;
+            return;
+        }
+        lado_dx = -lado_dx;
+        lado_dy = -lado_dy;
+    }
+    *dx = 0;
+    *dy = 0;
+}
+
+//A fase acaba quando nao sobra nenhum item (contador mantido por altera_celula, sem varrer a matriz nem comparar pontuacoes)
+int verifica_fim_de_fase(JOGO *jogo)
+{
+    return jogo->num_coletaveis == 0;
+}
+//Verifica se o pacman nao esta ocupando uma posicao com coletavel, se sim faz a coleta e substitui por um espaco vazio.
+void verifica_coleta(JOGO *jogo)
+{
+    POS_PACMAN *pacman = &jogo->pacman;
+    BITBOARDS_MAPA *mapa = &jogo->mapa;
+    int ponto = testa_celula(mapa, mapa->pontos, pacman->x, pacman->y);
+    int power = testa_celula(mapa, mapa->power, pacman->x, pacman->y);
+    int fruta = testa_celula(mapa, mapa->frutas, pacman->x, pacman->y);
+    if (ponto | power | fruta)
+    {
+        jogo->player.pontuacao += 10 * ponto + 20 * power + 30 * fruta; //'.' = 10, 'S' = 20, 'F' = 30
+        altera_celula(jogo, pacman->x, pacman->y, ' ');
+    }
+}
+void controla_dificuldade(JOGO *jogo)
+{
+    jogo->player.dificuldade++;
+    jogo->vel_monstros = jogo->vel_monstros-0.05;
+}
+
+//funcao responsavel pela movimentacao do pac-man
+void move_pacman(JOGO *jogo, float deltaTime)
+{
+    POS_PACMAN *pacman = &jogo->pacman;
+    //O temporizador fica dentro do JOGO (e nao em uma variavel static), assim cada jogo comeca com ele zerado
+    jogo->timer_pacman += deltaTime; //temporizador para cadenciar movimentos do pacman (controlar velocidade)
+    if (jogo->timer_pacman >= VEL_PACMAN) //Se o valor chegar na velocidade de pacman entra no looping
+    {
+        int novoX = pacman->x + pacman->dx; //move nova posicao do pacman na direcao do vetor "acionado"
+        int novoY = pacman->y + pacman->dy;
+        pacman->x_anterior = pacman->x;
+        pacman->y_anterior = pacman->y;
+
+        if (!eh_parede(&jogo->mapa, novoX, novoY))  // se essa posicao NAO for uma parede, o pacman vai para nova posicao
+        {
+            pacman->x = novoX;
+            pacman->y = novoY;
+            // verifica se essa posicao nao  a mesma de nem um dos monstro (uma consulta na grade de ocupacao), se for, aciona a funcao trata_colisao
+            if (monstro_na_celula(jogo, pacman->x, pacman->y) >= 0)
+            {
+                trata_colisao(jogo);
+                return;
+            }
+            //Aciona funcao para verificar se coleta foi feita
+            verifica_coleta(jogo);
+        }
+        jogo->timer_pacman = 0.0f; //Zera timer
+    }
+}
+
+
+//Funcao heuristica para apoio do algoritmo A*
+int heuristica(int x1, int y1, int x2, int y2)
+{
+    return abs(x1 - x2) + abs(y1 - y2); //Retorna a soma das distancias entre as coordenadas x e y de dois pontos.
+}
+
+//Reinicia a arena para uma nova busca - O(1), nenhum node precisa ser liberado individualmente
+void reinicia_arena(ARENA_NODES *arena)
+{
+    if (arena->usados > arena->pico)
+        arena->pico = arena->usados;
+    arena->usados = 0;
+    arena->buscas++;
+}
+
+//Retorna o indice de um node dentro da arena (e o que fica guardado no campo parent)
+int indice_node(const ARENA_NODES *arena, const Node *node)
+{
+    return (int)(node - arena->nodes);
+}
+
+//Funcao para prencher os valores de um Node
+//Pega o proximo node livre da arena e inicializa com as coordenadas fornecidas, custo g, heurstica h, e o indice do node pai.
+Node *cria_node(ARENA_NODES *arena, int x, int y, int g, int h, int parent)
+{
+    //Nao ha malloc aqui: a arena tem um node por celula e cada celula gera no maximo um node por busca
+    Node *node = &arena->nodes[arena->usados++];
+    arena->total_alocados++;
+    node->x = x;
+    node->y = y;
+    node->g = g;
+    node->h = h;
+    node->f = g + h;
+    node->parent = parent;
+    return node;
+}
+
+//Funcao de comparacao usada pelo heap da lista aberta.
+//Retorna negativo se o nodeA deve sair antes do nodeB: primeiro o menor F e, em caso de empate, o node inserido primeiro.
+//O desempate pela ordem de insercao deixa a ordem deterministica (o qsort nao e estavel, entao a ordem de empates dependia da biblioteca).
+int compara_nodes(const Node *nodeA, const Node *nodeB)
+{
+    if (nodeA->f != nodeB->f)
+        return nodeA->f - nodeB->f;
+    return nodeA->ordem - nodeB->ordem;
+}
+
+//Troca dois itens do heap de lugar, mantendo o indice_heap de cada node atualizado
+void heap_troca(HEAP_ABERTOS *heap, int a, int b)
+{
+    Node *temp = heap->itens[a];
+    heap->itens[a] = heap->itens[b];
+    heap->itens[b] = temp;
+    heap->itens[a]->indice_heap = a;
+    heap->itens[b]->indice_heap = b;
+}
+
+//Sobe o item da posicao i enquanto ele for "menor" que o pai (usado na insercao e no decrease-key)
+void heap_sobe(HEAP_ABERTOS *heap, int i)
+{
+    while (i > 0)
+    {
+        int pai = (i - 1) / 2;
+        if (compara_nodes(heap->itens[i], heap->itens[pai]) >= 0)
+            break;
+        heap_troca(heap, i, pai);
+        i = pai;
+    }
+}
+
+//Desce o item da posicao i enquanto algum filho for "menor" que ele (usado na remocao do topo)
+void heap_desce(HEAP_ABERTOS *heap, int i)
+{
+    while (1)
+    {
+        int esq = 2 * i + 1;
+        int dir = esq + 1;
+        int menor = i;
+        if (esq < heap->tamanho && compara_nodes(heap->itens[esq], heap->itens[menor]) < 0)
+            menor = esq;
+        if (dir < heap->tamanho && compara_nodes(heap->itens[dir], heap->itens[menor]) < 0)
+            menor = dir;
+        if (menor == i)
+            break;
+        heap_troca(heap, i, menor);
+        i = menor;
+    }
+}
+
+//Insere um node na lista aberta - O(log n)
+void heap_insere(HEAP_ABERTOS *heap, Node *node)
+{
+    node->indice_heap = heap->tamanho;
+    heap->itens[heap->tamanho++] = node;
+    heap_sobe(heap, node->indice_heap);
+}
+
+//Remove e retorna o node de menor F da lista aberta - O(log n)
+Node *heap_remove_menor(HEAP_ABERTOS *heap)
+{
+    Node *menor = heap->itens[0];
+    heap->tamanho--;
+    if (heap->tamanho > 0)
+    {
+        heap->itens[0] = heap->itens[heap->tamanho];
+        heap->itens[0]->indice_heap = 0;
+        heap_desce(heap, 0);
+    }
+    return menor;
+}
+
+//Desliga os bits de aberto/fechado das celulas que a ultima busca tocou (uma por node usado), em vez de zerar os vetores do mapa inteiro
+//a cada busca: o custo fica proporcional ao que a busca explorou, e nao ao tamanho do mapa
+void limpa_bits_arena(ARENA_NODES *arena, const BITBOARDS_MAPA *mapa)
+{
+    for (int i = 0; i < arena->usados; i++)
+    {
+        int indice = INDICE_CELULA(mapa, arena->nodes[i].x, arena->nodes[i].y);
+        desliga_bit(arena->bits_abertos, indice);
+        desliga_bit(arena->bits_fechados, indice);
+    }
+}
+
+//Algoritmo A*: procura o menor caminho de (origem_x, origem_y) ate (alvo_x, alvo_y) e devolve em *dx e *dy o primeiro passo desse caminho.
+//Retorna 1 se encontrou caminho e 0 caso contrario (nesse caso *dx = *dy = 0, o monstro fica parado).
+//
+//A lista aberta e um heap binario com decrease-key, e as listas aberta/fechada tambem sao marcadas em mapas de bits
+//indexados por y*largura+x. Assim cada celula tem no maximo um node, e verificar se um vizinho ja foi visto custa O(1)
+//em vez de percorrer as listas inteiras como era feito antes. Os nodes, o heap e os mapas de bits vem da arena (do bloco de memoria
+//do jogo), entao a busca nao faz nenhum malloc e nao usa a pilha mesmo em mapas de milhoes de celulas. Os bits sao deixados zerados no fim.
+int busca_a_estrela(ARENA_NODES *arena, const BITBOARDS_MAPA *mapa, int origem_x, int origem_y, int alvo_x, int alvo_y, int *dx, int *dy)
+{
+    HEAP_ABERTOS *abertos = &arena->abertos;
+    Node **node_da_celula = arena->node_da_celula;
+    unsigned int *bits_abertos = arena->bits_abertos;
+    unsigned int *bits_fechados = arena->bits_fechados;
+    int proxima_ordem = 0;
+    int encontrou = 0;
+
+    *dx = 0;
+    *dy = 0;
+    abertos->tamanho = 0;
+    reinicia_arena(arena);
+    arena->ultimo_custo = -1;
+
+    Node *inicio = cria_node(arena, origem_x, origem_y, 0, heuristica(origem_x, origem_y, alvo_x, alvo_y), NODE_NULO);
+    inicio->ordem = proxima_ordem++;
+    heap_insere(abertos, inicio);
+    liga_bit(bits_abertos, INDICE_CELULA(mapa, origem_x, origem_y));
+    node_da_celula[INDICE_CELULA(mapa, origem_x, origem_y)] = inicio;
+
+    while (abertos->tamanho > 0)
+    {
+        Node *atual = heap_remove_menor(abertos); //o elemento com o valor de menor F da lista aberta
+        int indice_atual = INDICE_CELULA(mapa, atual->x, atual->y);
+        desliga_bit(bits_abertos, indice_atual);
+        liga_bit(bits_fechados, indice_atual); //Adiciona posicao atual a lista fechada
+
+        //PASSOS CASO NODE ATUAL SEJA O ALVO
+        if (atual->x == alvo_x && atual->y == alvo_y)
+        {
+            Node *caminho = atual;
+            arena->ultimo_custo = atual->g;
+            //Recua pelos nodes pais ate o node que vem logo depois da posicao inicial (o que tem o "node avo" vazio)
+            while (caminho->parent != NODE_NULO && arena->nodes[caminho->parent].parent != NODE_NULO)
+            {
+                caminho = &arena->nodes[caminho->parent];
+            }
+            if (caminho->parent != NODE_NULO) //se o alvo ja era a posicao inicial nao ha passo a dar
+            {
+                *dx = caminho->x - origem_x;
+                *dy = caminho->y - origem_y;
+            }
+            encontrou = 1;
+            break;
+        }
+
+        //Explora as quatro direcoes possiveis a partir do node atual
+        for (int d = 0; d < 4; d++)
+        {
+            int nx = atual->x + direcoes[d][0];
+            int ny = atual->y + direcoes[d][1];
+            if (eh_parede(mapa, nx, ny)) continue; //paredes (e o lado de fora do mapa) nunca entram na lista aberta
+
+            int indice = INDICE_CELULA(mapa, nx, ny);
+            if (testa_bit(bits_fechados, indice)) continue; //ja foi explorado
+
+            int g = atual->g + 1; //custo para chegar no n atual + 1
+            if (testa_bit(bits_abertos, indice))
+            {
+                //Ja esta na lista aberta: so atualiza se o novo caminho for melhor (decrease-key)
+                Node *vizinho = node_da_celula[indice];
+                if (vizinho->g <= g) continue;
+                vizinho->g = g;
+                vizinho->f = g + vizinho->h;
+                vizinho->parent = indice_node(arena, atual);
+                vizinho->ordem = proxima_ordem++;
+                heap_sobe(abertos, vizinho->indice_heap);
+            }
+            else
+            {
+                Node *vizinho = cria_node(arena, nx, ny, g, heuristica(nx, ny, alvo_x, alvo_y), indice_node(arena, atual)); //Cria node com a nova posicao
+                vizinho->ordem = proxima_ordem++;
+                heap_insere(abertos, vizinho); //Adiciona node a lista dos abertos
+                liga_bit(bits_abertos, indice);
+                node_da_celula[indice] = vizinho;
+            }
+        }
+    }
+
+    //Os nodes ficam na arena e sao descartados de uma vez so no inicio da proxima busca
+    limpa_bits_arena(arena, mapa);
+    return encontrou;
+}
+
+//Relaxa a aresta do node atual ate a celula (x, y), com custo acumulado g: o mesmo tratamento dos vizinhos em busca_a_estrela,
+//para arestas de qualquer custo (as do grafo abstrato)
+void relaxa_aresta(ARENA_NODES *arena, const BITBOARDS_MAPA *mapa, Node *atual, int x, int y, int g, int alvo_x, int alvo_y, int *proxima_ordem)
+{
+    int indice = INDICE_CELULA(mapa, x, y);
+    if (testa_bit(arena->bits_fechados, indice)) return;
+    if (testa_bit(arena->bits_abertos, indice))
+    {
+        Node *vizinho = arena->node_da_celula[indice];
+        if (vizinho->g <= g) return;
+        vizinho->g = g;
+        vizinho->f = g + vizinho->h;
+        vizinho->parent = indice_node(arena, atual);
+        vizinho->ordem = (*proxima_ordem)++;
+        heap_sobe(&arena->abertos, vizinho->indice_heap);
+    }
+    else
+    {
+        Node *vizinho = cria_node(arena, x, y, g, heuristica(x, y, alvo_x, alvo_y), atual ? indice_node(arena, atual) : NODE_NULO);
+        vizinho->ordem = (*proxima_ordem)++;
+        heap_insere(&arena->abertos, vizinho);
+        liga_bit(arena->bits_abertos, indice);
+        arena->node_da_celula[indice] = vizinho;
+    }
+}
+
+//Primeiro passo de (origem_x, origem_y) ate (alvo_x, alvo_y) sem sair do cluster da origem e do cluster do alvo, que tem que ser o mesmo
+//ou vizinhos: uma BFS local a partir do alvo. Retorna 0 se os clusters nao sao vizinhos ou se o alvo so e alcancavel por fora deles.
+int passo_local(const GRAFO_HPA *grafo, const BITBOARDS_MAPA *mapa, MEMORIA_HPA *memoria, int origem_x, int origem_y, int alvo_x, int alvo_y, int *dx, int *dy)
+{
+    int cx_origem = origem_x / LADO_CLUSTER, cy_origem = origem_y / LADO_CLUSTER;
+    int cx_alvo = alvo_x / LADO_CLUSTER, cy_alvo = alvo_y / LADO_CLUSTER;
+    if (abs(cx_origem - cx_alvo) + abs(cy_origem - cy_alvo) > 1) return 0;
+
+    int x0 = (cx_origem < cx_alvo ? cx_origem : cx_alvo) * LADO_CLUSTER, y0 = (cy_origem < cy_alvo ? cy_origem : cy_alvo) * LADO_CLUSTER;
+    int x1 = ((cx_origem > cx_alvo ? cx_origem : cx_alvo) + 1) * LADO_CLUSTER, y1 = ((cy_origem > cy_alvo ? cy_origem : cy_alvo) + 1) * LADO_CLUSTER;
+    if (x1 > grafo->largura) x1 = grafo->largura;
+    if (y1 > grafo->altura) y1 = grafo->altura;
+    bfs_retangulo(mapa, x0, y0, x1, y1, alvo_x, alvo_y, memoria->distancia_local, memoria->fila);
+
+    int largura = x1 - x0, distancia = memoria->distancia_local[(origem_y - y0) * largura + origem_x - x0];
+    if (distancia <= 0) return distancia == 0;
+    for (int d = 0; d < 4; d++)
+    {
+        int nx = origem_x + direcoes[d][0], ny = origem_y + direcoes[d][1];
+        if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1) continue;
+        if (memoria->distancia_local[(ny - y0) * largura + nx - x0] == distancia - 1)
+        {
+            *dx = direcoes[d][0];
+            *dy = direcoes[d][1];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//A* no grafo abstrato, da celula de origem ate a celula alvo. A origem e o alvo entram no grafo so durante a busca, ligados aos nos dos
+//seus clusters pelas distancias de uma BFS local cada. Os nodes, o heap e os bits sao os da arena do A* (um node por celula), mas so as
+//celulas que sao nos do grafo entram na busca. Guarda em caminho os primeiros MAXIMO_NOS_CAMINHO nos do caminho encontrado.
+//Retorna 1 se encontrou caminho.
+int busca_abstrata(const GRAFO_HPA *grafo, ARENA_NODES *arena, MEMORIA_HPA *memoria, const BITBOARDS_MAPA *mapa,
+                   int origem_x, int origem_y, int alvo_x, int alvo_y, CAMINHO_HPA *caminho)
+{
+    int cluster_origem = CLUSTER_DA_CELULA(grafo, origem_x, origem_y), cluster_alvo = CLUSTER_DA_CELULA(grafo, alvo_x, alvo_y);
+    int ox0, oy0, ox1, oy1, ax0, ay0, ax1, ay1;
+    int origem = INDICE_CELULA(mapa, origem_x, origem_y), alvo = INDICE_CELULA(mapa, alvo_x, alvo_y);
+    int proxima_ordem = 0;
+    Node *fim = NULL;
+
+    limites_cluster(grafo, cluster_origem, &ox0, &oy0, &ox1, &oy1);
+    limites_cluster(grafo, cluster_alvo, &ax0, &ay0, &ax1, &ay1);
+    bfs_retangulo(mapa, ox0, oy0, ox1, oy1, origem_x, origem_y, memoria->distancia_origem, memoria->fila);
+    bfs_retangulo(mapa, ax0, ay0, ax1, ay1, alvo_x, alvo_y, memoria->distancia_alvo, memoria->fila);
+
+    caminho->num = caminho->proximo = 0;
+    caminho->cluster_alvo = cluster_alvo;
+    arena->abertos.tamanho = 0;
+    reinicia_arena(arena);
+    arena->ultimo_custo = -1;
+    relaxa_aresta(arena, mapa, NULL, origem_x, origem_y, 0, alvo_x, alvo_y, &proxima_ordem);
+
+    while (arena->abertos.tamanho > 0)
+    {
+        Node *atual = heap_remove_menor(&arena->abertos);
+        int indice_atual = INDICE_CELULA(mapa, atual->x, atual->y);
+        desliga_bit(arena->bits_abertos, indice_atual);
+        liga_bit(arena->bits_fechados, indice_atual);
+        memoria->nos_expandidos++;
+        if (indice_atual == alvo)
+        {
+            fim = atual;
+            break;
+        }
+
+        int cluster = CLUSTER_DA_CELULA(grafo, atual->x, atual->y);
+        int no = no_da_celula_hpa(grafo, cluster, indice_atual);
+        if (indice_atual == origem) //a origem liga nos nos do proprio cluster
+        {
+            for (int n = grafo->inicio_nos_cluster[cluster]; n < grafo->inicio_nos_cluster[cluster + 1]; n++)
+            {
+                int x = grafo->celula_no[n] % mapa->largura, y = grafo->celula_no[n] / mapa->largura;
+                int passos = memoria->distancia_origem[(y - oy0) * (ox1 - ox0) + x - ox0];
+                if (passos > 0) relaxa_aresta(arena, mapa, atual, x, y, atual->g + passos, alvo_x, alvo_y, &proxima_ordem);
+            }
+        }
+        if (no >= 0)
+        {
+            for (int a = grafo->inicio_arestas[no]; a < grafo->inicio_arestas[no + 1]; a++)
+            {
+                int celula = grafo->celula_no[grafo->destino_aresta[a]];
+                relaxa_aresta(arena, mapa, atual, celula % mapa->largura, celula / mapa->largura, atual->g + grafo->custo_aresta[a],
+                              alvo_x, alvo_y, &proxima_ordem);
+            }
+        }
+        if (cluster == cluster_alvo) //e os nos do cluster do alvo ligam no alvo
+        {
+            int passos = memoria->distancia_alvo[(atual->y - ay0) * (ax1 - ax0) + atual->x - ax0];
+            if (passos > 0) relaxa_aresta(arena, mapa, atual, alvo_x, alvo_y, atual->g + passos, alvo_x, alvo_y, &proxima_ordem);
+        }
+    }
+
+    if (fim != NULL)
+    {
+        //o caminho sai do alvo para a origem pelos pais: primeiro conta os nos do meio, depois guarda os primeiros a partir da origem
+        int nos_meio = -1;
+        arena->ultimo_custo = fim->g;
+        for (Node *node = fim; node->parent != NODE_NULO; node = &arena->nodes[node->parent])
+            nos_meio++;
+        int posicao = nos_meio;
+        for (Node *node = &arena->nodes[fim->parent]; node->parent != NODE_NULO; node = &arena->nodes[node->parent])
+        {
+            posicao--;
+            if (posicao < MAXIMO_NOS_CAMINHO)
+                caminho->celulas[posicao] = INDICE_CELULA(mapa, node->x, node->y);
+        }
+        caminho->num = nos_meio < MAXIMO_NOS_CAMINHO ? nos_meio : MAXIMO_NOS_CAMINHO;
+    }
+    limpa_bits_arena(arena, mapa);
+    return fim != NULL;
+}
+
+//Segue o caminho guardado: vale enquanto o alvo estiver no corredor (o cluster de algum no que falta, ou o cluster onde ele estava quando
+//o caminho foi calculado). Pula os nos ja alcancados e da um passo local ate o proximo. Retorna 0 se o caminho nao serve mais.
+int segue_caminho(const GRAFO_HPA *grafo, const BITBOARDS_MAPA *mapa, MEMORIA_HPA *memoria, CAMINHO_HPA *caminho,
+                  int origem_x, int origem_y, int cluster_alvo, int *dx, int *dy)
+{
+    int no_corredor = caminho->num > 0 && caminho->cluster_alvo == cluster_alvo;
+    for (int i = caminho->proximo; i < caminho->num && !no_corredor; i++)
+        no_corredor = CLUSTER_DA_CELULA(grafo, caminho->celulas[i] % mapa->largura, caminho->celulas[i] / mapa->largura) == cluster_alvo;
+    if (!no_corredor) return 0;
+
+    while (caminho->proximo < caminho->num)
+    {
+        int celula = caminho->celulas[caminho->proximo];
+        if (celula == INDICE_CELULA(mapa, origem_x, origem_y))
+        {
+            caminho->proximo++;
+            continue;
+        }
+        return passo_local(grafo, mapa, memoria, origem_x, origem_y, celula % mapa->largura, celula / mapa->largura, dx, dy);
+    }
+    return 0;
+}
+
+//Passo de um monstro com o HPA*: se ele esta no cluster do alvo, uma busca local; senao segue o caminho guardado, e so quando o caminho
+//nao serve mais faz uma nova busca no grafo abstrato. O custo de um passo depende do tamanho dos clusters, nao do mapa.
+//Retorna 1 se encontrou caminho e 0 caso contrario (nesse caso *dx = *dy = 0, como em busca_a_estrela).
+int passo_hpa(const GRAFO_HPA *grafo, ARENA_NODES *arena, MEMORIA_HPA *memoria, const BITBOARDS_MAPA *mapa, CAMINHO_HPA *caminho,
+              int origem_x, int origem_y, int alvo_x, int alvo_y, int *dx, int *dy)
+{
+    int cluster_alvo = CLUSTER_DA_CELULA(grafo, alvo_x, alvo_y);
+    *dx = 0;
+    *dy = 0;
+    if (origem_x == alvo_x && origem_y == alvo_y) return 1;
+
+    if (CLUSTER_DA_CELULA(grafo, origem_x, origem_y) == cluster_alvo && passo_local(grafo, mapa, memoria, origem_x, origem_y, alvo_x, alvo_y, dx, dy))
+    {
+        memoria->buscas_locais++;
+        return 1;
+    }
+    if (segue_caminho(grafo, mapa, memoria, caminho, origem_x, origem_y, cluster_alvo, dx, dy))
+    {
+        memoria->reaproveitados++;
+        return 1;
+    }
+    memoria->buscas_abstratas++;
+    if (busca_abstrata(grafo, arena, memoria, mapa, origem_x, origem_y, alvo_x, alvo_y, caminho)
+        && segue_caminho(grafo, mapa, memoria, caminho, origem_x, origem_y, cluster_alvo, dx, dy))
+        return 1;
+    memoria->sem_caminho++;
+    caminho->num = 0;
+    return 0;
+}
+
+//Reparte o bloco das buscas incrementais para o mapa e o numero de monstros do jogo (o bloco so cresce, como o do jogo).
+//Retorna 0 se o mapa e grande demais para ter uma busca por monstro ou se faltou memoria; nesse caso os monstros usam o HPA*.
+int prepara_busca_incremental(JOGO *jogo)
+{
+    MEMORIA_INCREMENTAL *incremental = &jogo->incremental;
+    size_t celulas = (size_t)CELULAS_MAPA(&jogo->mapa);
+    if (incremental->memoria.bloco != NULL && incremental->largura == jogo->mapa.largura && incremental->altura == jogo->mapa.altura
+        && incremental->monstros == jogo->num_monstros)
+        return 1;
+    if (celulas * jogo->num_monstros > MAXIMO_CELULAS_INCREMENTAL) return 0;
+
+    DIVISOR_BLOCO divisor = {NULL, 0};
+    for (int passo = 0; passo < 2; passo++)
+    {
+        divisor.usado = 0;
+        incremental->buscas = (BUSCA_INCREMENTAL *)reserva_bloco(&divisor, (size_t)jogo->num_monstros * sizeof(BUSCA_INCREMENTAL));
+        for (int i = 0; i < jogo->num_monstros; i++)
+        {
+            int *g = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+            int *rhs = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+            int *posicao_fila = (int *)reserva_bloco(&divisor, celulas * sizeof(int));
+            ITEM_INCREMENTAL *fila = (ITEM_INCREMENTAL *)reserva_bloco(&divisor, celulas * sizeof(ITEM_INCREMENTAL));
+            if (incremental->buscas == NULL) continue; //so medindo
+            BUSCA_INCREMENTAL *busca = &incremental->buscas[i];
+            busca->g = g;
+            busca->rhs = rhs;
+            busca->posicao_fila = posicao_fila;
+            busca->fila = fila;
+            busca->iniciada = 0;
+        }
+        if (passo == 0 && !cresce_memoria(&incremental->memoria, divisor.usado, "as buscas incrementais"))
+        {
+            incremental->largura = 0;
+            incremental->buscas = NULL;
+            incremental->monstros = 0;
+            return 0;
+        }
+        divisor.base = (unsigned char *)incremental->memoria.bloco;
+    }
+    incremental->largura = jogo->mapa.largura;
+    incremental->altura = jogo->mapa.altura;
+    incremental->monstros = jogo->num_monstros;
+    return 1;
+}
+
+//Ordem das chaves do D* Lite: a que tem o menor k1 sai antes, e no empate a de menor k2
+int chave_menor(int a1, int a2, int b1, int b2)
+{
+    return a1 < b1 || (a1 == b1 && a2 < b2);
+}
+
+//Troca dois itens do heap da busca incremental, mantendo posicao_fila atualizado
+void troca_fila_incremental(BUSCA_INCREMENTAL *busca, int a, int b)
+{
+    ITEM_INCREMENTAL temp = busca->fila[a];
+    busca->fila[a] = busca->fila[b];
+    busca->fila[b] = temp;
+    busca->posicao_fila[busca->fila[a].celula] = a;
+    busca->posicao_fila[busca->fila[b].celula] = b;
+}
+
+//Recoloca no lugar certo do heap o item da posicao i depois que a chave dele mudou (sobe ou desce)
+void ajusta_fila_incremental(BUSCA_INCREMENTAL *busca, int i)
+{
+    ITEM_INCREMENTAL *fila = busca->fila;
+    while (i > 0 && chave_menor(fila[i].k1, fila[i].k2, fila[(i - 1) / 2].k1, fila[(i - 1) / 2].k2))
+    {
+        troca_fila_incremental(busca, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while (1)
+    {
+        int esq = 2 * i + 1, dir = esq + 1, menor = i;
+        if (esq < busca->tamanho_fila && chave_menor(fila[esq].k1, fila[esq].k2, fila[menor].k1, fila[menor].k2)) menor = esq;
+        if (dir < busca->tamanho_fila && chave_menor(fila[dir].k1, fila[dir].k2, fila[menor].k1, fila[menor].k2)) menor = dir;
+        if (menor == i) break;
+        troca_fila_incremental(busca, i, menor);
+        i = menor;
+    }
+}
+
+//Poe a celula na fila com a chave dada, ou so troca a chave se ela ja estiver la
+void poe_na_fila_incremental(BUSCA_INCREMENTAL *busca, int celula, int k1, int k2)
+{
+    int i = busca->posicao_fila[celula];
+    if (i < 0)
+    {
+        i = busca->tamanho_fila++;
+        busca->fila[i].celula = celula;
+        busca->posicao_fila[celula] = i;
+    }
+    busca->fila[i].k1 = k1;
+    busca->fila[i].k2 = k2;
+    ajusta_fila_incremental(busca, i);
+}
+
+//Tira a celula da fila (se estiver nela)
+void tira_da_fila_incremental(BUSCA_INCREMENTAL *busca, int celula)
+{
+    int i = busca->posicao_fila[celula];
+    if (i < 0) return;
+    busca->posicao_fila[celula] = -1;
+    busca->tamanho_fila--;
+    if (i == busca->tamanho_fila) return;
+    busca->fila[i] = busca->fila[busca->tamanho_fila];
+    busca->posicao_fila[busca->fila[i].celula] = i;
+    ajusta_fila_incremental(busca, i);
+}
+
+//Chave da celula para a posicao atual do Pac-Man (alvo)
+void chave_incremental(const BUSCA_INCREMENTAL *busca, const BITBOARDS_MAPA *mapa, int celula, int alvo_x, int alvo_y, int *k1, int *k2)
+{
+    int menor = busca->g[celula] < busca->rhs[celula] ? busca->g[celula] : busca->rhs[celula];
+    *k2 = menor;
+    *k1 = menor >= DISTANCIA_INFINITA ? DISTANCIA_INFINITA
+                                      : menor + heuristica(celula % mapa->largura, celula / mapa->largura, alvo_x, alvo_y) + busca->km;
+}
+
+//UpdateVertex do D* Lite: recalcula o rhs da celula a partir dos vizinhos e a deixa na fila so se ela ficou inconsistente (g != rhs)
+void atualiza_celula_incremental(BUSCA_INCREMENTAL *busca, const BITBOARDS_MAPA *mapa, int celula, int alvo_x, int alvo_y)
+{
+    int x = celula % mapa->largura, y = celula / mapa->largura;
+    if (celula == busca->raiz)
+        busca->rhs[celula] = 0;
+    else
+    {
+        int menor = DISTANCIA_INFINITA;
+        for (int d = 0; d < 4; d++)
+        {
+            int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+            if (eh_parede(mapa, nx, ny)) continue;
+            int g = busca->g[INDICE_CELULA(mapa, nx, ny)];
+            if (g < DISTANCIA_INFINITA && g + 1 < menor) menor = g + 1;
+        }
+        busca->rhs[celula] = menor;
+    }
+    if (busca->g[celula] != busca->rhs[celula])
+    {
+        int k1, k2;
+        chave_incremental(busca, mapa, celula, alvo_x, alvo_y, &k1, &k2);
+        poe_na_fila_incremental(busca, celula, k1, k2);
+    }
+    else
+        tira_da_fila_incremental(busca, celula);
+}
+
+//ComputeShortestPath do D* Lite: tira celulas da fila ate a celula do Pac-Man ficar consistente e nenhuma chave menor que a dela sobrar.
+//Retorna quantas celulas foram expandidas.
+int calcula_busca_incremental(BUSCA_INCREMENTAL *busca, const BITBOARDS_MAPA *mapa, int alvo_x, int alvo_y)
+{
+    int alvo = INDICE_CELULA(mapa, alvo_x, alvo_y), expandidas = 0;
+    while (busca->tamanho_fila > 0)
+    {
+        int k1_alvo, k2_alvo, k1, k2;
+        ITEM_INCREMENTAL topo = busca->fila[0];
+        chave_incremental(busca, mapa, alvo, alvo_x, alvo_y, &k1_alvo, &k2_alvo);
+        if (!chave_menor(topo.k1, topo.k2, k1_alvo, k2_alvo) && busca->rhs[alvo] == busca->g[alvo]) break;
+
+        int u = topo.celula, x = u % mapa->largura, y = u / mapa->largura;
+        expandidas++;
+        chave_incremental(busca, mapa, u, alvo_x, alvo_y, &k1, &k2);
+        if (chave_menor(topo.k1, topo.k2, k1, k2)) //chave velha (o Pac-Man andou): so reposiciona
+        {
+            poe_na_fila_incremental(busca, u, k1, k2);
+            continue;
+        }
+        if (busca->g[u] > busca->rhs[u]) //ficou mais perto: fixa a distancia e avisa os vizinhos
+        {
+            busca->g[u] = busca->rhs[u];
+            tira_da_fila_incremental(busca, u);
+        }
+        else //ficou mais longe: a distancia antiga nao vale mais, ela e os vizinhos sao recalculados
+        {
+            busca->g[u] = DISTANCIA_INFINITA;
+            atualiza_celula_incremental(busca, mapa, u, alvo_x, alvo_y);
+        }
+        for (int d = 0; d < 4; d++)
+        {
+            int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+            if (!eh_parede(mapa, nx, ny))
+                atualiza_celula_incremental(busca, mapa, INDICE_CELULA(mapa, nx, ny), alvo_x, alvo_y);
+        }
+    }
+    return expandidas;
+}
+
+//Volta do Pac-Man para a raiz pelo vizinho de menor g (no empate, o mais perto do monstro) procurando a celula do monstro. Se ela esta
+//no caminho, retorna a celula por onde o caminho chegou nela: o passo do monstro. Retorna -1 se o monstro nao esta no caminho.
+int celula_seguinte_incremental(const BUSCA_INCREMENTAL *busca, const BITBOARDS_MAPA *mapa, int alvo, int origem_x, int origem_y)
+{
+    int origem = INDICE_CELULA(mapa, origem_x, origem_y), celula = alvo, anterior = -1;
+    if (busca->g[alvo] >= DISTANCIA_INFINITA) return -1;
+    while (celula != origem)
+    {
+        if (celula == busca->raiz) return -1;
+        int x = celula % mapa->largura, y = celula / mapa->largura, proxima = -1, perto = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            int nx = x + direcoes[d][0], ny = y + direcoes[d][1];
+            if (eh_parede(mapa, nx, ny)) continue;
+            int vizinha = INDICE_CELULA(mapa, nx, ny), h = heuristica(nx, ny, origem_x, origem_y);
+            if (busca->g[vizinha] != busca->g[celula] - 1) continue;
+            if (proxima < 0 || h < perto)
+            {
+                proxima = vizinha;
+                perto = h;
+            }
+        }
+        if (proxima < 0) return -1;
+        anterior = celula;
+        celula = proxima;
+    }
+    return anterior;
+}
+
+//Passo de um monstro com a busca incremental. Na primeira vez (ou depois de invalida_buscas_incrementais) a busca comeca do zero, com a
+//raiz na celula do monstro; depois, se o Pac-Man mudou de celula so km cresce e a busca expande o que falta ate a celula nova dele. O passo
+//e o proximo do caminho minimo da raiz ate o Pac-Man; se o monstro saiu desse caminho, a busca recomeca com a raiz nele.
+//Retorna 1 se encontrou caminho e 0 caso contrario (nesse caso *dx = *dy = 0, como em busca_a_estrela).
+int passo_incremental(MEMORIA_INCREMENTAL *incremental, BUSCA_INCREMENTAL *busca, const BITBOARDS_MAPA *mapa,
+                      int origem_x, int origem_y, int alvo_x, int alvo_y, int *dx, int *dy)
+{
+    int alvo = INDICE_CELULA(mapa, alvo_x, alvo_y), origem = INDICE_CELULA(mapa, origem_x, origem_y), seguinte = -1;
+    *dx = 0;
+    *dy = 0;
+    if (origem == alvo) return 1;
+
+    if (busca->iniciada)
+    {
+        busca->km += heuristica(busca->ultimo_x, busca->ultimo_y, alvo_x, alvo_y);
+        busca->ultimo_x = alvo_x;
+        busca->ultimo_y = alvo_y;
+        int expandidas = calcula_busca_incremental(busca, mapa, alvo_x, alvo_y);
+        incremental->nos_expandidos += expandidas;
+        incremental->nos_ultimo_passo += expandidas;
+        seguinte = celula_seguinte_incremental(busca, mapa, alvo, origem_x, origem_y);
+        if (seguinte >= 0) incremental->reaproveitadas++;
+    }
+    if (seguinte < 0) //primeira busca ou monstro fora do caminho: recomeca com a raiz no monstro
+    {
+        size_t celulas = (size_t)CELULAS_MAPA(mapa);
+        for (size_t c = 0; c < celulas; c++)
+        {
+            busca->g[c] = busca->rhs[c] = DISTANCIA_INFINITA;
+            busca->posicao_fila[c] = -1;
+        }
+        busca->tamanho_fila = 0;
+        busca->km = 0;
+        busca->raiz = origem;
+        busca->rhs[origem] = 0;
+        poe_na_fila_incremental(busca, origem, heuristica(origem_x, origem_y, alvo_x, alvo_y), 0);
+        busca->ultimo_x = alvo_x;
+        busca->ultimo_y = alvo_y;
+        busca->iniciada = 1;
+        incremental->reiniciadas++;
+        int expandidas = calcula_busca_incremental(busca, mapa, alvo_x, alvo_y);
+        incremental->nos_expandidos += expandidas;
+        incremental->nos_ultimo_passo += expandidas;
+        seguinte = celula_seguinte_incremental(busca, mapa, alvo, origem_x, origem_y);
+    }
+    if (incremental->nos_ultimo_passo > incremental->pico_nos_passo)
+        incremental->pico_nos_passo = incremental->nos_ultimo_passo;
+    if (seguinte < 0) return 0; //Pac-Man inalcancavel
+    *dx = seguinte % mapa->largura - origem_x;
+    *dy = seguinte / mapa->largura - origem_y;
+    return 1;
+}
+
+//Threads que dividem as decisoes dos monstros com a thread do jogo (ver decide_monstros). Cada auxiliar tem a propria memoria de trabalho
+//das buscas (arena do A* e memoria do HPA*) e os proprios contadores, somados nos do jogo no fim de cada passo; o que e guardado por monstro
+//(caminho do HPA*, busca incremental) so e mexido pela thread que pegou aquele monstro. As threads ficam dormindo entre os passos.
+#define MAXIMO_THREADS_IA 16
+#define MONSTROS_POR_TAREFA 16 //monstros que uma thread pega de cada vez
+#define MINIMO_MONSTROS_PARALELO 64 //com menos monstros acordar as threads custa mais que as buscas
+typedef struct auxiliar_ia
+{
+    struct equipe_ia *equipe;
+    pthread_t thread;
+    long rodada; //ultima rodada que o auxiliar executou
+    ARENA_NODES arena;
+    MEMORIA_HPA hpa; //so a memoria de trabalho e os contadores (os caminhos sao os do jogo)
+    MEMORIA_INCREMENTAL incremental; //so os contadores (as buscas sao as do jogo)
+    MEMORIA_JOGO memoria; //vetores da arena
+    int largura, altura; //para que mapa a arena foi repartida (0 = ainda nao foi)
+} AUXILIAR_IA;
+
+typedef struct equipe_ia
+{
+    AUXILIAR_IA auxiliares[MAXIMO_THREADS_IA - 1];
+    int num_auxiliares;
+    pthread_mutex_t trava;
+    pthread_cond_t comecou, terminou;
+    long rodada; //passos dos monstros entregues a equipe (cada auxiliar espera a rodada mudar)
+    int pendentes; //auxiliares que ainda nao terminaram a rodada atual
+    int encerrar;
+    JOGO *jogo; //jogo e modo da rodada atual
+    int incremental;
+    atomic_int proximo; //primeiro monstro da proxima tarefa
+} EQUIPE_IA;
+
+//Relogio de parede em segundos (clock() mede tempo de CPU somado de todas as threads, que nao serve aqui)
+double agora_segundos(void)
+{
+    struct timespec agora;
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec + agora.tv_nsec / 1e9;
+}
+
+int numero_de_nucleos(void)
+{
+#ifdef _WIN32
+    return pthread_num_processors_np();
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+//Escolhe o passo do monstro i (em decisao_dx e decisao_dy) com a memoria de trabalho e os contadores recebidos. So le a posicao dele e a
+//do Pac-Man, e so mexe no que e guardado para ele: as decisoes de todos os monstros podem ser tomadas em qualquer ordem e em qualquer thread.
+void decide_monstro(JOGO *jogo, ARENA_NODES *arena, MEMORIA_HPA *hpa, MEMORIA_INCREMENTAL *contadores, int incremental, int i)
+{
+    MONSTROS *monstros = &jogo->monstros;
+    int x = monstros->x[i], y = monstros->y[i];
+    int *dx = &jogo->decisao_dx[i], *dy = &jogo->decisao_dy[i];
+    *dx = *dy = 0; //iniciando parado
+
+    //Com a tabela de rotas ou o campo de fluxo o passo e so uma consulta, e a busca incremental conserta a do passo anterior.
+    //Sem tabela (mapas grandes) vale o HPA*, e o A* fica como alternativa caso nem o grafo exista
+    if (jogo->modo_ia == IA_CAMPO_FLUXO)
+        consulta_campo_fluxo(&jogo->campo_fluxo, &jogo->mapa, x, y, dx, dy);
+    else if (jogo->modo_ia == IA_TABELA_ROTAS && jogo->tabela_rotas && jogo->tabela_rotas->pronta)
+        consulta_rota(jogo->tabela_rotas, x, y, jogo->pacman.x, jogo->pacman.y, dx, dy);
+    else if (incremental)
+        passo_incremental(contadores, &jogo->incremental.buscas[i], &jogo->mapa, x, y, jogo->pacman.x, jogo->pacman.y, dx, dy);
+    else if (jogo->modo_ia != IA_A_ESTRELA && jogo->grafo_hpa != NULL)
+        passo_hpa(jogo->grafo_hpa, arena, hpa, &jogo->mapa, &jogo->hpa.caminhos[i], x, y, jogo->pacman.x, jogo->pacman.y, dx, dy);
+    else
+        busca_a_estrela(arena, &jogo->mapa, x, y, jogo->pacman.x, jogo->pacman.y, dx, dy);
+}
+
+//Pega tarefas de MONSTROS_POR_TAREFA monstros da rodada atual ate acabarem os monstros
+void executa_tarefas_ia(EQUIPE_IA *equipe, ARENA_NODES *arena, MEMORIA_HPA *hpa, MEMORIA_INCREMENTAL *contadores)
+{
+    JOGO *jogo = equipe->jogo;
+    int inicio;
+    while ((inicio = atomic_fetch_add(&equipe->proximo, MONSTROS_POR_TAREFA)) < jogo->num_monstros)
+    {
+        int fim = inicio + MONSTROS_POR_TAREFA < jogo->num_monstros ? inicio + MONSTROS_POR_TAREFA : jogo->num_monstros;
+        for (int i = inicio; i < fim; i++)
+            decide_monstro(jogo, arena, hpa, contadores, equipe->incremental, i);
+    }
+}
+
+//Thread de um auxiliar: dorme ate a proxima rodada, pega tarefas junto com as outras e avisa quando nao sobrou nenhuma
+void *executa_auxiliar_ia(void *argumento)
+{
+    AUXILIAR_IA *auxiliar = (AUXILIAR_IA *)argumento;
+    EQUIPE_IA *equipe = auxiliar->equipe;
+    pthread_mutex_lock(&equipe->trava);
+    for (;;)
+    {
+        while (equipe->rodada == auxiliar->rodada && !equipe->encerrar)
+            pthread_cond_wait(&equipe->comecou, &equipe->trava);
+        if (equipe->encerrar) break;
+        auxiliar->rodada = equipe->rodada;
+        pthread_mutex_unlock(&equipe->trava);
+
+        executa_tarefas_ia(equipe, &auxiliar->arena, &auxiliar->hpa, &auxiliar->incremental);
+
+        pthread_mutex_lock(&equipe->trava);
+        if (--equipe->pendentes == 0)
+            pthread_cond_signal(&equipe->terminou);
+    }
+    pthread_mutex_unlock(&equipe->trava);
+    return NULL;
+}
+
+//Reparte o bloco de um auxiliar para a arena do A* de um mapa de largura x altura (so cresce, como o bloco do jogo). Retorna 0 se faltou memoria
+int prepara_auxiliar_ia(AUXILIAR_IA *auxiliar, int largura, int altura)
+{
+    DIVISOR_BLOCO divisor = {NULL, 0};
+    size_t celulas = (size_t)largura * altura;
+    if (auxiliar->memoria.bloco != NULL && auxiliar->largura == largura && auxiliar->altura == altura) return 1;
+
+    for (int passo = 0; passo < 2; passo++)
+    {
+        divisor.usado = 0;
+        divide_arena(&auxiliar->arena, &divisor, celulas);
+        if (passo == 0 && !cresce_memoria(&auxiliar->memoria, divisor.usado, "a arena de uma thread da IA"))
+        {
+            auxiliar->largura = 0;
+            return 0;
+        }
+        divisor.base = (unsigned char *)auxiliar->memoria.bloco;
+    }
+    memset(auxiliar->arena.bits_abertos, 0, PALAVRAS_BITS(celulas) * sizeof(unsigned int));
+    memset(auxiliar->arena.bits_fechados, 0, PALAVRAS_BITS(celulas) * sizeof(unsigned int));
+    auxiliar->largura = largura;
+    auxiliar->altura = altura;
+    return 1;
+}
+
+//Soma os contadores de um auxiliar nos do jogo e zera os dele
+void junta_contadores_ia(JOGO *jogo, AUXILIAR_IA *auxiliar)
+{
+    jogo->arena.buscas += auxiliar->arena.buscas;
+    jogo->arena.total_alocados += auxiliar->arena.total_alocados;
+    if (auxiliar->arena.pico > jogo->arena.pico)
+        jogo->arena.pico = auxiliar->arena.pico;
+    jogo->hpa.buscas_locais += auxiliar->hpa.buscas_locais;
+    jogo->hpa.reaproveitados += auxiliar->hpa.reaproveitados;
+    jogo->hpa.buscas_abstratas += auxiliar->hpa.buscas_abstratas;
+    jogo->hpa.nos_expandidos += auxiliar->hpa.nos_expandidos;
+    jogo->hpa.sem_caminho += auxiliar->hpa.sem_caminho;
+    jogo->incremental.reaproveitadas += auxiliar->incremental.reaproveitadas;
+    jogo->incremental.reiniciadas += auxiliar->incremental.reiniciadas;
+    jogo->incremental.nos_expandidos += auxiliar->incremental.nos_expandidos;
+    jogo->incremental.nos_ultimo_passo += auxiliar->incremental.nos_ultimo_passo;
+    auxiliar->arena.buscas = auxiliar->arena.total_alocados = 0;
+    auxiliar->hpa.buscas_locais = auxiliar->hpa.reaproveitados = auxiliar->hpa.buscas_abstratas = 0;
+    auxiliar->hpa.nos_expandidos = auxiliar->hpa.sem_caminho = 0;
+    auxiliar->incremental.reaproveitadas = auxiliar->incremental.reiniciadas = auxiliar->incremental.nos_expandidos = 0;
+    auxiliar->incremental.nos_ultimo_passo = 0;
+}
+
+//Decide o passo de todos os monstros antes de qualquer um andar (move_monstros aplica os passos depois, na ordem dos monstros).
+//Quando o jogo tem uma equipe e o passo e uma busca (nao uma consulta) com monstros suficientes, a thread do jogo acorda os auxiliares e
+//pega tarefas junto com eles; senao decide sozinha, um monstro depois do outro. Como cada decisao so depende do proprio monstro, o resultado
+//e o mesmo nos dois casos, com qualquer numero de threads.
+void decide_monstros(JOGO *jogo, int incremental)
+{
+    EQUIPE_IA *equipe = jogo->equipe;
+    int consulta = jogo->modo_ia == IA_CAMPO_FLUXO || (jogo->modo_ia == IA_TABELA_ROTAS && jogo->tabela_rotas && jogo->tabela_rotas->pronta);
+    int paralelo = equipe != NULL && !consulta && jogo->num_monstros >= MINIMO_MONSTROS_PARALELO;
+    for (int k = 0; paralelo && k < equipe->num_auxiliares; k++)
+        paralelo = prepara_auxiliar_ia(&equipe->auxiliares[k], jogo->mapa.largura, jogo->mapa.altura);
+    if (!paralelo)
+    {
+        for (int i = 0; i < jogo->num_monstros; i++)
+            decide_monstro(jogo, &jogo->arena, &jogo->hpa, &jogo->incremental, incremental, i);
+        return;
+    }
+
+    pthread_mutex_lock(&equipe->trava);
+    equipe->jogo = jogo;
+    equipe->incremental = incremental;
+    atomic_store(&equipe->proximo, 0);
+    equipe->pendentes = equipe->num_auxiliares;
+    equipe->rodada++;
+    pthread_cond_broadcast(&equipe->comecou);
+    pthread_mutex_unlock(&equipe->trava);
+
+    executa_tarefas_ia(equipe, &jogo->arena, &jogo->hpa, &jogo->incremental);
+
+    pthread_mutex_lock(&equipe->trava);
+    while (equipe->pendentes > 0)
+        pthread_cond_wait(&equipe->terminou, &equipe->trava);
+    pthread_mutex_unlock(&equipe->trava);
+
+    for (int k = 0; k < equipe->num_auxiliares; k++)
+        junta_contadores_ia(jogo, &equipe->auxiliares[k]);
+    if (jogo->incremental.nos_ultimo_passo > jogo->incremental.pico_nos_passo) //o pico e do passo inteiro, entao so fecha depois da soma
+        jogo->incremental.pico_nos_passo = jogo->incremental.nos_ultimo_passo;
+}
+
+//Acorda os auxiliares para sair, espera todos e devolve a memoria da equipe
+void encerra_equipe_ia(EQUIPE_IA *equipe)
+{
+    pthread_mutex_lock(&equipe->trava);
+    equipe->encerrar = 1;
+    pthread_cond_broadcast(&equipe->comecou);
+    pthread_mutex_unlock(&equipe->trava);
+    for (int k = 0; k < equipe->num_auxiliares; k++)
+    {
+        pthread_join(equipe->auxiliares[k].thread, NULL);
+        free(equipe->auxiliares[k].memoria.bloco);
+    }
+    pthread_mutex_destroy(&equipe->trava);
+    pthread_cond_destroy(&equipe->comecou);
+    pthread_cond_destroy(&equipe->terminou);
+    free(equipe);
+}
+
+//Faz o jogo decidir o passo dos monstros com "threads" threads contando a dele (ate MAXIMO_THREADS_IA; 1 = sem equipe, como antes).
+//Os auxiliares sao criados aqui e ficam com o jogo ate a proxima chamada ou libera_jogo. Retorna o numero de threads em uso.
+int define_threads_ia(JOGO *jogo, int threads)
+{
+    if (threads > MAXIMO_THREADS_IA) threads = MAXIMO_THREADS_IA;
+    if (jogo->equipe != NULL && jogo->equipe->num_auxiliares == threads - 1) return threads;
+    if (jogo->equipe != NULL)
+    {
+        encerra_equipe_ia(jogo->equipe);
+        jogo->equipe = NULL;
+    }
+    if (threads <= 1) return 1;
+
+    EQUIPE_IA *equipe = (EQUIPE_IA *)calloc(1, sizeof(EQUIPE_IA));
+    if (equipe == NULL) return 1;
+    pthread_mutex_init(&equipe->trava, NULL);
+    pthread_cond_init(&equipe->comecou, NULL);
+    pthread_cond_init(&equipe->terminou, NULL);
+    for (int k = 0; k < threads - 1; k++)
+    {
+        equipe->auxiliares[k].equipe = equipe;
+        if (pthread_create(&equipe->auxiliares[k].thread, NULL, executa_auxiliar_ia, &equipe->auxiliares[k]) != 0)
+        {
+            printf("Erro: nao foi possivel criar a thread %d da IA dos monstros\n", k + 2);
+            break;
+        }
+        equipe->num_auxiliares++;
+    }
+    if (equipe->num_auxiliares == 0)
+    {
+        encerra_equipe_ia(equipe);
+        return 1;
+    }
+    jogo->equipe = equipe;
+    return equipe->num_auxiliares + 1;
+}
+
+//funo para atualizar o movimento dos monstros em direo ao Pac-Man usando o algoritmo A* e fazendo alguns outros tratamentos
+void move_monstros(JOGO *jogo, float deltaTime)
+{
+    POS_PACMAN *pacman = &jogo->pacman;
+    MONSTROS *monstros = &jogo->monstros;
+
+    jogo->timer_monstros += deltaTime;
+    if (jogo->dificuldade_contador >= TEMPO_DIFICULDADE)
+    {
+        jogo->dificuldade_contador = 0;
+        controla_dificuldade(jogo);
+    }
+
+    if (jogo->timer_monstros >= jogo->vel_monstros) //Mesma logica do move_pacman
+    {
+        jogo->dificuldade_contador++;
+        jogo->passos_monstros++;
+        if (jogo->modo_ia == IA_CAMPO_FLUXO)
+            atualiza_campo_fluxo(&jogo->campo_fluxo, &jogo->mapa, pacman->x, pacman->y); //uma BFS para todos os monstros
+        int incremental = jogo->modo_ia == IA_INCREMENTAL && prepara_busca_incremental(jogo);
+        if (incremental)
+        {
+            jogo->incremental.passos++;
+            jogo->incremental.nos_ultimo_passo = 0;
+        }
+
+        decide_monstros(jogo, incremental); //todas as decisoes primeiro (em varias threads, se o jogo tiver uma equipe)
+
+        //Depois os passos, sempre um monstro depois do outro na ordem dos indices: a grade de ocupacao, o desvio (que sorteia) e a colisao
+        //com o Pac-Man dao o mesmo resultado com qualquer numero de threads
+        for (int i = 0; i < jogo->num_monstros; i++) //A operacao para mover os monstros ira se repetir para todos os monstros
+        {
+            int melhor_dx = jogo->decisao_dx[i], melhor_dy = jogo->decisao_dy[i];
+            //Legenda
+
+            //melhor_dx = 1 significa mover para a direita,
+            //melhor_dx = -1 significa mover para a esquerda,
+            //melhor_dx = 0 signidica que o monstro no precisa se mover no eixo x
+
+            //melhor_dy = 1 significa mover para baixo,
+            //melhor_dy = -1 significa mover para cima.
+            //melhor_dy = 0 signidica que o monstro no precisa se mover no eixo y
+
+            if ((melhor_dx != 0 || melhor_dy != 0) && monstro_na_celula(jogo, monstros->x[i] + melhor_dx, monstros->y[i] + melhor_dy) >= 0)
+                desvia_monstro(jogo, monstros->x[i], monstros->y[i], &melhor_dx, &melhor_dy); //celula ocupada por outro monstro
+
+            monstros->x_anterior[i] = monstros->x[i];
+            monstros->y_anterior[i] = monstros->y[i];
+            monstros->dx[i] = melhor_dx; //atualiza direcao do monstro em x
+            monstros->dy[i] = melhor_dy; //atualiza direcao do monstro em y
+            desocupa_celula(jogo, i);
+            monstros->x[i] += monstros->dx[i]; //atualiza posicao do monstro em x
+            monstros->y[i] += monstros->dy[i]; //atualiza posicao do monstro em y
+            ocupa_celula(jogo, i);
+
+            if (monstros->x[i] == pacman->x && monstros->y[i] == pacman->y) //se a posicao atual do monstro for igual a do pacman
+            {
+                trata_colisao(jogo); //chama a funcao  trata colisao
+                return;
+            }
+        }
+
+        jogo->timer_monstros = 0.0f; //Zera timer
+    }
+}
+
+//Zera todo o estado da simulacao (timers, contadores, buffers da IA) antes de comecar ou carregar um jogo.
+//Os blocos de memoria ficam com o jogo para serem reaproveitados pelo proximo mapa (ver prepara_memoria_jogo); o jogo tem que ter sido
+//zerado (memset, calloc ou variavel global) antes do primeiro inicia_jogo.
+void inicia_jogo(JOGO *jogo)
+{
+    MEMORIA_JOGO memoria = jogo->memoria, memoria_incremental = jogo->incremental.memoria, memoria_monstros = jogo->monstros.memoria;
+    struct equipe_ia *equipe = jogo->equipe;
+    memset(jogo, 0, sizeof(*jogo));
+    jogo->equipe = equipe; //as threads da IA ficam com o jogo ate libera_jogo
+    jogo->memoria = memoria;
+    jogo->incremental.memoria = memoria_incremental; //repartido de novo no primeiro passo (prepara_busca_incremental)
+    jogo->monstros.memoria = memoria_monstros; //repartido de novo em carrega_mapa (prepara_monstros)
+    jogo->vel_monstros = VEL_MONSTROS_INICIAL;
+    jogo->modo_ia = IA_TABELA_ROTAS;
+    jogo->estado = JOGO_EM_ANDAMENTO;
+}
+
+//Comeca um jogo novo na fase indicada. Com a mesma semente, a mesma fase e as mesmas entradas o jogo se repete exatamente igual
+void novo_jogo(JOGO *jogo, unsigned long long semente, int fase)
+{
+    inicia_jogo(jogo);
+    jogo->semente = semente;
+    semeia(&jogo->rng, semente);
+    jogo->player.vida = 3;
+    jogo->player.pontuacao = 0;
+    jogo->player.fase = fase;
+    jogo->player.dificuldade = 1;
+    carrega_mapa(jogo, jogo->player.fase);
+}
+
+//Comeca o jogo em uma dificuldade maior: cada nivel acima do 1 deixa os monstros 0.05 s mais rapidos, como em controla_dificuldade
+void define_dificuldade(JOGO *jogo, int dificuldade)
+{
+    jogo->player.dificuldade = dificuldade;
+    jogo->vel_monstros = VEL_MONSTROS_INICIAL - 0.05f * (dificuldade - 1);
+}
+
+//Avanca a simulacao em um tick de duracao fixa (DT_SIMULACAO) aplicando o comando do jogador naquele tick.
+//Nao usa nada da raylib: e o mesmo codigo que roda na janela do jogo e no modo headless.
+void passo_simulacao(JOGO *jogo, int entrada)
+{
+    if (jogo->estado != JOGO_EM_ANDAMENTO) return;
+
+    if (entrada != ENTRADA_NENHUMA) // Mudando a direo de movimento do pacman
+    {
+        jogo->pacman.dx = direcoes[entrada - 1][0];
+        jogo->pacman.dy = direcoes[entrada - 1][1];
+    }
+
+    // Atualiza o movimento do Pac-Man e dos monstros
+    move_pacman(jogo, DT_SIMULACAO);
+    move_monstros(jogo, DT_SIMULACAO);
+    jogo->ticks++;
+
+    //FLUXO PRA QUANDO O JOGADOR MORRE
+    if (jogo->player.vida == 0)
+    {
+        jogo->estado = JOGO_PERDIDO;
+        return;
+    }
+
+    //FLUXO PRA QUANDO JOGADOR FINALIZA FASE
+    if (verifica_fim_de_fase(jogo))
+    {
+        jogo->player.fase++;
+        if (jogo->player.fase > num_fases()) //VERIFICA SE JOGADOR FINALIZOU O JOGO
+        {
+            jogo->estado = JOGO_VENCIDO;
+        }
+        else
+        {
+            jogo->player.dificuldade = 1;
+            jogo->vel_monstros = VEL_MONSTROS_INICIAL;
+            carrega_mapa(jogo, jogo->player.fase);
+        }
+    }
+}
+
+//Mistura os 4 bytes de um valor no checksum (FNV-1a)
+unsigned int mistura_checksum(unsigned int hash, int valor)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        hash ^= (unsigned int)(valor >> (8 * i)) & 0xFFu;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//Checksum do resultado de um jogo: situacao, pontos, vidas, fase, ticks e a posicao do Pac-Man e de cada monstro
+unsigned int checksum_jogo(const JOGO *jogo)
+{
+    unsigned int hash = 2166136261u;
+    hash = mistura_checksum(hash, jogo->estado);
+    hash = mistura_checksum(hash, jogo->player.pontuacao);
+    hash = mistura_checksum(hash, jogo->player.vida);
+    hash = mistura_checksum(hash, jogo->player.fase);
+    hash = mistura_checksum(hash, (int)jogo->ticks);
+    hash = mistura_checksum(hash, jogo->pacman.x);
+    hash = mistura_checksum(hash, jogo->pacman.y);
+    for (int i = 0; i < jogo->num_monstros; i++)
+    {
+        hash = mistura_checksum(hash, jogo->monstros.x[i]);
+        hash = mistura_checksum(hash, jogo->monstros.y[i]);
+    }
+    return hash;
+}
+
+//Comeca a gravar o replay de um jogo recem iniciado com novo_jogo (o replay deve comecar zerado)
+void inicia_replay(REPLAY *replay, const JOGO *jogo)
+{
+    memset(&replay->cabecalho, 0, sizeof(replay->cabecalho));
+    memcpy(replay->cabecalho.assinatura, "PMRP", 4);
+    replay->cabecalho.versao = VERSAO_REPLAY;
+    replay->cabecalho.semente = jogo->semente;
+    replay->cabecalho.fase_inicial = jogo->player.fase;
+    replay->cabecalho.modo_ia = jogo->modo_ia;
+}
+
+//Grava a entrada de mais um tick (chamar junto com cada passo_simulacao). Retorna 0 se faltou memoria: o replay fica incompleto
+//e as proximas entradas nao sao gravadas
+int grava_entrada_replay(REPLAY *replay, int entrada)
+{
+    int n = replay->cabecalho.num_trechos;
+    if (replay->incompleto) return 0;
+    if (n > 0 && (replay->trechos[n - 1] & 7) == entrada && (replay->trechos[n - 1] >> 3) < MAXIMO_REPETICOES_TRECHO - 1)
+    {
+        replay->trechos[n - 1] += 1 << 3; //mais uma repeticao da mesma entrada
+    }
+    else
+    {
+        if (n == replay->capacidade)
+        {
+            int capacidade = replay->capacidade ? replay->capacidade * 2 : 256;
+            unsigned short *trechos = (unsigned short *)realloc(replay->trechos, capacidade * sizeof(unsigned short));
+            if (trechos == NULL)
+            {
+                replay->incompleto = 1;
+                return 0;
+            }
+            replay->trechos = trechos;
+            replay->capacidade = capacidade;
+        }
+        replay->trechos[replay->cabecalho.num_trechos++] = (unsigned short)entrada;
+    }
+    replay->cabecalho.num_ticks++; //so conta o tick depois que a entrada dele foi guardada
+    return 1;
+}
+
+//Guarda no replay o resultado do jogo, que sera conferido quando ele for executado de novo
+void finaliza_replay(REPLAY *replay, const JOGO *jogo)
+{
+    replay->cabecalho.pontuacao_final = jogo->player.pontuacao;
+    replay->cabecalho.vida_final = jogo->player.vida;
+    replay->cabecalho.fase_final = jogo->player.fase;
+    replay->cabecalho.checksum = checksum_jogo(jogo);
+}
+
+//Grava o replay no arquivo. Retorna 1 se gravou tudo; um replay incompleto nao e gravado
+int salva_replay(const REPLAY *replay, const char *nome_arq)
+{
+    if (replay->incompleto)
+    {
+        printf("Erro: faltou memoria durante a gravacao, o replay %s nao foi gravado\n", nome_arq);
+        return 0;
+    }
+    FILE *arquivo = fopen(nome_arq, "wb");
+    int ok = arquivo != NULL && fwrite(&replay->cabecalho, sizeof(replay->cabecalho), 1, arquivo) == 1
+             && (int)fwrite(replay->trechos, sizeof(unsigned short), replay->cabecalho.num_trechos, arquivo) == replay->cabecalho.num_trechos;
+    if (arquivo != NULL) ok = fclose(arquivo) == 0 && ok;
+    if (!ok) printf("Erro ao gravar o replay %s\n", nome_arq);
+    return ok;
+}
+
+int carrega_replay(REPLAY *replay, const char *nome_arq)
+{
+    FILE *arquivo = fopen(nome_arq, "rb");
+    if (arquivo == NULL) return 0;
+    int ok = fread(&replay->cabecalho, sizeof(replay->cabecalho), 1, arquivo) == 1
+             && memcmp(replay->cabecalho.assinatura, "PMRP", 4) == 0
+             && replay->cabecalho.versao == VERSAO_REPLAY
+             && replay->cabecalho.fase_inicial >= 1 && replay->cabecalho.fase_inicial <= num_fases()
+             && replay->cabecalho.modo_ia >= IA_A_ESTRELA && replay->cabecalho.modo_ia <= IA_INCREMENTAL
+             && replay->cabecalho.num_ticks >= 0
+             && replay->cabecalho.num_trechos >= 0 && replay->cabecalho.num_trechos <= replay->cabecalho.num_ticks;
+    if (ok)
+    {
+        replay->capacidade = replay->cabecalho.num_trechos;
+        replay->trechos = (unsigned short *)malloc(((size_t)replay->capacidade + 1) * sizeof(unsigned short));
+        ok = replay->trechos != NULL
+             && (int)fread(replay->trechos, sizeof(unsigned short), replay->cabecalho.num_trechos, arquivo) == replay->cabecalho.num_trechos;
+    }
+    fclose(arquivo);
+
+    //as entradas indexam direcoes[] em passo_simulacao: um trecho estragado nao pode chegar a simulacao
+    long long ticks = 0;
+    for (int i = 0; ok && i < replay->cabecalho.num_trechos; i++)
+    {
+        ok = (replay->trechos[i] & 7) <= ENTRADA_CIMA;
+        ticks += (replay->trechos[i] >> 3) + 1;
+    }
+    return ok && ticks == replay->cabecalho.num_ticks;
+}
+
+void libera_replay(REPLAY *replay)
+{
+    free(replay->trechos);
+    replay->trechos = NULL;
+    replay->capacidade = 0;
+}
+
+//Re-simula o jogo gravado, sem janela e o mais rapido possivel. Retorna 1 se o resultado bateu com o gravado.
+int executa_replay(const REPLAY *replay, JOGO *jogo)
+{
+    novo_jogo(jogo, replay->cabecalho.semente, replay->cabecalho.fase_inicial);
+    jogo->modo_ia = replay->cabecalho.modo_ia;
+    for (int i = 0; i < replay->cabecalho.num_trechos; i++)
+    {
+        int entrada = replay->trechos[i] & 7;
+        int repeticoes = (replay->trechos[i] >> 3) + 1;
+        for (int r = 0; r < repeticoes; r++)
+            passo_simulacao(jogo, entrada);
+    }
+    return checksum_jogo(jogo) == replay->cabecalho.checksum
+           && jogo->player.pontuacao == replay->cabecalho.pontuacao_final
+           && jogo->ticks == replay->cabecalho.num_ticks;
+}
+
+//Poe um comando na fila (so o produtor chama). Retorna 0 se a fila estava cheia
+int poe_comando(FILA_COMANDOS *fila, int comando)
+{
+    unsigned int fim = atomic_load_explicit(&fila->fim, memory_order_relaxed);
+    if (fim - atomic_load_explicit(&fila->inicio, memory_order_acquire) == TAMANHO_FILA_COMANDOS) return 0;
+    fila->comandos[fim % TAMANHO_FILA_COMANDOS] = (unsigned char)comando;
+    atomic_store_explicit(&fila->fim, fim + 1, memory_order_release);
+    return 1;
+}
+
+//Tira o comando mais antigo da fila (so o consumidor chama). Retorna -1 se ela estava vazia
+int tira_comando(FILA_COMANDOS *fila)
+{
+    unsigned int inicio = atomic_load_explicit(&fila->inicio, memory_order_relaxed);
+    if (inicio == atomic_load_explicit(&fila->fim, memory_order_acquire)) return -1;
+    int comando = fila->comandos[inicio % TAMANHO_FILA_COMANDOS];
+    atomic_store_explicit(&fila->inicio, inicio + 1, memory_order_release);
+    return comando;
+}
+
+//O mesmo checksum de checksum_jogo, calculado com o que esta no retrato
+unsigned int checksum_retrato(const RETRATO_JOGO *retrato)
+{
+    unsigned int hash = 2166136261u;
+    hash = mistura_checksum(hash, retrato->estado);
+    hash = mistura_checksum(hash, retrato->player.pontuacao);
+    hash = mistura_checksum(hash, retrato->player.vida);
+    hash = mistura_checksum(hash, retrato->player.fase);
+    hash = mistura_checksum(hash, (int)retrato->ticks);
+    hash = mistura_checksum(hash, retrato->pacman.x);
+    hash = mistura_checksum(hash, retrato->pacman.y);
+    for (int i = 0; i < retrato->num_monstros; i++)
+    {
+        hash = mistura_checksum(hash, retrato->x[i]);
+        hash = mistura_checksum(hash, retrato->y[i]);
+    }
+    return hash;
+}
+
+//Reparte o bloco do retrato para o mapa e os monstros do jogo. So realoca quando precisa crescer; um mapa de outro tamanho faz o proximo
+//retrato copiar o mapa inteiro. Retorna 0 se faltou memoria.
+int prepara_retrato(RETRATO_JOGO *retrato, const JOGO *jogo)
+{
+    const BITBOARDS_MAPA *mapa = &jogo->mapa;
+    DIVISOR_BLOCO divisor = {NULL, 0};
+    if (retrato->memoria.bloco != NULL && retrato->mapa.largura == mapa->largura && retrato->mapa.altura == mapa->altura
+        && jogo->num_monstros <= retrato->capacidade_monstros)
+        return 1;
+
+    for (int passo = 0; passo < 2; passo++)
+    {
+        int **vetores[4] = {&retrato->x, &retrato->y, &retrato->x_anterior, &retrato->y_anterior};
+        divisor.usado = 0;
+        LINHA_BITS *bitboards = (LINHA_BITS *)reserva_bloco(&divisor, tamanho_bitboards(mapa->largura, mapa->altura) * sizeof(LINHA_BITS));
+        for (int v = 0; v < 4; v++)
+            *vetores[v] = (int *)reserva_bloco(&divisor, (size_t)jogo->num_monstros * sizeof(int));
+        aponta_bitboards(&retrato->mapa, bitboards, mapa->largura, mapa->altura);
+
+        if (passo == 0 && !cresce_memoria(&retrato->memoria, divisor.usado, "o retrato do jogo"))
+        {
+            memset(&retrato->mapa, 0, sizeof(retrato->mapa));
+            retrato->capacidade_monstros = 0;
+            return 0;
+        }
+        divisor.base = (unsigned char *)retrato->memoria.bloco;
+    }
+    retrato->capacidade_monstros = jogo->num_monstros;
+    retrato->versao_mapa = 0; //o mapa do retrato esta vazio
+    return 1;
+}
+
+//Copia o jogo para o retrato da simulacao e publica ele como o ultimo completo. A fila de celulas alteradas do jogo marca as linhas que
+//mudaram, e so elas sao copiadas de novo para o retrato (que pode estar alguns retratos atrasado); um mapa novo e copiado inteiro.
+void tira_retrato(SIMULACAO *sim, float ms_simulacao)
+{
+    JOGO *jogo = sim->jogo;
+    const BITBOARDS_MAPA *mapa = &jogo->mapa;
+    RETRATO_JOGO *retrato = &sim->retratos[sim->escrita];
+
+    if (jogo->mapa_alterado || sim->linhas < mapa->altura)
+    {
+        if (sim->linhas < mapa->altura)
+        {
+            unsigned int *versao_linha = (unsigned int *)realloc(sim->versao_linha, (size_t)mapa->altura * sizeof(unsigned int));
+            if (versao_linha == NULL) return; //fica sem retrato novo ate ter memoria
+            sim->versao_linha = versao_linha;
+            sim->linhas = mapa->altura;
+        }
+        memset(sim->versao_linha, 0, (size_t)mapa->altura * sizeof(unsigned int));
+        sim->versao_linhas = 0;
+        if (++sim->versao_mapa == 0) sim->versao_mapa = 1; //0 e o mapa vazio de prepara_retrato
+        jogo->mapa_alterado = 0;
+    }
+    if (jogo->num_celulas_alteradas > 0)
+    {
+        sim->versao_linhas++;
+        for (int k = 0; k < jogo->num_celulas_alteradas; k++)
+        {
+            sim->versao_linha[jogo->celulas_alteradas[k] / mapa->largura] = sim->versao_linhas;
+            desliga_bit(jogo->celula_na_fila, jogo->celulas_alteradas[k]);
+        }
+        jogo->num_celulas_alteradas = 0;
+    }
+    if (!prepara_retrato(retrato, jogo)) return;
+
+    size_t palavras = (size_t)mapa->altura * mapa->palavras;
+    if (retrato->versao_mapa != sim->versao_mapa)
+    {
+        memcpy(retrato->mapa.paredes, mapa->paredes, 4 * palavras * sizeof(LINHA_BITS)); //os 4 bitboards estao em sequencia
+    }
+    else
+    {
+        for (int y = 0; y < mapa->altura; y++)
+        {
+            if (sim->versao_linha[y] <= retrato->versao_linhas) continue;
+            for (int b = 0; b < 4; b++)
+                memcpy(retrato->mapa.paredes + b * palavras + (size_t)y * mapa->palavras, mapa->paredes + b * palavras + (size_t)y * mapa->palavras,
+                       mapa->palavras * sizeof(LINHA_BITS));
+        }
+    }
+    retrato->versao_mapa = sim->versao_mapa;
+    retrato->versao_linhas = sim->versao_linhas;
+    retrato->paredes_alteradas = jogo->paredes_alteradas;
+    retrato->num_coletaveis = jogo->num_coletaveis;
+
+    retrato->pacman = jogo->pacman;
+    retrato->player = jogo->player;
+    retrato->estado = jogo->estado;
+    retrato->ticks = jogo->ticks;
+    retrato->vel_monstros = jogo->vel_monstros;
+    retrato->timer_pacman = jogo->timer_pacman;
+    retrato->timer_monstros = jogo->timer_monstros;
+    retrato->tempo_pendente = sim->acumulador;
+    retrato->instante = sim->ultimo_instante;
+    retrato->ms_simulacao = ms_simulacao;
+    retrato->buscas_a_estrela = jogo->arena.buscas;
+    retrato->nodes_a_estrela = jogo->arena.total_alocados;
+    retrato->bfs_fluxo = jogo->campo_fluxo.calculos;
+    retrato->buscas_hpa = jogo->hpa.buscas_abstratas;
+    retrato->buscas_consertadas = jogo->incremental.reaproveitadas;
+    retrato->buscas_do_zero = jogo->incremental.reiniciadas;
+    retrato->num_monstros = jogo->num_monstros;
+    memcpy(retrato->x, jogo->monstros.x, (size_t)jogo->num_monstros * sizeof(int));
+    memcpy(retrato->y, jogo->monstros.y, (size_t)jogo->num_monstros * sizeof(int));
+    memcpy(retrato->x_anterior, jogo->monstros.x_anterior, (size_t)jogo->num_monstros * sizeof(int));
+    memcpy(retrato->y_anterior, jogo->monstros.y_anterior, (size_t)jogo->num_monstros * sizeof(int));
+    if (sim->conferir) retrato->checksum = checksum_retrato(retrato);
+
+    //publica: o retrato escrito vira o pronto, e o pronto antigo (que o desenho nao pegou) volta a ser escrito
+    sim->escrita = atomic_exchange(&sim->pronto, sim->escrita | RETRATO_NOVO) & ~RETRATO_NOVO;
+}
+
+//O retrato completo mais novo. Continua valendo (e sem mudar) ate a proxima chamada, que devolve ele para a simulacao
+const RETRATO_JOGO *pega_retrato(SIMULACAO *sim)
+{
+    if (atomic_load(&sim->pronto) & RETRATO_NOVO)
+        sim->leitura = atomic_exchange(&sim->pronto, sim->leitura) & ~RETRATO_NOVO;
+    return &sim->retratos[sim->leitura];
+}
+
+//Uma volta da simulacao: soma o tempo desde a ultima volta no acumulador, aplica as teclas que chegaram pela fila e executa os ticks que
+//couberem (como a tela do jogo fazia), e tira um retrato se algum tick rodou. Retorna quantos ticks rodaram.
+int avanca_simulacao(SIMULACAO *sim)
+{
+    JOGO *jogo = sim->jogo;
+    double inicio = agora_segundos();
+    int comando, ticks = 0;
+
+    if (sim->sem_relogio) //teste: cada comando e a entrada de um tick
+    {
+        while (jogo->estado == JOGO_EM_ANDAMENTO && (comando = tira_comando(&sim->entradas)) >= 0)
+        {
+            passo_simulacao(jogo, comando);
+            ticks++;
+        }
+        sim->ultimo_instante = agora_segundos();
+    }
+    else
+    {
+        sim->acumulador += (float)(inicio - sim->ultimo_instante);
+        sim->ultimo_instante = inicio;
+        if (sim->acumulador > MAXIMO_TICKS_POR_QUADRO * DT_SIMULACAO) sim->acumulador = MAXIMO_TICKS_POR_QUADRO * DT_SIMULACAO;
+        while ((comando = tira_comando(&sim->entradas)) >= 0)
+            if (comando != ENTRADA_NENHUMA) sim->entrada_pendente = comando;
+        while (sim->acumulador >= DT_SIMULACAO && jogo->estado == JOGO_EM_ANDAMENTO)
+        {
+            if (sim->replay && !grava_entrada_replay(sim->replay, sim->entrada_pendente))
+                sim->replay = NULL; //sem memoria: para de gravar, e salva_replay recusa o replay incompleto
+            passo_simulacao(jogo, sim->entrada_pendente);
+            sim->entrada_pendente = ENTRADA_NENHUMA; //a tecla vale so para o primeiro tick
+            sim->acumulador -= DT_SIMULACAO;
+            ticks++;
+        }
+    }
+    if (ticks > 0) tira_retrato(sim, (float)((agora_segundos() - inicio) * 1000.0));
+    return ticks;
+}
+
+void dorme_segundos(double segundos)
+{
+    struct timespec espera;
+    espera.tv_sec = (time_t)segundos;
+    espera.tv_nsec = (long)((segundos - (double)espera.tv_sec) * 1e9);
+    nanosleep(&espera, NULL);
+}
+
+//Thread da simulacao: avanca o jogo e dorme ate o proximo tick. Termina quando pedem (para_simulacao) ou quando o jogo acaba, depois de
+//publicar o retrato do fim
+void *executa_simulacao(void *argumento)
+{
+    SIMULACAO *sim = (SIMULACAO *)argumento;
+    while (atomic_load(&sim->rodando) && sim->jogo->estado == JOGO_EM_ANDAMENTO)
+    {
+        int ticks = avanca_simulacao(sim);
+        if (!sim->sem_relogio)
+            dorme_segundos(DT_SIMULACAO - sim->acumulador);
+        else if (ticks == 0)
+            dorme_segundos(0.0001); //fila vazia
+    }
+    return NULL;
+}
+
+//Comeca (ou retoma) a simulacao do jogo em uma thread propria. Tira um retrato antes, para o desenho ja ter o que mostrar. Se a thread
+//nao puder ser criada a simulacao continua valendo, mas quem a avanca e quem iniciou (avanca_simulacao a cada quadro).
+void inicia_simulacao(SIMULACAO *sim, JOGO *jogo, REPLAY *replay)
+{
+    if (sim->escrita == sim->leitura) //simulacao zerada: distribui os tres retratos
+    {
+        sim->escrita = 0;
+        sim->leitura = 1;
+        atomic_store(&sim->pronto, 2);
+    }
+    sim->jogo = jogo;
+    sim->replay = replay;
+    sim->ultimo_instante = agora_segundos();
+    tira_retrato(sim, 0.0f);
+    sim->ativa = 1;
+    atomic_store(&sim->rodando, 1);
+    sim->thread_ativa = pthread_create(&sim->thread, NULL, executa_simulacao, sim) == 0;
+    if (!sim->thread_ativa) printf("Erro ao iniciar a thread da simulacao: o jogo avanca junto com o desenho\n");
+}
+
+//Para a simulacao e espera a thread terminar: daqui ate o proximo inicia_simulacao quem chamou pode mexer no jogo
+void para_simulacao(SIMULACAO *sim)
+{
+    if (!sim->ativa) return;
+    atomic_store(&sim->rodando, 0);
+    if (sim->thread_ativa) pthread_join(sim->thread, NULL);
+    sim->thread_ativa = 0;
+    sim->ativa = 0;
+}
+
+//Descarta o tempo acumulado e as teclas que ainda nao viraram tick (com a simulacao parada): partida nova ou jogo carregado
+void descarta_entradas(SIMULACAO *sim)
+{
+    sim->acumulador = 0.0f;
+    sim->entrada_pendente = ENTRADA_NENHUMA;
+    while (tira_comando(&sim->entradas) >= 0)
+    {
+    }
+}
+
+//Para a simulacao e devolve a memoria dos retratos
+void libera_simulacao(SIMULACAO *sim)
+{
+    para_simulacao(sim);
+    for (int r = 0; r < 3; r++)
+        free(sim->retratos[r].memoria.bloco);
+    free(sim->versao_linha);
+    memset(sim, 0, sizeof(*sim));
+}
+
+
+#ifndef PACMAN_HEADLESS
+//Telas do jogo. Existe uma unica janela (e um unico contexto OpenGL, com a fonte e as texturas) durante todo o programa:
+//cada tela desenha um quadro por vez e trocar de tela e so mudar telas.tela, que vale a partir do quadro seguinte.
+#define TELA_MENU 0
+#define TELA_JOGO 1
+#define TELA_PAUSE 2
+#define TELA_FIM_DE_JOGO 3 //"Game Over!" ou "VOCE VENCEU!" por TEMPO_FIM_DE_JOGO segundos
+#define TELA_NOVO_HIGHSCORE 4
+#define TELA_HIGHSCORES 5
+#define TELA_SAIR 6
+#define TEMPO_FIM_DE_JOGO 2.0
+
+//Gravador de slots em segundo plano: salvar um slot no jogo e so um memcpy; a thread do gravador escreve o slot no disco depois,
+//entao o quadro nunca espera pelo arquivo. Ao iniciar o programa os slots sao lidos dos arquivos, e ao fechar o que falta e gravado.
+typedef struct gravador_slots
+{
+    SLOT_SAVE slots[NUM_SLOTS];
+    unsigned int pendentes; //bit i ligado = o slot i mudou e ainda nao foi gravado no disco
+    int encerrar;
+    int thread_ativa;
+    pthread_t thread;
+    pthread_mutex_t trava; //protege slots e pendentes entre o jogo e a thread
+    pthread_cond_t sinal;
+} GRAVADOR_SLOTS;
+
+GRAVADOR_SLOTS gravador = {.trava = PTHREAD_MUTEX_INITIALIZER, .sinal = PTHREAD_COND_INITIALIZER};
+SIMULACAO simulacao; //thread do jogo em andamento (ver tela_jogo)
+
+//Arquivo de cada slot: o slot 0 e o savegame do menu ("CARREGAR-JOGO"), os outros sao "slotN.bin"
+void nome_arquivo_slot(int slot, char *nome, size_t tamanho)
+{
+    if (slot == 0)
+        snprintf(nome, tamanho, "%s", ARQUIVO_SAVE);
+    else
+        snprintf(nome, tamanho, "slot%d.bin", slot);
+}
+
+void *executa_gravador(void *argumento)
+{
+    static JOGO copia; //so o estado salvo e o mapa sao usados
+    char nome[64];
+    (void)argumento;
+
+    pthread_mutex_lock(&gravador.trava);
+    for (;;)
+    {
+        while (gravador.pendentes == 0 && !gravador.encerrar)
+            pthread_cond_wait(&gravador.sinal, &gravador.trava);
+        if (gravador.pendentes == 0) break; //encerrando e nao ha mais nada para gravar
+
+        int slot = menor_bit(gravador.pendentes);
+        gravador.pendentes &= ~(1u << slot);
+        int copiou = copia_do_slot(&copia, &gravador.slots[slot]);
+        pthread_mutex_unlock(&gravador.trava);
+
+        nome_arquivo_slot(slot, nome, sizeof(nome));
+        if (copiou) grava_savegame(&copia, nome); //fora da trava: o jogo pode salvar de novo enquanto o arquivo e escrito
+
+        pthread_mutex_lock(&gravador.trava);
+    }
+    pthread_mutex_unlock(&gravador.trava);
+    libera_jogo(&copia);
+    return NULL;
+}
+
+//Le os slots que ja existem no disco e inicia a thread do gravador
+void inicia_gravador(void)
+{
+    static JOGO lido;
+    char nome[64];
+    for (int i = 0; i < NUM_SLOTS; i++)
+    {
+        nome_arquivo_slot(i, nome, sizeof(nome));
+        FILE *existe = fopen(nome, "rb");
+        if (existe == NULL) continue; //slot nunca usado
+        fclose(existe);
+        if (le_savegame(&lido, nome))
+            copia_para_slot(&gravador.slots[i], &lido);
+    }
+    libera_jogo(&lido);
+    gravador.thread_ativa = pthread_create(&gravador.thread, NULL, executa_gravador, NULL) == 0;
+    if (!gravador.thread_ativa) printf("Erro ao iniciar o gravador: os slots serao gravados na hora\n");
+}
+
+//Guarda o jogo no slot e pede para a thread gravar no disco
+void salva_no_slot(int slot, const JOGO *jogo)
+{
+    pthread_mutex_lock(&gravador.trava);
+    copia_para_slot(&gravador.slots[slot], jogo);
+    gravador.pendentes |= 1u << slot;
+    pthread_cond_signal(&gravador.sinal);
+    pthread_mutex_unlock(&gravador.trava);
+
+    if (!gravador.thread_ativa) //sem thread: grava aqui mesmo
+    {
+        char nome[64];
+        nome_arquivo_slot(slot, nome, sizeof(nome));
+        gravador.pendentes &= ~(1u << slot);
+        grava_savegame(jogo, nome);
+    }
+}
+
+//Espera a thread gravar todos os slots pendentes, termina a thread e libera os slots
+void encerra_gravador(void)
+{
+    if (gravador.thread_ativa)
+    {
+        pthread_mutex_lock(&gravador.trava);
+        gravador.encerrar = 1;
+        pthread_cond_signal(&gravador.sinal);
+        pthread_mutex_unlock(&gravador.trava);
+        pthread_join(gravador.thread, NULL);
+        gravador.thread_ativa = 0;
+    }
+    for (int i = 0; i < NUM_SLOTS; i++)
+        libera_slot(&gravador.slots[i]);
+}
+
+//Estado das telas 
+typedef struct estado_telas
+{
+    int tela; //TELA_*
+    int marcador; //opcao selecionada no menu ou no pause
+    TIPO_SCORE scores[MAXSCORES];
+    char nome[30]; //nome sendo digitado na tela de novo highscore
+    int letra_atual;
+    double fim_mensagem; //GetTime() em que a tela de fim de jogo acaba
+    REPLAY replay; //entradas do jogo, gravadas em "ultimo_jogo.replay" no final para poder reproduzir a partida
+    int gravando; //so da para reproduzir jogos que comecaram do zero
+    long ticks_desenhados; //ticks do ultimo retrato desenhado
+    int slot_atual; //slot dos saves rapidos (1 a NUM_SLOTS - 1)
+    char aviso[64]; //mensagem curta mostrada durante o jogo ("Jogo salvo no slot 1"...)
+    double fim_aviso; //GetTime() em que o aviso some
+} ESTADO_TELAS;
+
+//Mostra um aviso na tela do jogo por 2 segundos
+void mostra_aviso(ESTADO_TELAS *telas, const char *aviso)
+{
+    snprintf(telas->aviso, sizeof(telas->aviso), "%s", aviso);
+    telas->fim_aviso = GetTime() + 2.0;
+}
+
+//Muda de tela. A janela continua a mesma, so o titulo muda
+void muda_tela(ESTADO_TELAS *telas, int tela)
+{
+    static const char *titulos[] = {"MENU", "PAC-MAN", "PAUSE", "PAC-MAN", "HIGHSCORES", "HIGHSCORES", "PAC-MAN"};
+    telas->tela = tela;
+    telas->marcador = 0;
+    SetWindowTitle(titulos[tela]);
+}
+
+//Le os highscores (zerados se o arquivo ainda nao existir)
+void le_highscores(ESTADO_TELAS *telas)
+{
+    memset(telas->scores, 0, sizeof(telas->scores));
+    le_arquivo(telas->scores, "highscores.bin");
+}
+
+//Comeca um jogo (novo ou carregado do savegame) e vai para a tela do jogo
+void comeca_partida(ESTADO_TELAS *telas, JOGO *jogo, int carregar)
+{
+    memset(&telas->replay, 0, sizeof(telas->replay));
+    telas->gravando = !carregar;
+    if (carregar)
+    {
+        inicia_jogo(jogo);
+        if (!restaura_slot(jogo, &gravador.slots[0])) //sem savegame fica no menu
+        {
+            printf("Nenhum jogo salvo\n");
+            return;
+        }
+    }
+    else
+    {
+        novo_jogo(jogo, (unsigned long long)time(NULL), 1);
+        inicia_replay(&telas->replay, jogo);
+    }
+    descarta_entradas(&simulacao);
+    telas->ticks_desenhados = jogo->ticks;
+    telas->fim_aviso = 0.0;
+    muda_tela(telas, TELA_JOGO);
+}
+
+//Fim de uma partida (perdida, vencida ou abandonada pelo pause)
+void encerra_partida(ESTADO_TELAS *telas)
+{
+    para_simulacao(&simulacao);
+    libera_replay(&telas->replay);
+    telas->gravando = 0;
+}
+
+//Um quadro do menu principal
+void tela_menu(ESTADO_TELAS *telas, JOGO *jogo)
+{
+    //Interacoes com o menu
+    if (IsKeyPressed(KEY_W)) telas->marcador--;
+    if (IsKeyPressed(KEY_S)) telas->marcador++;
+    //"Vai e vem" do menu
+    if (telas->marcador == 4) telas->marcador = 0;
+    if (telas->marcador == -1) telas->marcador = 3;
+
+    //Interface grafica
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawText("PAC-MAN", 30, 20, 130, YELLOW);
+    DrawText("NOVO-JOGO", 30, 160, 80, YELLOW);
+    DrawText("CARREGAR-JOGO", 30, 260, 80, YELLOW);
+    DrawText("HIGHSCORES", 30, 360, 80, YELLOW);
+    DrawText("SAIR", 30, 460, 80, YELLOW);
+    DrawText("|W| |S| |ENTER|", 580, 600, 30, GRAY);
+    if (telas->marcador == 0) DrawCircle(550, 195, 25, YELLOW);
+    if (telas->marcador == 1) DrawCircle(765, 295, 25, YELLOW);
+    if (telas->marcador == 2) DrawCircle(600, 398, 25, YELLOW);
+    if (telas->marcador == 3) DrawCircle(262, 498, 25, YELLOW);
+    EndDrawing();
+
+    if (IsKeyPressed(KEY_ESCAPE))
+    {
+        muda_tela(telas, TELA_SAIR);
+    }
+    else if (IsKeyPressed(KEY_ENTER))
+    {
+        switch (telas->marcador)
+        {
+        case 0: //novo jogo
+            comeca_partida(telas, jogo, 0);
+            break;
+        case 1: //carregar jogo
+            comeca_partida(telas, jogo, 1);
+            break;
+        case 2: //ranking
+            le_highscores(telas);
+            muda_tela(telas, TELA_HIGHSCORES);
+            break;
+        default: //sair
+            muda_tela(telas, TELA_SAIR);
+            break;
+        }
+    }
+}
+
+//Um quadro da tela de highscores
+void tela_highscores(ESTADO_TELAS *telas)
+{
+    BeginDrawing();
+    ClearBackground(BLACK);
+
+    DrawText("HIGHSCORES", LAR_TELA/2 - MeasureText("HIGHSCORES", 40)/2, ALT_TELA/8, 40, YELLOW);
+    for (int i = 0; i < MAXSCORES; i++)
+    {
+        char buffer[64];
+        sprintf(buffer, "%d. %s - %d", i + 1, telas->scores[i].nome, telas->scores[i].score);
+        DrawText(buffer, LAR_TELA/4, ALT_TELA/4 + 40*i, 30, WHITE);
+    }
+
+    DrawText("Pressione TAB para voltar", LAR_TELA/2 - MeasureText("Pressione TAB para voltar", 20)/2, ALT_TELA - 60, 20, GRAY);
+    EndDrawing();
+
+    if (IsKeyPressed(KEY_TAB)) muda_tela(telas, TELA_MENU); // TAB volta ao menu
+    if (IsKeyPressed(KEY_ESCAPE)) muda_tela(telas, TELA_SAIR); // ESC fecha o jogo
+}
+
+//Um quadro da tela em que o jogador digita o nome para entrar no ranking
+void tela_novo_highscore(ESTADO_TELAS *telas, JOGO *jogo)
+{
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawText("Novo Highscore!", LAR_TELA / 2 - MeasureText("Novo Highscore!", 40) / 2, ALT_TELA / 4, 40, YELLOW);
+    DrawText("Digite seu nome:", LAR_TELA / 2 - MeasureText("Digite seu nome:", 30) / 2, ALT_TELA / 2 - 50, 30, WHITE);
+    DrawText(telas->nome, LAR_TELA / 2 - MeasureText(telas->nome, 30) / 2, ALT_TELA / 2, 30, WHITE);
+    EndDrawing();
+
+    int key = GetCharPressed();
+
+    if ((key >= 32) && (key <= 125) && (telas->letra_atual < 29))  // Verifica se  uma letra vlida e se h espao no buffer
+    {
+        telas->nome[telas->letra_atual] = (char)key;
+        telas->letra_atual++;
+        telas->nome[telas->letra_atual] = '\0';  // Atualiza a string com o novo caractere
+    }
+
+    if (IsKeyPressed(KEY_BACKSPACE) && telas->letra_atual > 0)  // Verifica se o backspace foi pressionado
+    {
+        telas->letra_atual--;
+        telas->nome[telas->letra_atual] = '\0';
+    }
+
+    if (IsKeyPressed(KEY_ENTER) && telas->letra_atual > 0)  // Se o jogador pressionar ENTER e tiver digitado um nome
+    {
+        TIPO_SCORE novo_score;
+        novo_score.score = jogo->player.pontuacao;
+        strcpy(novo_score.nome, telas->nome);
+        atualiza_highscores(telas->scores, MAXSCORES, novo_score);
+        escreve_arquivo(telas->scores, "highscores.bin");
+        muda_tela(telas, TELA_MENU);
+    }
+}
+
+//Um quadro da mensagem de fim de jogo. Depois de TEMPO_FIM_DE_JOGO segundos vai para o ranking (se a pontuacao entrar nele) ou para o menu
+void tela_fim_de_jogo(ESTADO_TELAS *telas, JOGO *jogo)
+{
+    BeginDrawing();
+    ClearBackground(BLACK);
+    if (jogo->estado == JOGO_VENCIDO)
+        DrawText("VOCE VENCEU!", 200, 200, 50, GREEN);
+    else
+        DrawText("Game Over!", LAR_TELA / 2 - 100, ALT_TELA / 2 - 50, 50, RED);
+    EndDrawing();
+
+    if (GetTime() < telas->fim_mensagem) return;
+
+    // Verifica se a pontuao do jogador entra no ranking dos highscores
+    le_highscores(telas);
+    if (jogo->player.pontuacao > telas->scores[MAXSCORES - 1].score)
+    {
+        telas->nome[0] = '\0';
+        telas->letra_atual = 0;
+        muda_tela(telas, TELA_NOVO_HIGHSCORE);
+    }
+    else
+    {
+        muda_tela(telas, TELA_MENU);
+    }
+}
 
-                    //melhor_dx = 1 significa mover para a direita,
-                    //melhor_dx = -1 significa mover para a esquerda,
-                    //melhor_dx = 0 signidica que o monstro no precisa se mover no eixo x
+//Um quadro do menu de pause. O jogo fica parado na memoria enquanto isso (a simulacao foi parada ao entrar no pause)
+void tela_pause(ESTADO_TELAS *telas, JOGO *jogo)
+{
+    //Interacoes com o menu
+    if (IsKeyPressed(KEY_W)) telas->marcador--;
+    if (IsKeyPressed(KEY_S)) telas->marcador++;
+    if (telas->marcador == 3) telas->marcador = 0;
+    if (telas->marcador == -1) telas->marcador = 2;
 
-                    //melhor_dy = 1 significa mover para baixo,
-                    //melhor_dy = -1 significa mover para cima.
-                    //melhor_dy = 0 signidica que o monstro no precisa se mover no eixo y
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawText("PAUSE", 170, 20, 140, YELLOW);
+    DrawText("CONTINUAR", 30, 160, 80, YELLOW);
+    DrawText("SALVAR JOGO", 30, 260, 80, YELLOW);
+    DrawText("SAIR", 30, 360, 80, YELLOW);
+    DrawText("|W| |S| |ENTER|", 580, 600, 30, GRAY);
+    if (telas->marcador == 0) DrawCircle(550, 195, 25, YELLOW);
+    if (telas->marcador == 1) DrawCircle(640, 295, 25, YELLOW);
+    if (telas->marcador == 2) DrawCircle(255, 398, 25, YELLOW);
+    EndDrawing();
 
-                    break; //Sai do loop
-                }
+    if (!IsKeyPressed(KEY_ENTER)) return;
+    if (telas->marcador == 0) //continua o jogo
+    {
+        muda_tela(telas, TELA_JOGO);
+    }
+    else if (telas->marcador == 1) //salva e continua o jogo (o arquivo e gravado em segundo plano)
+    {
+        salva_no_slot(0, jogo);
+        muda_tela(telas, TELA_JOGO);
+        mostra_aviso(telas, "Jogo salvo");
+    }
+    else //abandona a partida e volta ao menu
+    {
+        encerra_partida(telas);
+        muda_tela(telas, TELA_MENU);
+    }
+}
 
-                //Esse trecho do cdigo  responsvel por explorar as quatro direes possveis a partir do n atual(direita, esquerda, para cima, para baixo)
-                //e avaliar cada um desses movimentos para determinar se devem ser adicionados  lista de "abertos" (ns que sero explorados em etapas futuras).
-                for (int d = 0; d < 4; d++) //Esse loop ira iterar para cada uma das 4 possiveis direcoes
-                {
-                    //legenda - direcoes[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
-                    int nx = atual->x + direcoes[d][0]; //nova cordenada de X, resultante da posicao atual mais a direcao
-                    int ny = atual->y + direcoes[d][1]; //nova cordenada de Y, resultante da posicao atual mais a direcao
-                    int g = atual->g + 1; //custo para chegar no n atual + 1
-                    int h = heuristica(nx, ny, pacman->x, pacman->y); //Heuristica da distancia da nova posicao ate o pacman
-                    int f = g + h; // F = Valor do custo do n + Heuristica
-
-                    //Verificao para ver se o novo N no Est na Lista dos Fechados
-                    int fechado = 0;//flag para node fechado
-                    for (int j = 0; j < num_fechados; j++)
-                    {
-                        if (fechados[j]->x == nx && fechados[j]->y == ny)
-                        {
-                            fechado = 1;
-                            break;//Se for constatado que o n j est na lista dos fechados o looping  interrompido
-                        }
-                    }
-                    if (fechado) continue;
+//Um quadro do jogo: entrada e desenho. Os ticks rodam na thread da simulacao: as teclas vao para ela pela fila de entradas e o quadro
+//desenha o ultimo retrato que ela publicou. Quem precisa do jogo em si (pause, saves, fim da partida) para a simulacao antes.
+void tela_jogo(ESTADO_TELAS *telas, JOGO *jogo)
+{
+    double inicio_quadro = GetTime();
 
-                    //Verificao para ver se o novo N Est na Lista dos Abertos, se no estiver, ser adicionado, a menos que a posicao seja uma parede
-                    int aberto = 0; //flag para node aberto
-                    for (int j = 0; j < num_abertos; j++)
-                    {
-                        if (abertos[j]->x == nx && abertos[j]->y == ny && abertos[j]->f <= f)
-                            //Verifica para ver se o novo N Est na Lista dos Abertos e Verifica se o valor f do n na lista de "abertos"  menor ou igual ao f do n anterior.
-                            //Se no for menor, o looping tambm para, isso  uma questo de otimizacao na escolha dos nos que irao entrar na lista aberta
-                        {
-                            aberto = 1;
-                            break; //Se for constatado que o n esta na lista dos abertos o looping para
-                        }
-                    }
-                    if (aberto) continue;
+    // Fluxo pra quando o jogador aperta o boto para pausar o jogo
+    if (IsKeyPressed(KEY_TAB))
+    {
+        para_simulacao(&simulacao);
+        muda_tela(telas, TELA_PAUSE);
+        return;
+    }
+    if (IsKeyPressed(KEY_ESCAPE)) // ESC abandona a partida e volta ao menu
+    {
+        encerra_partida(telas);
+        muda_tela(telas, TELA_MENU);
+        return;
+    }
 
-                    //Verifica se nova posicao no  uma parede
-                    if (matriz_mapa[ny][nx] != 'W')
-                    {
-                        Node *vizinho = cria_node(nx, ny, g, h, atual); //Cria node com a nova posicao
-                        abertos[num_abertos++] = vizinho; //Adicionha node a lista dos abertos
-                    }
-                }
-            }
-            //Limpa todos os nodes apos a direcao ter sido determinada
-            for (int j = 0; j < num_abertos; j++)
-            {
-                free(abertos[j]); //Libera a memoria alocada dinamicamente na funcao cria nodes
-            }
-            for (int j = 0; j < num_fechados; j++)
+    // Interaes de movimento do pacman
+    int entrada = ENTRADA_NENHUMA;
+    if (IsKeyPressed(KEY_RIGHT)) entrada = ENTRADA_DIREITA;
+    if (IsKeyPressed(KEY_LEFT)) entrada = ENTRADA_ESQUERDA;
+    if (IsKeyPressed(KEY_UP)) entrada = ENTRADA_CIMA;
+    if (IsKeyPressed(KEY_DOWN)) entrada = ENTRADA_BAIXO;
+    if (IsKeyPressed(KEY_F2)) desenho.lote = !desenho.lote; //alterna o modo de desenho dos sprites
+    if (IsKeyPressed(KEY_F3)) desenho.painel_visivel = !desenho.painel_visivel; //painel de desempenho
+    if (IsKeyPressed(KEY_F4)) //proximo modo de ritmo dos quadros
+    {
+        ritmo.modo = (ritmo.modo + 1) % NUM_RITMOS;
+        aplica_ritmo_quadros();
+    }
+
+    // Saves rapidos: 1-4 escolhe o slot, F5 salva, F9 carrega
+    for (int i = 1; i < NUM_SLOTS; i++)
+    {
+        if (IsKeyPressed(KEY_ONE + i - 1))
+        {
+            telas->slot_atual = i;
+            mostra_aviso(telas, TextFormat("Slot %d", i));
+        }
+    }
+    if (IsKeyPressed(KEY_F5))
+    {
+        para_simulacao(&simulacao);
+        salva_no_slot(telas->slot_atual, jogo);
+        mostra_aviso(telas, TextFormat("Jogo salvo no slot %d", telas->slot_atual));
+    }
+    if (IsKeyPressed(KEY_F9))
+    {
+        para_simulacao(&simulacao);
+        if (restaura_slot(jogo, &gravador.slots[telas->slot_atual]))
+        {
+            if (telas->gravando) //o replay so reproduz um jogo sem voltas no tempo
             {
-                free(fechados[j]); //Libera a memoria alocada dinamicamente na funcao cria nodes
+                libera_replay(&telas->replay);
+                telas->gravando = 0;
             }
+            descarta_entradas(&simulacao);
+            entrada = ENTRADA_NENHUMA;
+            mostra_aviso(telas, TextFormat("Slot %d carregado", telas->slot_atual));
+        }
+        else
+        {
+            mostra_aviso(telas, TextFormat("Slot %d vazio", telas->slot_atual));
+        }
+    }
 
-            monstros[i].dx = melhor_dx; //atualiza direcao do monstro em x
-            monstros[i].dy = melhor_dy; //atualiza direcao do monstro em y
-            monstros[i].x += monstros[i].dx; //atualiza posicao do monstro em x
-            monstros[i].y += monstros[i].dy; //atualiza posicao do monstro em y
+    // O Pac-Man e os monstros andam na thread da simulacao: quantos ticks fixos couberem no tempo que passou (ver avanca_simulacao)
+    if (!simulacao.ativa) inicia_simulacao(&simulacao, jogo, telas->gravando ? &telas->replay : NULL);
+    if (entrada != ENTRADA_NENHUMA) poe_comando(&simulacao.entradas, entrada); //fila cheia: a tecla se perde, como em um quadro sem tick
+    if (!simulacao.thread_ativa) avanca_simulacao(&simulacao);
+    const RETRATO_JOGO *retrato = pega_retrato(&simulacao);
+    int ticks_no_quadro = retrato->ticks > telas->ticks_desenhados ? (int)(retrato->ticks - telas->ticks_desenhados) : 0;
+    telas->ticks_desenhados = retrato->ticks;
 
+    // Interface grfica
+    atualiza_camada_paredes(retrato); //so faz algo se o mapa mudou
+    BeginDrawing();
+    ClearBackground(BLACK);
+    desenha_mapa(retrato, retrato->tempo_pendente + (float)(agora_segundos() - retrato->instante));
+    desenha_painel_desempenho(retrato);
+    if (GetTime() < telas->fim_aviso)
+        desenha_texto(telas->aviso, LAR_TELA / 2 - MeasureText(telas->aviso, 20) / 2, 40, 20, WHITE);
+    double fim_desenho = GetTime();
+    EndDrawing();
+    espera_fim_do_quadro();
+    registra_quadro(inicio_quadro, fim_desenho, GetTime(), ticks_no_quadro, retrato->ms_simulacao);
 
-            if (monstros[i].x == pacman->x && monstros[i].y == pacman->y) //se a posicao atual do monstro for igual a do pacman
-            {
-                trata_colisao(pacman, player); //chama a funcao  trata colisao
-                return;
-            }
+    //FLUXO PRA QUANDO O JOGADOR MORRE OU FINALIZA O JOGO (o retrato do fim e o ultimo: a thread ja terminou ou esta terminando)
+    if (retrato->estado != JOGO_EM_ANDAMENTO)
+    {
+        para_simulacao(&simulacao);
+        if (telas->gravando)
+        {
+            finaliza_replay(&telas->replay, jogo);
+            salva_replay(&telas->replay, "ultimo_jogo.replay");
+        }
+        encerra_partida(telas);
+        telas->fim_mensagem = GetTime() + TEMPO_FIM_DE_JOGO;
+        muda_tela(telas, TELA_FIM_DE_JOGO);
+    }
+}
+
+//Uso: PACMAN_Final [--limitado fps | --vsync | --livre [fps]] [--mapa arquivo.txt] [--threads n]
+//O ritmo dos quadros padrao e limitado a 60. Com --mapa o jogo tem uma fase so, no mapa dado (de qualquer tamanho, ver compila_mapa).
+//--threads limita as threads que decidem os passos dos monstros (padrao: uma por nucleo; 1 = so a thread do jogo).
+int main(int argc, char *argv[])
+{
+    static JOGO jogo; //estado completo da simulacao (static por ser grande demais para a pilha)
+    static ESTADO_TELAS telas;
+    const char *mapa_avulso = NULL;
+    int threads_ia = numero_de_nucleos();
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--vsync") == 0)
+            ritmo.modo = RITMO_VSYNC;
+        else if (strcmp(argv[i], "--livre") == 0)
+        {
+            ritmo.modo = RITMO_LIVRE;
+            ritmo.fps_alvo = i + 1 < argc && argv[i + 1][0] != '-' ? atoi(argv[++i]) : 0;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--limitado") == 0)
+            ritmo.fps_alvo = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--mapa") == 0)
+            mapa_avulso = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0)
+            threads_ia = atoi(argv[++i]);
+    }
+    if (ritmo.fps_alvo < 0) ritmo.fps_alvo = 0;
+
+    if (mapa_avulso != NULL ? !abre_mapa_avulso(mapa_avulso) : !abre_mapas_compilados())
+        return 1; //todos os mapas ficam na memoria: trocar de fase nao le arquivos
+    define_threads_ia(&jogo, threads_ia); //so entram em acao com muitos monstros e IA com busca (ver decide_monstros)
+
+    //a janela, o contexto OpenGL e os recursos graficos duram o programa inteiro
+    InitWindow(LAR_TELA, ALT_TELA, "MENU");
+    SetExitKey(KEY_NULL); //o ESC e tratado por cada tela (no jogo ele volta ao menu em vez de fechar a janela)
+    aplica_ritmo_quadros();
+    carrega_recursos_graficos();
+    inicia_gravador();
+    telas.slot_atual = 1;
+    muda_tela(&telas, TELA_MENU);
+
+    while (telas.tela != TELA_SAIR && !WindowShouldClose())  // Loop principal: um quadro da tela atual por volta
+    {
+        switch (telas.tela)
+        {
+        case TELA_MENU:
+            tela_menu(&telas, &jogo);
+            break;
+        case TELA_JOGO:
+            tela_jogo(&telas, &jogo);
+            continue; //o quadro do jogo ja esperou e mediu o proprio tempo
+        case TELA_PAUSE:
+            tela_pause(&telas, &jogo);
+            break;
+        case TELA_FIM_DE_JOGO:
+            tela_fim_de_jogo(&telas, &jogo);
+            break;
+        case TELA_NOVO_HIGHSCORE:
+            tela_novo_highscore(&telas, &jogo);
+            break;
+        case TELA_HIGHSCORES:
+            tela_highscores(&telas);
+            break;
+        default:
+            break;
         }
+        espera_fim_do_quadro();
+    }
+
+    if (telas.tela == TELA_JOGO || telas.tela == TELA_PAUSE) //janela fechada no meio de uma partida
+        encerra_partida(&telas);
+    encerra_gravador(); //grava no disco os slots que ainda estao so na memoria
+    libera_simulacao(&simulacao);
+    libera_jogo(&jogo);
+    libera_recursos_graficos();
+    CloseWindow();  // Fecha a janela
+    fecha_mapas_compilados();
+    return 0;
+}
+#else
+//Comando do "bot" usado no modo headless: segue na direcao atual e, quando da de cara com uma parede, sorteia uma direcao livre.
+//O bot tem o seu proprio gerador (rng), separado do gerador do jogo.
+int entrada_bot(JOGO *jogo, unsigned long long *rng)
+{
+    POS_PACMAN *pacman = &jogo->pacman;
+    if ((pacman->dx != 0 || pacman->dy != 0) && !eh_parede(&jogo->mapa, pacman->x + pacman->dx, pacman->y + pacman->dy))
+        return ENTRADA_NENHUMA;
 
-        trata_colisao_monstros(monstros); //Se monstros estiverem ocupando o mesmo espaco essa funcao fara eles se separarem
-        timer = 0.0f; //Zera timer
+    int livres[4], num_livres = 0;
+    for (int d = 0; d < 4; d++)
+    {
+        if (!eh_parede(&jogo->mapa, pacman->x + direcoes[d][0], pacman->y + direcoes[d][1]))
+            livres[num_livres++] = d;
     }
+    if (num_livres == 0) return ENTRADA_NENHUMA;
+    return livres[sorteia(rng) % num_livres] + 1;
 }
 
+#ifdef PACMAN_LOTE
+#define MAXIMO_TRABALHADORES 64
+#define MAXIMO_TICKS_PARTIDA 216000 //1 hora de jogo: partidas em que o bot fica preso sao encerradas aqui
+
+//Um lote e o conjunto de todas as combinacoes (semente, mapa inicial, dificuldade inicial)
+typedef struct config_lote
+{
+    int num_sementes;
+    int num_dificuldades;
+    long num_partidas; //num_sementes * NUM_MAPAS * num_dificuldades
+} CONFIG_LOTE;
+
+//Estatisticas acumuladas por um trabalhador. So o proprio trabalhador escreve nelas (sem trava e sem atomico),
+//e o alinhamento em 64 bytes evita que dois trabalhadores dividam a mesma linha de cache.
+typedef struct estatisticas_lote
+{
+    _Alignas(64) long partidas[NUM_MAPAS]; //por mapa inicial
+    long vitorias[NUM_MAPAS];
+    long interrompidas[NUM_MAPAS]; //chegaram em MAXIMO_TICKS_PARTIDA
+    long long soma_pontos[NUM_MAPAS];
+    long long soma_ticks[NUM_MAPAS]; //tempo de sobrevivencia
+    int maior_pontuacao;
+    long roubadas; //partidas que o trabalhador pegou da fila de outro
+} ESTATISTICAS_LOTE;
+
+//Fila de partidas de um trabalhador: o intervalo [proxima, fim) do lote. O dono e os "ladroes" pegam partidas com
+//atomic_fetch_add em proxima, entao cada partida e jogada exatamente uma vez sem nenhuma trava.
+typedef struct fila_trabalho
+{
+    _Alignas(64) atomic_long proxima;
+    long fim;
+} FILA_TRABALHO;
+
+typedef struct trabalhador
+{
+    int id;
+    int num_trabalhadores;
+    FILA_TRABALHO *filas;
+    const CONFIG_LOTE *config;
+    JOGO *jogo; //cada trabalhador tem o seu proprio jogo
+    ESTATISTICAS_LOTE estatisticas;
+} TRABALHADOR;
+
+//Joga a partida de numero "indice" do lote com o bot e soma o resultado nas estatisticas do trabalhador
+void joga_partida_lote(JOGO *jogo, long indice, const CONFIG_LOTE *config, ESTATISTICAS_LOTE *estatisticas)
+{
+    unsigned long long semente = (unsigned long long)(indice / (NUM_MAPAS * config->num_dificuldades)) + 1;
+    int resto = (int)(indice % (NUM_MAPAS * config->num_dificuldades));
+    int mapa = resto / config->num_dificuldades;
+    unsigned long long rng_bot;
+
+    semeia(&rng_bot, semente ^ 0x9E3779B97F4A7C15ULL);
+    novo_jogo(jogo, semente, mapa + 1);
+    define_dificuldade(jogo, resto % config->num_dificuldades + 1);
+    while (jogo->estado == JOGO_EM_ANDAMENTO && jogo->ticks < MAXIMO_TICKS_PARTIDA)
+        passo_simulacao(jogo, entrada_bot(jogo, &rng_bot));
+
+    estatisticas->partidas[mapa]++;
+    estatisticas->vitorias[mapa] += jogo->estado == JOGO_VENCIDO;
+    estatisticas->interrompidas[mapa] += jogo->estado == JOGO_EM_ANDAMENTO;
+    estatisticas->soma_pontos[mapa] += jogo->player.pontuacao;
+    estatisticas->soma_ticks[mapa] += jogo->ticks;
+    if (jogo->player.pontuacao > estatisticas->maior_pontuacao)
+        estatisticas->maior_pontuacao = jogo->player.pontuacao;
+}
 
-void gameplay(char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA], POS_PACMAN *pacman, STATUS_PLAYER *player, int carregar)
+//Thread de um trabalhador: esvazia a propria fila e depois rouba partidas das filas dos outros
+void *executa_trabalhador(void *argumento)
 {
-    if (!carregar)  // Se no for para carregar jogo salvo, inicializa tudo.
+    TRABALHADOR *trabalhador = (TRABALHADOR *)argumento;
+    for (int k = 0; k < trabalhador->num_trabalhadores; k++)
     {
-        player->vida = 3;
-        player->pontuacao = 0;
-        player->fase = 1;
-        player->dificuldade = 1;
-        carrega_mapa(mapas[player->fase - 1], matriz_mapa, pacman, player);
+        FILA_TRABALHO *fila = &trabalhador->filas[(trabalhador->id + k) % trabalhador->num_trabalhadores];
+        long indice;
+        while ((indice = atomic_fetch_add(&fila->proxima, 1)) < fila->fim)
+        {
+            joga_partida_lote(trabalhador->jogo, indice, trabalhador->config, &trabalhador->estatisticas);
+            trabalhador->estatisticas.roubadas += k != 0;
+        }
     }
+    return NULL;
+}
 
-    // Inicia interface grfica do jogo
-    InitWindow(LAR_TELA, ALT_TELA, "PAC-MAN");
-    SetTargetFPS(60);
+//Joga o lote inteiro dividido entre num_trabalhadores threads. Devolve o tempo gasto (s) e as estatisticas somadas em *total.
+double executa_lote(const CONFIG_LOTE *config, int num_trabalhadores, ESTATISTICAS_LOTE *total)
+{
+    static TRABALHADOR trabalhadores[MAXIMO_TRABALHADORES];
+    static FILA_TRABALHO filas[MAXIMO_TRABALHADORES];
+    pthread_t threads[MAXIMO_TRABALHADORES];
 
-    while (!WindowShouldClose())
+    for (int i = 0; i < num_trabalhadores; i++)
     {
-        float deltaTime = GetFrameTime();  // variao de tempo, baseado no valor de variao de quadros na tela
+        //cada trabalhador comeca com um pedaco continuo do lote
+        atomic_init(&filas[i].proxima, config->num_partidas * i / num_trabalhadores);
+        filas[i].fim = config->num_partidas * (i + 1) / num_trabalhadores;
+        memset(&trabalhadores[i].estatisticas, 0, sizeof(ESTATISTICAS_LOTE));
+        trabalhadores[i].id = i;
+        trabalhadores[i].num_trabalhadores = num_trabalhadores;
+        trabalhadores[i].filas = filas;
+        trabalhadores[i].config = config;
+        if (trabalhadores[i].jogo == NULL)
+            trabalhadores[i].jogo = (JOGO *)calloc(1, sizeof(JOGO)); //zerado: inicia_jogo guarda o bloco de memoria que encontrar
+    }
+
+    double inicio = agora_segundos();
+    for (int i = 0; i < num_trabalhadores; i++)
+        pthread_create(&threads[i], NULL, executa_trabalhador, &trabalhadores[i]);
+    for (int i = 0; i < num_trabalhadores; i++)
+        pthread_join(threads[i], NULL);
+    double segundos = agora_segundos() - inicio;
 
-        //FLUXO PRA QUANDO O JOGADOR MORRE
-        if (player->vida == 0)
+    //junta os acumuladores depois que todas as threads terminaram
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < num_trabalhadores; i++)
+    {
+        ESTATISTICAS_LOTE *parcial = &trabalhadores[i].estatisticas;
+        for (int m = 0; m < NUM_MAPAS; m++)
         {
-            BeginDrawing();
-            ClearBackground(BLACK);
-            DrawText("Game Over!", LAR_TELA / 2 - 100, ALT_TELA / 2 - 50, 50, RED);
-            EndDrawing();
-            WaitTime(2.0); // Espera 2 segundos antes de continuar
+            total->partidas[m] += parcial->partidas[m];
+            total->vitorias[m] += parcial->vitorias[m];
+            total->interrompidas[m] += parcial->interrompidas[m];
+            total->soma_pontos[m] += parcial->soma_pontos[m];
+            total->soma_ticks[m] += parcial->soma_ticks[m];
+        }
+        if (parcial->maior_pontuacao > total->maior_pontuacao)
+            total->maior_pontuacao = parcial->maior_pontuacao;
+        total->roubadas += parcial->roubadas;
+    }
+    return segundos;
+}
 
-            // Verifica se a pontuao do jogador entra no ranking dos highscores
-            TIPO_SCORE scores[MAXSCORES];
-            le_arquivo(scores, "highscores.bin");
+//Executor de lotes: joga todas as combinacoes de sementes x mapas x dificuldades com o bot, repetindo o lote com
+//1, 2, 4, ... threads para medir partidas por segundo e a eficiencia da escala.
+//Uso: pacman_lote [sementes] [dificuldades] [max_threads]
+int main(int argc, char *argv[])
+{
+    static JOGO aquecimento;
+    CONFIG_LOTE config;
+    ESTATISTICAS_LOTE total, referencia;
+    int max_trabalhadores = argc > 3 ? atoi(argv[3]) : numero_de_nucleos();
+    double partidas_por_segundo_1 = 0;
 
-            if (player->pontuacao > scores[MAXSCORES - 1].score)
-            {
-                insere_highscore_grafico(scores, player->pontuacao);
-            }
+    config.num_sementes = argc > 1 ? atoi(argv[1]) : 200;
+    config.num_dificuldades = argc > 2 ? atoi(argv[2]) : 3;
+    if (config.num_sementes < 1) config.num_sementes = 1;
+    if (config.num_dificuldades < 1) config.num_dificuldades = 1;
+    if (max_trabalhadores < 1) max_trabalhadores = 1;
+    if (max_trabalhadores > MAXIMO_TRABALHADORES) max_trabalhadores = MAXIMO_TRABALHADORES;
+    config.num_partidas = (long)config.num_sementes * NUM_MAPAS * config.num_dificuldades;
+
+    //os mapas compilados sao abertos antes das threads; depois disso os trabalhadores so leem
+    if (!abre_mapas_compilados()) return 1;
+    for (int m = 0; m < NUM_MAPAS; m++)
+        novo_jogo(&aquecimento, 1, m + 1);
 
-            break;  // Sai do loop para finalizar o jogo
+    printf("Lote: %d sementes x %d mapas x %d dificuldades = %ld partidas\n", config.num_sementes, NUM_MAPAS, config.num_dificuldades, config.num_partidas);
+    for (int n = 1; ; n = n * 2 < max_trabalhadores ? n * 2 : max_trabalhadores)
+    {
+        double segundos = executa_lote(&config, n, &total);
+        double partidas_por_segundo = config.num_partidas / segundos;
+        if (n == 1)
+        {
+            partidas_por_segundo_1 = partidas_por_segundo;
+            referencia = total;
         }
+        int iguais = memcmp(total.soma_pontos, referencia.soma_pontos, sizeof(total.soma_pontos)) == 0
+                     && memcmp(total.soma_ticks, referencia.soma_ticks, sizeof(total.soma_ticks)) == 0;
+        printf("%2d threads: %.3f s, %.0f partidas/s, speedup %.2fx, eficiencia %.0f%%, %ld roubadas%s\n", n, segundos, partidas_por_segundo,
+               partidas_por_segundo / partidas_por_segundo_1, 100.0 * partidas_por_segundo / partidas_por_segundo_1 / n, total.roubadas,
+               iguais ? "" : " (RESULTADO DIFERENTE DO SERIAL!)");
+        if (n == max_trabalhadores) break;
+    }
+
+    for (int m = 0; m < NUM_MAPAS; m++)
+    {
+        printf("%s: %ld partidas, %.1f%% vitorias, %ld interrompidas, media de %.1f pontos, sobrevivencia media de %.1f s\n", mapas[m],
+               total.partidas[m], 100.0 * total.vitorias[m] / total.partidas[m], total.interrompidas[m],
+               (double)total.soma_pontos[m] / total.partidas[m], total.soma_ticks[m] * DT_SIMULACAO / total.partidas[m]);
+    }
+    printf("Maior pontuacao: %d\n", total.maior_pontuacao);
+    return 0;
+}
+#else
+//Joga uma partida inteira com o bot e grava o replay dela
+int grava_partida_bot(const char *nome_arq, unsigned long long semente, int fase)
+{
+    static JOGO jogo;
+    REPLAY replay = {0};
+    unsigned long long rng_bot;
+
+    semeia(&rng_bot, semente ^ 0x9E3779B97F4A7C15ULL);
+    novo_jogo(&jogo, semente, fase);
+    inicia_replay(&replay, &jogo);
+    while (jogo.estado == JOGO_EM_ANDAMENTO)
+    {
+        int entrada = entrada_bot(&jogo, &rng_bot);
+        if (!grava_entrada_replay(&replay, entrada)) break; //salva_replay recusa o replay incompleto
+        passo_simulacao(&jogo, entrada);
+    }
+    finaliza_replay(&replay, &jogo);
+    int ok = salva_replay(&replay, nome_arq);
+    printf("Replay %s: semente %llu, fase %d, %d ticks em %d trechos, %d pontos, checksum %08x\n", nome_arq, semente, fase,
+           replay.cabecalho.num_ticks, replay.cabecalho.num_trechos, replay.cabecalho.pontuacao_final, replay.cabecalho.checksum);
+    libera_replay(&replay);
+    return ok;
+}
+
+//Executa um replay gravado (quantas vezes for pedido), confere o resultado e mede a velocidade da simulacao
+int confere_replay(const char *nome_arq, int repeticoes)
+{
+    static JOGO jogo;
+    REPLAY replay = {0};
+    int ok = 1;
+
+    if (!carrega_replay(&replay, nome_arq))
+    {
+        printf("Erro ao carregar replay %s\n", nome_arq);
+        libera_replay(&replay);
+        return 0;
+    }
+    clock_t inicio = clock();
+    for (int r = 0; r < repeticoes; r++)
+        ok = executa_replay(&replay, &jogo) && ok;
+    double ms = 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
+    long ticks = (long)replay.cabecalho.num_ticks * repeticoes;
 
-        //FLUXO PRA QUANDO JOGADOR FINALIZA FASE
-        if (verifica_fim_de_fase(player))
+    printf("Replay %s: %s (pontos %d/%d, checksum %08x/%08x)\n", nome_arq, ok ? "OK" : "DIVERGIU",
+           jogo.player.pontuacao, replay.cabecalho.pontuacao_final, checksum_jogo(&jogo), replay.cabecalho.checksum);
+    printf("%d execucoes, %ld ticks em %.1f ms (%.0f ticks/ms)\n", repeticoes, ticks, ms, ms > 0 ? ticks / ms : 0.0);
+    libera_replay(&replay);
+    return ok;
+}
+
+//Joga um replay pela thread da simulacao, como a tela do jogo faz: esta thread poe as entradas na fila (uma por tick, sem esperar o
+//relogio) e le os retratos enquanto a outra escreve. Confere que todo retrato pego esta inteiro (o checksum guardado bate com o conteudo
+//e o mapa tem os coletaveis que o jogo contava), que o resultado e o do replay e que o ultimo retrato e igual ao jogo no fim.
+int confere_simulacao_thread(const char *nome_arq)
+{
+    static JOGO jogo;
+    static SIMULACAO sim;
+    REPLAY replay = {0};
+    long retratos = 0, ruins = 0, ticks_anteriores = -1;
+    int trecho = 0, repetidos = 0, ok = 1;
+
+    if (!carrega_replay(&replay, nome_arq))
+    {
+        printf("Erro ao carregar replay %s\n", nome_arq);
+        libera_replay(&replay);
+        return 0;
+    }
+    novo_jogo(&jogo, replay.cabecalho.semente, replay.cabecalho.fase_inicial);
+    jogo.modo_ia = replay.cabecalho.modo_ia;
+    sim.sem_relogio = 1;
+    sim.conferir = 1;
+    inicia_simulacao(&sim, &jogo, NULL);
+
+    clock_t inicio = clock();
+    const RETRATO_JOGO *retrato = pega_retrato(&sim);
+    while (retrato->ticks < replay.cabecalho.num_ticks && retrato->estado == JOGO_EM_ANDAMENTO)
+    {
+        //entradas do replay, enquanto couberem na fila
+        while (trecho < replay.cabecalho.num_trechos && poe_comando(&sim.entradas, replay.trechos[trecho] & 7))
         {
-            player->fase++;
-            if (player->fase > NUM_MAPAS) //VERIFICA SE JOGADOR FINALIZOU O JOGO
+            if (++repetidos > replay.trechos[trecho] >> 3)
             {
-                BeginDrawing();
-                ClearBackground(BLACK);
-                DrawText("VOCE VENCEU!", 200, 200, 50, GREEN);
-                EndDrawing();
-                WaitTime(2.0);
+                trecho++;
+                repetidos = 0;
+            }
+        }
+        if (!sim.thread_ativa) avanca_simulacao(&sim);
+
+        retrato = pega_retrato(&sim);
+        if (retrato->ticks == ticks_anteriores) continue; //o mesmo retrato de antes
+        retratos++;
+        int coletaveis = conta_bitboard(&retrato->mapa, retrato->mapa.pontos) + conta_bitboard(&retrato->mapa, retrato->mapa.power)
+                         + conta_bitboard(&retrato->mapa, retrato->mapa.frutas);
+        if (retrato->checksum != checksum_retrato(retrato) || coletaveis != retrato->num_coletaveis || retrato->ticks < ticks_anteriores)
+            ruins++;
+        ticks_anteriores = retrato->ticks;
+    }
+    para_simulacao(&sim);
+    double ms = 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
+
+    retrato = pega_retrato(&sim);
+    ok = checksum_jogo(&jogo) == replay.cabecalho.checksum && jogo.player.pontuacao == replay.cabecalho.pontuacao_final && ruins == 0
+         && retrato->checksum == checksum_jogo(&jogo)
+         && memcmp(retrato->mapa.paredes, jogo.mapa.paredes, tamanho_bitboards(jogo.mapa.largura, jogo.mapa.altura) * sizeof(LINHA_BITS)) == 0;
+    printf("Simulacao em thread %s: %s (pontos %d/%d, checksum %08x/%08x)\n", nome_arq, ok ? "OK" : "FALHOU", jogo.player.pontuacao,
+           replay.cabecalho.pontuacao_final, checksum_jogo(&jogo), replay.cabecalho.checksum);
+    printf("%ld ticks em %.1f ms, %ld retratos lidos durante a simulacao, %ld incompletos ou fora de ordem\n", jogo.ticks, ms, retratos, ruins);
+    libera_simulacao(&sim);
+    libera_replay(&replay);
+    return ok;
+}
+
+//Microbenchmark da BFS por bitboards contra o A* usado pelos monstros, nos mapas do jogo.
+//Antes de medir confere que todos os kernels dao as mesmas distancias que a BFS com fila (todos os alvos)
+//e que essas distancias sao o tamanho do caminho achado pelo A* (uma amostra de alvos, todas as origens).
+int compara_bfs_a_estrela(int repeticoes)
+{
+    static JOGO jogo;
+    int dx, dy, ok = 1;
 
-            // Verifica se a pontuao do jogador entra no ranking dos highscores
-            TIPO_SCORE scores[MAXSCORES];
-            le_arquivo(scores, "highscores.bin");
+    printf("Kernel escolhido neste processador: %s\n", nomes_kernels_bfs[melhor_kernel_bfs()]);
+    for (int m = 0; m < num_fases(); m++)
+    {
+        int num_livres = 0;
+        long diferencas = 0, pares_a_estrela = 0;
+        novo_jogo(&jogo, 1, m + 1);
+        const BITBOARDS_MAPA *mapa = &jogo.mapa;
+        int largura = mapa->largura, celulas = CELULAS_MAPA(mapa);
+        MEMORIA_BFS *memoria = &jogo.campo_fluxo.bfs;
+        int *distancia = (int *)malloc((size_t)celulas * sizeof(int));
+        int *referencia = (int *)malloc((size_t)celulas * sizeof(int));
+        int *livres = (int *)malloc((size_t)celulas * sizeof(int));
+        if (distancia == NULL || referencia == NULL || livres == NULL)
+        {
+            printf("Erro: sem memoria para comparar as BFS\n");
+            free(distancia);
+            free(referencia);
+            free(livres);
+            return 0;
+        }
+        for (int celula = 0; celula < celulas; celula++)
+        {
+            if (!eh_parede(mapa, celula % largura, celula / largura))
+                livres[num_livres++] = celula;
+        }
 
-            if (player->pontuacao > scores[MAXSCORES - 1].score)
+        //conferencia
+        for (int k = 0; k < num_livres; k++)
+        {
+            int alvo = livres[k];
+            bfs_distancias(mapa, alvo, referencia, memoria->fila);
+            for (int kernel = 0; kernel < NUM_KERNELS_BFS; kernel++)
             {
-                insere_highscore_grafico(scores, player->pontuacao);
-            }
-                break;
+                if (!kernel_bfs_disponivel(kernel)) continue;
+                bfs_bits_kernel(mapa, alvo, distancia, memoria, kernel);
+                diferencas += memcmp(distancia, referencia, (size_t)celulas * sizeof(int)) != 0;
             }
-            else
+            if (k % 16 != 0) continue;
+            for (int o = 0; o < num_livres; o++)
             {
-                player->dificuldade = 1;
-                VEL_MONSTROS = 0.30;
-                carrega_mapa(mapas[player->fase - 1], matriz_mapa, pacman, player);
+                busca_a_estrela(&jogo.arena, mapa, livres[o] % largura, livres[o] / largura, alvo % largura, alvo / largura, &dx, &dy);
+                diferencas += jogo.arena.ultimo_custo != referencia[livres[o]];
+                pares_a_estrela++;
             }
         }
+        printf("%s: %d celulas livres, %ld pares conferidos com o A*, %ld diferencas\n", mapa_compilado(m + 1)->nome, num_livres, pares_a_estrela, diferencas);
+        ok = ok && diferencas == 0;
 
-        // Fluxo pra quando o jogador aperta o boto para pausar o jogo
-        if (IsKeyPressed(KEY_TAB))
+        //D* Lite: um monstro e um alvo andando ao acaso; depois de cada passo o monstro tem que achar caminho quando a BFS acha, e o passo
+        //tem que encurtar a distancia da BFS
+        long diferencas_incrementais = 0, passos_incrementais = 0, nodes_a_estrela = 0;
+        unsigned long long rng;
+        semeia(&rng, (unsigned long long)m + 1);
+        if (prepara_busca_incremental(&jogo))
         {
-            int opcao_pause = chama_menu_pause();
-            if (opcao_pause == 0)
-            {
-                continue;  // continua o jogo
-            }
-            else if (opcao_pause == 1)
+            BUSCA_INCREMENTAL *busca = &jogo.incremental.buscas[0];
+            int monstro = livres[sorteia(&rng) % num_livres], alvo = livres[sorteia(&rng) % num_livres];
+            for (int passo = 0; passo < 20 * repeticoes; passo++)
             {
-                salvar_jogo(matriz_mapa, player, pacman, monstros);  // Inicia funo salvar jogo
-                CloseWindow();  // Fecha o jogo aps salvar
-                return;  // Sai da funo gameplay
+                for (int k = 0; k < 4; k++) //o alvo anda ate 4 celulas, e as vezes pula para qualquer lugar
+                {
+                    int d = (int)(sorteia(&rng) % 4), nx = alvo % largura + direcoes[d][0], ny = alvo / largura + direcoes[d][1];
+                    if (!eh_parede(mapa, nx, ny)) alvo = INDICE_CELULA(mapa, nx, ny);
+                }
+                if (sorteia(&rng) % 50 == 0) alvo = livres[sorteia(&rng) % num_livres];
+                busca_a_estrela(&jogo.arena, mapa, monstro % largura, monstro / largura, alvo % largura, alvo / largura, &dx, &dy);
+                nodes_a_estrela += jogo.arena.usados;
+                int achou = passo_incremental(&jogo.incremental, busca, mapa, monstro % largura, monstro / largura, alvo % largura, alvo / largura, &dx, &dy);
+                bfs_distancias(mapa, alvo, referencia, memoria->fila);
+                diferencas_incrementais += achou != (referencia[monstro] >= 0);
+                diferencas_incrementais += (dx != 0 || dy != 0) && referencia[INDICE_CELULA(mapa, monstro % largura + dx, monstro / largura + dy)] != referencia[monstro] - 1;
+                passos_incrementais++;
+                monstro = INDICE_CELULA(mapa, monstro % largura + dx, monstro / largura + dy);
+                if (monstro == alvo) monstro = livres[sorteia(&rng) % num_livres]; //pegou: volta para outro lugar
             }
-            else if (opcao_pause == 2)
+            printf("  D* Lite: %ld passos conferidos com a BFS, %ld diferencas, %.1f celulas expandidas por passo (o A* usaria %.1f nodes)\n",
+                   passos_incrementais, diferencas_incrementais, (double)jogo.incremental.nos_expandidos / passos_incrementais,
+                   (double)nodes_a_estrela / passos_incrementais);
+            ok = ok && diferencas_incrementais == 0;
+        }
+
+        //A*: uma busca (o que cada monstro faz a cada passo no modo IA_A_ESTRELA)
+        long buscas = 0;
+        clock_t inicio = clock();
+        for (int r = 0; r < repeticoes; r++)
+        {
+            for (int k = 0; k < num_livres; k += 16)
             {
-                break; // Fecha o jogo
+                for (int o = 0; o < num_livres; o++, buscas++)
+                    busca_a_estrela(&jogo.arena, mapa, livres[o] % largura, livres[o] / largura, livres[k] % largura, livres[k] / largura, &dx, &dy);
             }
         }
+        double us_a_estrela = 1e6 * (double)(clock() - inicio) / CLOCKS_PER_SEC / buscas;
+        printf("  A* (uma origem)        : %8.3f us por busca, %d monstros = %.3f us por passo\n", us_a_estrela, jogo.num_monstros, us_a_estrela * jogo.num_monstros);
 
-        // Interaes de movimento do pacman
-        if (IsKeyPressed(KEY_RIGHT))
+        //campo de distancias inteiro (serve todos os monstros de uma vez): BFS com fila e os kernels de bits
+        inicio = clock();
+        for (int r = 0; r < repeticoes; r++)
         {
-            pacman->dx = 1; // Mudando a direo de movimento do pacman
-            pacman->dy = 0;
+            for (int k = 0; k < num_livres; k++)
+                bfs_distancias(mapa, livres[k], referencia, memoria->fila);
         }
-        if (IsKeyPressed(KEY_LEFT))
+        double us_fila = 1e6 * (double)(clock() - inicio) / CLOCKS_PER_SEC / ((double)repeticoes * num_livres);
+        printf("  BFS com fila (campo)   : %8.3f us por campo\n", us_fila);
+        for (int kernel = 0; kernel < NUM_KERNELS_BFS; kernel++)
         {
-            pacman->dx = -1;
-            pacman->dy = 0;
+            if (!kernel_bfs_disponivel(kernel)) continue;
+            inicio = clock();
+            for (int r = 0; r < repeticoes; r++)
+            {
+                for (int k = 0; k < num_livres; k++)
+                    bfs_bits_kernel(mapa, livres[k], distancia, memoria, kernel);
+            }
+            double us = 1e6 * (double)(clock() - inicio) / CLOCKS_PER_SEC / ((double)repeticoes * num_livres);
+            printf("  bits %-7s (campo)   : %8.3f us por campo (%.2fx a fila, %.1fx os %d A* de um passo)\n", nomes_kernels_bfs[kernel], us,
+                   us_fila / us, us_a_estrela * jogo.num_monstros / us, jogo.num_monstros);
+        }
+        free(distancia);
+        free(referencia);
+        free(livres);
+    }
+    libera_jogo(&jogo);
+    return ok;
+}
+
+//Gera um labirinto de largura x altura a partir da semente, para testar o jogo em mapas de qualquer tamanho.
+//Primeiro um labirinto perfeito (um unico caminho entre duas celulas quaisquer) por busca em profundidade com uma pilha do malloc,
+//entao nao ha recursao que estoure a pilha em labirintos enormes; depois algumas paredes internas sao abertas para criar ciclos,
+//como nos mapas do jogo. Os corredores ficam nas coordenadas impares e a borda e sempre parede. Preenche a matriz com 'W', '.', 'S', 'F',
+//o Pac-Man ('J') no canto de cima e num_monstros monstros ('M'; 0 = um para cada 64 celulas do labirinto). A mesma semente sempre gera
+//o mesmo labirinto. Retorna 0 se faltou memoria.
+int gera_labirinto(char *matriz, int largura, int altura, unsigned long long semente, int num_monstros)
+{
+    int colunas = (largura - 1) / 2, linhas = (altura - 1) / 2; //celulas do labirinto (nas coordenadas impares)
+    unsigned long long rng;
+    int topo = 0;
+    int *pilha = (int *)malloc((size_t)colunas * linhas * sizeof(int));
+    if (pilha == NULL) return 0;
+
+    semeia(&rng, semente);
+    memset(matriz, 'W', (size_t)largura * altura);
+    matriz[(size_t)1 * largura + 1] = ' ';
+    pilha[topo++] = 0;
+    while (topo > 0)
+    {
+        int atual = pilha[topo - 1];
+        int cx = atual % colunas, cy = atual / colunas;
+        int opcoes[4], num_opcoes = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            int nx = cx + direcoes[d][0], ny = cy + direcoes[d][1];
+            if (nx >= 0 && nx < colunas && ny >= 0 && ny < linhas && matriz[(size_t)(2 * ny + 1) * largura + 2 * nx + 1] == 'W')
+                opcoes[num_opcoes++] = d;
         }
-        if (IsKeyPressed(KEY_UP))
+        if (num_opcoes == 0) //beco sem saida: volta um passo
         {
-            pacman->dx = 0;
-            pacman->dy = -1;
+            topo--;
+            continue;
         }
-        if (IsKeyPressed(KEY_DOWN))
+        int d = opcoes[sorteia(&rng) % num_opcoes];
+        int nx = cx + direcoes[d][0], ny = cy + direcoes[d][1];
+        matriz[(size_t)(2 * cy + 1 + direcoes[d][1]) * largura + 2 * cx + 1 + direcoes[d][0]] = ' '; //parede entre as duas celulas
+        matriz[(size_t)(2 * ny + 1) * largura + 2 * nx + 1] = ' ';
+        pilha[topo++] = ny * colunas + nx;
+    }
+    free(pilha);
+
+    //abre 1 em cada 8 paredes entre dois corredores e poe os itens nos corredores
+    for (int y = 1; y < 2 * linhas; y++)
+    {
+        for (int x = 1; x < 2 * colunas; x++)
         {
-            pacman->dx = 0;
-            pacman->dy = 1;
+            char *celula = &matriz[(size_t)y * largura + x];
+            int entre_corredores = (x % 2 == 0 && y % 2 == 1) || (x % 2 == 1 && y % 2 == 0);
+            if (*celula == 'W' && entre_corredores && sorteia(&rng) % 8 == 0)
+                *celula = ' ';
+            if (*celula == ' ')
+            {
+                unsigned int sorteio = sorteia(&rng) % 100;
+                *celula = sorteio < 1 ? 'F' : (sorteio < 3 ? 'S' : '.');
+            }
         }
+    }
 
-        // Atualiza o movimento do Pac-Man e dos monstros
-        move_pacman(pacman, matriz_mapa, player, deltaTime);
-        move_monstros(pacman, player, matriz_mapa, deltaTime);
+    //Pac-Man no canto de cima; monstros em corredores sorteados
+    matriz[(size_t)1 * largura + 1] = 'J';
+    if (num_monstros <= 0) num_monstros = colunas * linhas / 64;
+    if (num_monstros < 1) num_monstros = 1;
+    for (int i = 0, tentativas = 0; i < num_monstros && tentativas < 1000 + 64 * num_monstros; tentativas++)
+    {
+        int x = 2 * (int)(sorteia(&rng) % colunas) + 1, y = 2 * (int)(sorteia(&rng) % linhas) + 1;
+        char *celula = &matriz[(size_t)y * largura + x];
+        if (*celula == 'J' || *celula == 'M' || (x < 8 && y < 8)) continue; //longe do Pac-Man
+        *celula = 'M';
+        i++;
+    }
+    return 1;
+}
+
+//Gera um labirinto e grava como arquivo de mapa (com a linha "#mapa <largura> <altura>"), que o jogo abre com --mapa
+int grava_labirinto(const char *nome_arq, int largura, int altura, unsigned long long semente)
+{
+    char *matriz = (char *)malloc((size_t)largura * altura);
+    FILE *arquivo;
+    if (matriz == NULL || !gera_labirinto(matriz, largura, altura, semente, 0) || (arquivo = fopen(nome_arq, "w")) == NULL)
+    {
+        printf("Erro ao gerar o labirinto %s\n", nome_arq);
+        free(matriz);
+        return 0;
+    }
+    fprintf(arquivo, "#mapa %d %d\n", largura, altura);
+    for (int y = 0; y < altura; y++)
+    {
+        fwrite(&matriz[(size_t)y * largura], 1, largura, arquivo);
+        fputc('\n', arquivo);
+    }
+    int ok = fclose(arquivo) == 0;
+    free(matriz);
+    printf("Labirinto %dx%d (semente %llu) gravado em %s\n", largura, altura, semente, nome_arq);
+    return ok;
+}
 
-        // Interface grfica
-        BeginDrawing();
-        ClearBackground(BLACK);
-        desenha_mapa(matriz_mapa, *pacman, *player);
-        EndDrawing();
+//Gera e compila um labirinto e faz dele o mapa do jogo (ver usa_mapa_avulso). Retorna o mapa compilado ou NULL se faltou memoria
+const MAPA_COMPILADO *usa_labirinto(int largura, int altura, unsigned long long semente, int num_monstros, char *nome, size_t tamanho_nome)
+{
+    char *matriz = (char *)malloc((size_t)largura * altura);
+    if (matriz == NULL || !gera_labirinto(matriz, largura, altura, semente, num_monstros))
+    {
+        printf("Erro: sem memoria para um labirinto de %dx%d\n", largura, altura);
+        free(matriz);
+        return NULL;
     }
+    snprintf(nome, tamanho_nome, "labirinto %dx%d", largura, altura);
+    MAPA_COMPILADO *compilado = compila_matriz(matriz, largura, altura, nome);
+    free(matriz);
+    if (compilado != NULL) usa_mapa_avulso(compilado);
+    return compilado;
+}
+
+const char *nomes_ia[IA_INCREMENTAL + 1] = {"A*", "tabela de rotas", "campo de fluxo", "HPA*", "D* Lite"};
+
+//Comeca um jogo no labirinto ja carregado e deixa o bot jogar ate "ticks" ticks (ou ate o jogo acabar) com a IA dada.
+//Retorna os ms gastos e os ticks jogados em *jogados.
+double joga_labirinto(JOGO *jogo, unsigned long long semente, long ticks, int modo_ia, long *jogados)
+{
+    unsigned long long rng_bot;
+    long t;
+    semeia(&rng_bot, semente ^ 0x9E3779B97F4A7C15ULL);
+    novo_jogo(jogo, semente, 1);
+    jogo->modo_ia = modo_ia;
+    clock_t inicio = clock();
+    for (t = 0; t < ticks && jogo->estado == JOGO_EM_ANDAMENTO; t++)
+        passo_simulacao(jogo, entrada_bot(jogo, &rng_bot));
+    *jogados = t;
+    return 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
+}
+
+//Benchmark em um labirinto gerado na hora: o bot joga "ticks" ticks com a IA escolhida e mede o tempo por tick e o trabalho do A*.
+//Serve para ver o jogo em mapas muito maiores que os do jogo (1000x1000 = 1 milhao de celulas, onde o A* de cada monstro pode
+//visitar o mapa inteiro). Com o D* Lite o mesmo jogo e jogado de novo com o A*, para comparar.
+int executa_labirinto(int largura, int altura, unsigned long long semente, long ticks, int modo_ia)
+{
+    static JOGO jogo;
+    char nome[32];
+
+    clock_t inicio = clock();
+    const MAPA_COMPILADO *compilado = usa_labirinto(largura, altura, semente, 0, nome, sizeof(nome));
+    if (compilado == NULL) return 0;
+    double ms_mapa = 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
+
+    novo_jogo(&jogo, semente, 1);
+    printf("%s: %d celulas, %d monstros, %d pontos; gerado e compilado em %.1f ms; memoria do jogo %.1f MB\n", nome, largura * altura,
+           jogo.num_monstros, compilado->pontos_fase, ms_mapa, jogo.memoria.tamanho / (1024.0 * 1024.0));
+    printf("IA: %s%s\n", nomes_ia[modo_ia], modo_ia == IA_TABELA_ROTAS && jogo.tabela_rotas == NULL ? " (mapa sem tabela: os monstros usam o HPA*)" : "");
+    if (jogo.grafo_hpa != NULL)
+        printf("Grafo do HPA*: %d clusters de %dx%d, %d nos, %d arestas (%.1f KB)\n", jogo.grafo_hpa->clusters_x * jogo.grafo_hpa->clusters_y,
+               LADO_CLUSTER, LADO_CLUSTER, jogo.grafo_hpa->num_nos, jogo.grafo_hpa->num_arestas,
+               ((jogo.grafo_hpa->num_nos * 2.0 + jogo.grafo_hpa->num_arestas * 2.0) * sizeof(int)) / 1024.0);
+
+    long t;
+    double ms = joga_labirinto(&jogo, semente, ticks, modo_ia, &t);
+
+    printf("%ld ticks em %.1f ms (%.3f ms por tick), %d pontos, %d vidas\n", t, ms, t > 0 ? ms / t : 0.0, jogo.player.pontuacao, jogo.player.vida);
+    if (jogo.arena.buscas > 0)
+        printf("A*: %ld buscas, media de %.0f nodes por busca, pico de %d nodes (de %d celulas)\n", jogo.arena.buscas,
+               (double)jogo.arena.total_alocados / jogo.arena.buscas, jogo.arena.pico, largura * altura);
+    if (jogo.campo_fluxo.calculos > 0)
+        printf("Campo de fluxo: %ld BFS, %ld reaproveitados\n", jogo.campo_fluxo.calculos, jogo.campo_fluxo.reaproveitados);
+    if (jogo.hpa.buscas_abstratas > 0)
+        printf("HPA*: %ld passos locais, %ld pelo caminho guardado, %ld buscas no grafo (media de %.0f nos expandidos), %ld sem caminho\n",
+               jogo.hpa.buscas_locais, jogo.hpa.reaproveitados, jogo.hpa.buscas_abstratas,
+               (double)jogo.hpa.nos_expandidos / jogo.hpa.buscas_abstratas, jogo.hpa.sem_caminho);
+    if (jogo.incremental.passos > 0)
+        printf("D* Lite: %ld buscas consertadas (acertos), %ld do zero (falhas); %.1f celulas expandidas por passo dos monstros, pico de %d\n",
+               jogo.incremental.reaproveitadas, jogo.incremental.reiniciadas, (double)jogo.incremental.nos_expandidos / jogo.incremental.passos,
+               jogo.incremental.pico_nos_passo);
+    else if (modo_ia == IA_INCREMENTAL)
+        printf("D* Lite: mapa grande demais para uma busca por monstro (mais de %d celulas x monstros), os monstros usaram o HPA*\n",
+               MAXIMO_CELULAS_INCREMENTAL);
 
-    // Fecha a janela do jogo
-    CloseWindow();
+    if (jogo.incremental.passos > 0) //o mesmo jogo com um A* novo a cada passo
+    {
+        double celulas_incremental = (double)jogo.incremental.nos_expandidos / jogo.incremental.passos;
+        long t_a_estrela;
+        double ms_a_estrela = joga_labirinto(&jogo, semente, ticks, IA_A_ESTRELA, &t_a_estrela);
+        double nodes_a_estrela = jogo.passos_monstros > 0 ? (double)jogo.arena.total_alocados / jogo.passos_monstros : 0.0;
+        printf("D* Lite x A* no mesmo jogo: %.3f x %.3f ms por tick (%.1fx), %.1f celulas expandidas x %.0f nodes por passo dos monstros\n",
+               t > 0 ? ms / t : 0.0, t_a_estrela > 0 ? ms_a_estrela / t_a_estrela : 0.0, ms > 0 && t_a_estrela > 0 ? (ms_a_estrela / t_a_estrela) / (ms / t) : 0.0,
+               celulas_incremental, nodes_a_estrela);
+    }
+    libera_jogo(&jogo);
+    return 1;
 }
-int main(void)
+
+//Benchmark do custo do tick com cada vez mais monstros (10, 100, 1000 e 10000) no mesmo labirinto: o bot joga "ticks" ticks com a IA
+//escolhida, comecando outro jogo quando um acaba. Mostra o tempo medio por tick e por passo dos monstros (o tick em que todos andam)
+//e o custo de cada monstro a mais em relacao a primeira medida: com o campo de fluxo a BFS e a mesma para qualquer numero de monstros,
+//entao o que sobra e o passo de cada um (consulta, grade de ocupacao), que deve ficar constante.
+int escala_monstros(int largura, int altura, long ticks, int modo_ia)
 {
-    while (1)  // Loop principal para manter o menu ativo
+    static JOGO jogo;
+    char nome[32];
+    double ms_passo_base = 0.0;
+    int monstros_base = 0;
+
+    printf("Labirinto %dx%d, %ld ticks por medida, IA: %s\n", largura, altura, ticks, nomes_ia[modo_ia]);
+    printf("%9s %8s %12s %14s %22s %8s\n", "monstros", "jogos", "ms por tick", "ms por passo", "us por monstro a mais", "MB");
+    for (int monstros = 10; monstros <= 10000; monstros *= 10)
     {
-        int opcao = chama_menu();
+        unsigned long long rng_bot;
+        if (usa_labirinto(largura, altura, 1, monstros, nome, sizeof(nome)) == NULL) return 0;
+        semeia(&rng_bot, 0x9E3779B97F4A7C15ULL);
+        novo_jogo(&jogo, 1, 1);
+        jogo.modo_ia = modo_ia;
 
-        switch (opcao)
+        long jogos = 1, passos = 0;
+        clock_t inicio = clock();
+        for (long t = 0; t < ticks; t++)
         {
-        case 0: //Cdigo para novo jogo
+            if (jogo.estado != JOGO_EM_ANDAMENTO) //o Pac-Man perdeu (ou venceu): comeca outro jogo, somando os passos do anterior
+            {
+                passos += jogo.passos_monstros;
+                novo_jogo(&jogo, 1 + jogos++, 1);
+                jogo.modo_ia = modo_ia;
+            }
+            passo_simulacao(&jogo, entrada_bot(&jogo, &rng_bot));
+        }
+        double ms = 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
+        passos += jogo.passos_monstros;
+
+        double ms_passo = passos > 0 ? ms / passos : 0.0;
+        size_t memoria = jogo.memoria.tamanho + jogo.monstros.memoria.tamanho + jogo.incremental.memoria.tamanho;
+        printf("%9d %8ld %12.4f %14.4f ", jogo.num_monstros, jogos, ticks > 0 ? ms / ticks : 0.0, ms_passo);
+        if (monstros_base == 0 || jogo.num_monstros == monstros_base) //o labirinto nao tinha lugar para mais monstros
         {
-            char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA];
-            POS_PACMAN pacman;
-            STATUS_PLAYER player;
-            player.fase = 1;
-            player.dificuldade = 1;
-            gameplay(matriz_mapa, &pacman, &player, 0);
-            break;
+            ms_passo_base = ms_passo;
+            monstros_base = jogo.num_monstros;
+            printf("%22s", "-");
         }
-        case 1: //Cdigo para carregar jogo
+        else
         {
-            char matriz_mapa[LINHAS_MAPA][COLUNAS_MAPA];
-            POS_PACMAN pacman;
-            STATUS_PLAYER player;
-            carregar_jogo(matriz_mapa, &player, &pacman);
-            gameplay(matriz_mapa, &pacman, &player, 1);
-            break;
+            printf("%22.4f", 1000.0 * (ms_passo - ms_passo_base) / (jogo.num_monstros - monstros_base));
         }
-        case 2: // Cdigo para exibir ranking
+        printf(" %8.1f\n", memoria / (1024.0 * 1024.0));
+    }
+    libera_jogo(&jogo);
+    return 1;
+}
+
+//Benchmark das threads da IA: o mesmo jogo (labirinto, semente e entradas do bot) jogado com 1, 2, 4... ate "maximo_threads" threads
+//decidindo os passos dos monstros. Mostra o tempo medio por tick e por passo dos monstros, o pior tick (o quadro mais lento que o jogo
+//teria) e a aceleracao em relacao a uma thread, e confere pelo checksum que o jogo terminou exatamente igual ao de uma thread.
+int escala_threads(int largura, int altura, long ticks, int modo_ia, int num_monstros, int maximo_threads)
+{
+    static JOGO jogo;
+    char nome[32];
+    double ms_passo_serial = 0.0;
+    unsigned int checksum_serial = 0;
+    int iguais = 1;
+
+    if (usa_labirinto(largura, altura, 1, num_monstros, nome, sizeof(nome)) == NULL) return 0;
+    if (maximo_threads > MAXIMO_THREADS_IA) maximo_threads = MAXIMO_THREADS_IA;
+    novo_jogo(&jogo, 1, 1);
+    printf("%s: %d monstros, %ld ticks por medida, IA: %s, ate %d threads (%d nucleos)\n", nome, jogo.num_monstros, ticks, nomes_ia[modo_ia],
+           maximo_threads, numero_de_nucleos());
+    if (jogo.num_monstros < MINIMO_MONSTROS_PARALELO)
+        printf("Menos de %d monstros: as decisoes ficam na thread do jogo com qualquer numero de threads\n", MINIMO_MONSTROS_PARALELO);
+    printf("%8s %12s %14s %14s %11s %10s\n", "threads", "ms por tick", "ms por passo", "pior tick ms", "aceleracao", "checksum");
+    for (int threads = 1; threads <= maximo_threads; threads = threads * 2 <= maximo_threads ? threads * 2 : maximo_threads)
+    {
+        unsigned long long rng_bot;
+        semeia(&rng_bot, 0x9E3779B97F4A7C15ULL);
+        novo_jogo(&jogo, 1, 1);
+        jogo.modo_ia = modo_ia;
+        int em_uso = define_threads_ia(&jogo, threads);
+
+        long jogos = 1, passos = 0;
+        double pior_tick = 0.0, inicio = agora_segundos();
+        unsigned int checksum = 0;
+        for (long t = 0; t < ticks; t++)
         {
-            TIPO_SCORE scores[MAXSCORES];
-            le_arquivo(scores, "highscores.bin");
-            exibe_highscores(scores);
-            break;
+            if (jogo.estado != JOGO_EM_ANDAMENTO) //comeca outro jogo, somando os passos e o checksum do anterior
+            {
+                passos += jogo.passos_monstros;
+                checksum = mistura_checksum(checksum, (int)checksum_jogo(&jogo));
+                novo_jogo(&jogo, 1 + jogos++, 1);
+                jogo.modo_ia = modo_ia;
+            }
+            double inicio_tick = agora_segundos();
+            passo_simulacao(&jogo, entrada_bot(&jogo, &rng_bot));
+            if (agora_segundos() - inicio_tick > pior_tick)
+                pior_tick = agora_segundos() - inicio_tick;
         }
-        case 3: // Cdigo para sair do jogo
-            CloseWindow();  // Fecha a janela aberta
-            return 0;  // Encerra o programa
+        double ms = 1000.0 * (agora_segundos() - inicio);
+        passos += jogo.passos_monstros;
+        checksum = mistura_checksum(checksum, (int)checksum_jogo(&jogo));
+
+        double ms_passo = passos > 0 ? ms / passos : 0.0;
+        if (threads == 1)
+        {
+            ms_passo_serial = ms_passo;
+            checksum_serial = checksum;
         }
+        iguais &= checksum == checksum_serial;
+        printf("%8d %12.4f %14.4f %14.3f %10.2fx %10.8x%s\n", em_uso, ticks > 0 ? ms / ticks : 0.0, ms_passo, 1000.0 * pior_tick,
+               ms_passo > 0 ? ms_passo_serial / ms_passo : 0.0, checksum, checksum == checksum_serial ? "" : " DIFERENTE");
+        if (threads == maximo_threads) break;
+    }
+    printf("%s\n", iguais ? "OK: mesmo jogo com qualquer numero de threads" : "FALHOU: o jogo mudou com as threads");
+    libera_jogo(&jogo);
+    return iguais;
+}
+
+//Le as dimensoes de um labirinto da linha de comando. Retorna 0 (com uma mensagem) se nao forem validas
+int dimensoes_labirinto(const char *texto_largura, const char *texto_altura, int *largura, int *altura)
+{
+    *largura = atoi(texto_largura);
+    *altura = atoi(texto_altura);
+    if (*largura < 3 || *altura < 3 || *largura > MAXIMO_LADO_MAPA || *altura > MAXIMO_LADO_MAPA
+        || (long long)*largura * *altura > MAXIMO_CELULAS_MAPA)
+    {
+        printf("Dimensoes invalidas: de 3x3 ate %dx%d, no maximo %d celulas\n", MAXIMO_LADO_MAPA, MAXIMO_LADO_MAPA, MAXIMO_CELULAS_MAPA);
+        return 0;
+    }
+    return 1;
+}
+
+//Modo headless: roda a simulacao sem janela, o mais rapido possivel.
+//Uso: pacman_headless [--mapa arquivo.txt] ...           - antes de qualquer outra opcao: joga so o mapa dado, em vez dos mapaN.txt
+//     pacman_headless [ticks] [semente]                  - bot jogando partidas seguidas, mede ticks/ms
+//     pacman_headless --grava arquivo [semente] [fase]  - bot joga uma partida e o replay e gravado
+//     pacman_headless --replay arquivo [repeticoes]     - re-simula o replay e confere o resultado
+//     pacman_headless --simulacao-thread arquivo        - joga o replay na thread da simulacao e confere os retratos lidos
+//     pacman_headless --bfs [repeticoes]                - compara a BFS por bitboards com o A* nos mapas do jogo
+//     pacman_headless --compila-mapas                   - compila os mapaN.txt em mapas.pmc (o jogo tambem faz isso se precisar)
+//     pacman_headless --gera-labirinto arquivo largura altura [semente]          - grava um labirinto gerado como mapa .txt
+//     pacman_headless --labirinto largura altura [semente] [ticks] [modo_ia]     - benchmark em um labirinto gerado (modo_ia: 0 A*, 1 rotas, 2 fluxo, 3 HPA*, 4 D* Lite)
+//     pacman_headless --escala-monstros [largura] [altura] [ticks] [modo_ia]    - custo do tick com 10 a 10000 monstros (padrao: 513x513, 600, fluxo)
+//     pacman_headless --escala-threads [largura] [altura] [ticks] [modo_ia] [monstros] [threads]
+//                                                        - o mesmo jogo com 1 a N threads decidindo os passos dos monstros
+//                                                          (padrao: 257x257, 600, HPA*, 1000 monstros, todos os nucleos)
+int main(int argc, char *argv[])
+{
+    int largura, altura;
+    if (argc > 1 && strcmp(argv[1], "--compila-mapas") == 0)
+        return compila_mapas(ARQUIVO_MAPAS_COMPILADOS) ? 0 : 1;
+    if (argc > 4 && strcmp(argv[1], "--gera-labirinto") == 0)
+    {
+        if (!dimensoes_labirinto(argv[3], argv[4], &largura, &altura)) return 1;
+        return grava_labirinto(argv[2], largura, altura, argc > 5 ? strtoull(argv[5], NULL, 10) : 1) ? 0 : 1;
+    }
+    if (argc > 3 && strcmp(argv[1], "--labirinto") == 0)
+    {
+        if (!dimensoes_labirinto(argv[2], argv[3], &largura, &altura)) return 1;
+        unsigned long long semente = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+        long ticks = argc > 5 ? atol(argv[5]) : 600;
+        int modo_ia = argc > 6 ? atoi(argv[6]) : IA_TABELA_ROTAS;
+        if (modo_ia < IA_A_ESTRELA || modo_ia > IA_INCREMENTAL) modo_ia = IA_TABELA_ROTAS;
+        return executa_labirinto(largura, altura, semente, ticks, modo_ia) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--escala-monstros") == 0)
+    {
+        largura = altura = 513;
+        if (argc > 3 && !dimensoes_labirinto(argv[2], argv[3], &largura, &altura)) return 1;
+        long ticks = argc > 4 ? atol(argv[4]) : 600;
+        int modo_ia = argc > 5 ? atoi(argv[5]) : IA_CAMPO_FLUXO;
+        if (modo_ia < IA_A_ESTRELA || modo_ia > IA_INCREMENTAL) modo_ia = IA_CAMPO_FLUXO;
+        return escala_monstros(largura, altura, ticks, modo_ia) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--escala-threads") == 0)
+    {
+        largura = altura = 257;
+        if (argc > 3 && !dimensoes_labirinto(argv[2], argv[3], &largura, &altura)) return 1;
+        long ticks = argc > 4 ? atol(argv[4]) : 600;
+        int modo_ia = argc > 5 ? atoi(argv[5]) : IA_HIERARQUICA;
+        int num_monstros = argc > 6 ? atoi(argv[6]) : 1000;
+        int threads = argc > 7 ? atoi(argv[7]) : numero_de_nucleos();
+        if (modo_ia < IA_A_ESTRELA || modo_ia > IA_INCREMENTAL) modo_ia = IA_HIERARQUICA;
+        if (num_monstros < 1) num_monstros = 1000;
+        if (threads < 1) threads = 1;
+        return escala_threads(largura, altura, ticks, modo_ia, num_monstros, threads) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--mapa") == 0)
+    {
+        if (!abre_mapa_avulso(argv[2])) return 1;
+        argv[2] = argv[0]; //o resto da linha de comando e lido como se o --mapa nao estivesse la
+        argv += 2;
+        argc -= 2;
+    }
+    if (!abre_mapas_compilados()) return 1;
+
+    if (argc > 2 && strcmp(argv[1], "--grava") == 0)
+    {
+        unsigned long long semente = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+        int fase = argc > 4 ? atoi(argv[4]) : 1;
+        if (fase < 1 || fase > num_fases()) fase = 1;
+        return grava_partida_bot(argv[2], semente, fase) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+    {
+        int repeticoes = argc > 3 ? atoi(argv[3]) : 1;
+        return confere_replay(argv[2], repeticoes > 0 ? repeticoes : 1) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--simulacao-thread") == 0)
+        return confere_simulacao_thread(argv[2]) ? 0 : 1;
+
+    if (argc > 1 && strcmp(argv[1], "--bfs") == 0)
+    {
+        int repeticoes = argc > 2 ? atoi(argv[2]) : 5;
+        return compara_bfs_a_estrela(repeticoes > 0 ? repeticoes : 1) ? 0 : 1;
+    }
+
+    static JOGO jogo;
+    long total_ticks = argc > 1 ? atol(argv[1]) : 1000000;
+    unsigned long long semente = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    unsigned long long rng_bot;
+    long jogos = 1, vitorias = 0, soma_pontos = 0;
 
-        // Verifica se ESC foi pressionado para sair do loop principal
-        if (IsKeyPressed(KEY_ESCAPE))
+    semeia(&rng_bot, semente ^ 0x9E3779B97F4A7C15ULL);
+    novo_jogo(&jogo, semente, 1);
+
+    clock_t inicio = clock();
+    for (long t = 0; t < total_ticks; t++)
+    {
+        if (jogo.estado != JOGO_EM_ANDAMENTO) //terminou um jogo, comeca outro
         {
-            CloseWindow();  // Fecha qualquer janela aberta
-            return 0;  // Encerra o programa
+            vitorias += jogo.estado == JOGO_VENCIDO;
+            soma_pontos += jogo.player.pontuacao;
+            novo_jogo(&jogo, semente + jogos, 1);
+            jogos++;
         }
+        passo_simulacao(&jogo, entrada_bot(&jogo, &rng_bot));
     }
+    double ms = 1000.0 * (double)(clock() - inicio) / CLOCKS_PER_SEC;
 
+    printf("%ld ticks em %.1f ms (%.0f ticks/ms, %.1f s de jogo)\n", total_ticks, ms, ms > 0 ? total_ticks / ms : 0.0, total_ticks * DT_SIMULACAO);
+    printf("%ld jogos (%ld terminados, %ld vitorias), media de %.1f pontos por jogo terminado\n",
+           jogos, jogos - 1, vitorias, jogos > 1 ? (double)soma_pontos / (jogos - 1) : 0.0);
+    libera_jogo(&jogo);
     return 0;
 }
+#endif
+#endif